@@ -28,6 +28,13 @@ META_PATH = "meta.h5"
 INPUT_PATH = "chunks/"
 
 
+# Traces written before the "Input Type" column only hold the MPI datatype
+def input_type(trace):
+    if "Input Type" in trace.dtype.names:
+        return trace["Input Type"].decode()
+    return trace["MPI Datatype"].decode()
+
+
 def filter_dataset(meta_path, metric_name="Compression Rate", min_size=0):
     f = h5py.File(meta_path, "r")
     dset = f["Compression-Trace"]
@@ -50,6 +57,7 @@ def filter_dataset(meta_path, metric_name="Compression Rate", min_size=0):
                             trace["Compressor name"].decode(), trace["Compressor Level"]
                         ),
                         trace["Compressor Level"],
+                        input_type(trace),
                     )
     return winners
 
@@ -70,6 +78,30 @@ device = "cuda" if torch.cuda.is_available() else "cpu"
 print(f"Using {device} device")
 
 
+# The input type the library resolved the datatype of a write to
+INPUT_DTYPES = {
+    "float": np.float32,
+    "double": np.float64,
+    "int32": np.int32,
+    "int64": np.int64,
+    "uint8": np.uint8,
+}
+
+# Converted to float like the library does for the model input, other
+# datatypes are read as floats
+MPI_DTYPES = {
+    "MPI_DOUBLE": np.float64,
+    "MPI_INT": np.int32,
+    "MPI_INT32_T": np.int32,
+    "MPI_LONG": np.int64,
+    "MPI_LONG_LONG": np.int64,
+    "MPI_LONG_LONG_INT": np.int64,
+    "MPI_INT64_T": np.int64,
+    "MPI_UNSIGNED_CHAR": np.uint8,
+    "MPI_UINT8_T": np.uint8,
+}
+
+
 class ChunkDataset(Dataset):
     def __init__(self, items, data_path, dim_size, transform=None):
         self.transform = transform
@@ -101,12 +133,16 @@ class ChunkDataset(Dataset):
     def __getitem__(self, idx):
         chunk_name = self.items_keys[idx]
         item_path = Path("{}/{}".format(self.data_path, chunk_name))
-        chunk = np.fromfile(item_path, dtype=np.float32)
-        chunk = chunk[: self.dim_size]
+        type_name = self.items[chunk_name][4]
+        dtype = INPUT_DTYPES.get(type_name, MPI_DTYPES.get(type_name, np.float32))
+        chunk = np.fromfile(item_path, dtype=dtype)
+        with np.errstate(over="ignore"):
+            chunk = chunk[: self.dim_size].astype(np.float32)
         chunk = chunk.reshape(1, chunk.shape[0])
         # Required: RuntimeError: stack expects each tensor to be equal size, but got [1, 4096] at entry 0 and [1, 2] at entry 8
         chunk = np.resize(chunk, (1, self.dim_size))
-        chunk = np.nan_to_num(chunk, copy=True)
+        # Values that are no finite float become 0, like in the library
+        chunk[~np.isfinite(chunk)] = 0
 
         if np.isnan(chunk).any():
             self.test += 1
@@ -0,0 +1,19 @@
+#ifndef IOA_AGGREGATION_H
+#define IOA_AGGREGATION_H
+#include <glib.h>
+#include <mpi.h>
+
+// Regions are compressed in chunks of this size without a container block size
+#define AGGREGATION_CHUNK (4 * 1024 * 1024)
+// Ranks send their data to the aggregator in messages of at most this size
+#define AGGREGATION_PIECE (1024 * 1024 * 1024)
+
+void aggregation_init(int aggregators, int block_kib, int threads);
+void aggregation_open(MPI_Comm comm, MPI_File fh);
+gboolean aggregation_active(MPI_File fh);
+void aggregation_write(MPI_File fh, MPI_Offset offset, const void *buf,
+                       size_t size, MPI_Datatype datatype);
+void aggregation_close(MPI_File fh);
+void aggregation_report();
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef IOA_ANALYSIS_ASYNC_H
+#define IOA_ANALYSIS_ASYNC_H
+#include <analysis/compression.h>
+#include <glib.h>
+#include <mpi.h>
+
+typedef enum {
+    // Writer waits until enough queued analyses finished
+    ASYNC_POLICY_BLOCK = 0,
+    // Analysis of the write is skipped and counted
+    ASYNC_POLICY_DROP,
+    _ASYNC_POLICY_COUNT
+} Async_Policy;
+
+void async_analysis_init(int workers, size_t max_queued_bytes,
+                         Async_Policy policy);
+gboolean async_analysis_submit(MPI_File fh, const char *operation,
+                               const void *buf, size_t buf_size,
+                               MPI_Datatype datatype, MPI_Offset offset,
+                               gint count);
+void async_analysis_collect();
+void async_analysis_drain();
+gboolean async_analysis_running();
+int async_analysis_worker();
+int async_analysis_worker_count();
+
+Async_Policy name_to_async_policy(const char *name);
+#endif
\ No newline at end of file
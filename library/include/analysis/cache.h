@@ -0,0 +1,40 @@
+#ifndef IOA_ANALYSIS_CACHE_H
+#define IOA_ANALYSIS_CACHE_H
+#include <analysis/compression.h>
+#include <glib.h>
+#include <mpi.h>
+
+typedef enum {
+    CACHE_ANALYSIS = 0,
+    CACHE_INFERENCE,
+    _CACHE_KIND_COUNT
+} Cache_Kind;
+
+typedef struct {
+    guint64 hash;
+    size_t size;
+    MPI_Datatype datatype;
+    Cache_Kind kind;
+} Cache_Key;
+
+void result_cache_init(int capacity);
+gboolean result_cache_enabled();
+Cache_Key result_cache_key(Cache_Kind kind, const void *buf, size_t size,
+                           MPI_Datatype datatype);
+
+GList *result_cache_lookup_runs(const Cache_Key *key);
+void result_cache_store_runs(const Cache_Key *key, GList *runs);
+gboolean result_cache_lookup_inference(const Cache_Key *key,
+                                       CompressionSample *chosen,
+                                       CompressionSample *best,
+                                       Inference_Choice *choice);
+void result_cache_store_inference(const Cache_Key *key,
+                                  CompressionSample chosen,
+                                  CompressionSample best,
+                                  Inference_Choice choice);
+void result_cache_drop(Cache_Kind kind);
+
+void result_cache_report();
+void result_cache_cleanup();
+
+#endif
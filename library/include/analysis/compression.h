@@ -15,13 +15,31 @@ typedef enum {
     _METRIC_COUNT
 } Metric_Type;
 
+// Per call, over the repeated measurements
+typedef struct {
+    long long median;
+    long long p10;
+    long long p90;
+} Duration_Stats;
+
 typedef struct {
     Metric_Type metric;
     CompressionAlgorithmID algorithmID;
     gint level;
     gfloat metric_value;
     long duration;
+    // In ns, duration is the median in µs
+    Duration_Stats timing;
+    // Calls timed together, as small inputs are below the clock resolution
+    int batch;
+    // Wall-clock time of the whole analysis of the intercepted write
+    long overhead;
     size_t size;
+    // Bytes actually compressed and confidence of the extrapolated values
+    size_t sample_size;
+    gfloat confidence;
+    // Reused from an earlier analysis of identical content
+    gboolean cached;
     gchar *chunk_name;
 } CompressionRun;
 
@@ -32,6 +50,16 @@ typedef struct {
     size_t compressed_size;
 } CompressionSample;
 
+// How the compressor of an inferred write was chosen
+typedef struct {
+    // Probability of the predicted compressor
+    gfloat confidence;
+    // Compressors measured as the confidence was too low, 0 if none
+    int searched;
+    // Measurement of the predicted compressor, before any fallback search
+    CompressionSample predicted;
+} Inference_Choice;
+
 GList *test_algorithms(MPI_File fh, const void *buf, size_t buf_size,
                        MPI_Datatype datatype);
 
@@ -41,6 +69,9 @@ CompressionSample best_compressor(const void *buf, size_t buf_size,
 
 CompressionSample evaluate(CompressionAlgorithm_Level compressor_info,
                            const void *buf, size_t buf_size);
+CompressionSample evaluate_output(CompressionAlgorithm_Level compressor_info,
+                                  const void *buf, size_t buf_size,
+                                  void **output);
 
 gboolean store_training_chunk(char *name, const void *buf, size_t size,
                               MPI_Datatype datatype);
@@ -0,0 +1,19 @@
+#ifndef IOA_ANALYSIS_SAMPLING_H
+#define IOA_ANALYSIS_SAMPLING_H
+#include <glib.h>
+#include <stddef.h>
+
+typedef struct {
+    const char *data;
+    size_t size;
+} Sample_Block;
+
+gboolean sampling_applies(size_t buf_size);
+int sample_blocks(const void *buf, size_t buf_size, Sample_Block **blocks);
+int stratified_blocks(const void *buf, size_t buf_size, int count,
+                      size_t block_size, Sample_Block **blocks);
+size_t sample_size(const Sample_Block *blocks, int count);
+gfloat sample_confidence(const Sample_Block *blocks,
+                         const size_t *compressed_sizes, int count,
+                         size_t buf_size);
+#endif
\ No newline at end of file
@@ -20,6 +20,10 @@ typedef struct {
                        size_t srcSize, int compressionLevel);
     size_t (*decompress)(const char *src, char *dst, size_t compressedSize,
                          size_t dstCapacity);
+    // Reusable compressor state, cached per thread (see compression_context)
+    void *(*context_create)();
+    void (*context_reset)(void *context);
+    void (*context_free)(void *context);
     int *levels;
     int levels_count;
     const char *name;
@@ -38,6 +42,8 @@ typedef struct {
 
 extern GArray *available_compressors;
 void init_compressors();
+void *compression_context(CompressionAlgorithm *compressor);
+void release_compression_contexts();
 const char *compressor_to_name(CompressionAlgorithmID);
 CompressionAlgorithmID name_to_compressor(char *name);
 #endif
\ No newline at end of file
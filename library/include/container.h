@@ -0,0 +1,133 @@
+#ifndef IOA_CONTAINER_H
+#define IOA_CONTAINER_H
+#include <compression.h>
+#include <glib.h>
+#include <mpi.h>
+
+// Appended to the name of the intercepted file
+#define CONTAINER_SUFFIX ".ioa"
+// Algorithm of blocks that are stored uncompressed
+#define CONTAINER_STORED 0xff
+
+typedef enum {
+    CONTAINER_OFF = 0,
+    // Written next to the original file, which is written as before
+    CONTAINER_BESIDE,
+    // Written instead of the original file, which stays empty
+    CONTAINER_REPLACE,
+    _CONTAINER_MODE_COUNT
+} Container_Mode;
+
+typedef struct {
+    char magic[8];
+    guint32 version;
+    guint32 block_header_size;
+} Container_Header;
+
+/*
+ * Every write becomes one block, or one per block size it spans. The header is
+ * followed by compressed_size bytes, the data decompresses to raw_size bytes at
+ * offset, in bytes from the start of the original file.
+ */
+typedef struct {
+    char magic[4];
+    guint8 algorithm;
+    gint8 level;
+    guint16 reserved;
+    guint64 offset;
+    guint64 raw_size;
+    guint64 compressed_size;
+    // XXH3 of the raw data
+    guint64 checksum;
+} Container_Block_Header;
+
+// A block of the container, in the index at its end and in memory
+typedef struct {
+    guint64 offset;
+    guint64 raw_size;
+    // Position of the compressed data in the container
+    guint64 data;
+    guint64 compressed_size;
+    guint64 checksum;
+    // Largest end of this and all blocks before it in the index
+    guint64 max_end;
+    guint8 algorithm;
+    gint8 level;
+    // Other blocks cover some of its bytes, so it's never read in place
+    guint8 overlapped;
+    guint8 reserved[5];
+} Container_Index_Entry;
+
+/*
+ * Last bytes of a closed container. The index starts at an 8 byte aligned
+ * position after the last block and holds count entries, sorted by offset and
+ * then by the order they were written in.
+ */
+typedef struct {
+    char magic[8];
+    guint64 index;
+    guint64 count;
+    // Of the original file
+    guint64 size;
+} Container_Footer;
+
+typedef struct {
+    Container_Index_Entry *blocks;
+    guint64 count;
+    guint64 size;
+    // Set if the blocks point into the mapped container
+    GMappedFile *mapped;
+} Container_Index;
+
+// Contiguous bytes of the original file
+typedef struct {
+    guint64 offset;
+    guint64 size;
+} Container_Run;
+
+// Where the compressed data of a write goes
+typedef struct {
+    MPI_File fh;
+    MPI_Offset offset;
+    // Of non-contiguous file views, in the order of the buffer, or NULL
+    GArray *runs;
+} Write_Target;
+
+Container_Mode name_to_container_mode(const char *name);
+void container_init(Container_Mode mode, int block_kib, int read_threads);
+gboolean container_enabled();
+
+gboolean container_creates(MPI_Comm comm, const char *filename, int amode);
+void container_open(MPI_Comm comm, const char *filename, int amode,
+                    MPI_Info info, MPI_File fh, gboolean created);
+gboolean container_writes(MPI_File fh);
+gboolean container_replaces(MPI_File fh);
+GArray *container_view_runs(MPI_File fh, MPI_Offset offset, size_t size);
+gboolean container_target(MPI_File fh, MPI_Offset offset, size_t size,
+                          Write_Target *target);
+void container_target_copy(Write_Target *copy, const Write_Target *target);
+void container_target_clear(Write_Target *target);
+void container_write(const Write_Target *target, const void *buf,
+                     size_t size, CompressionAlgorithm_Level compressor,
+                     void *compressed, size_t compressed_size);
+void container_store(MPI_File fh, MPI_Offset offset, const void *buf,
+                     size_t size);
+gboolean container_collective_begin(MPI_File fh);
+void container_collective_end(MPI_File fh);
+void container_close(MPI_File fh);
+
+gboolean container_reads(MPI_File fh);
+int container_read(MPI_File fh, MPI_Offset offset, void *buf, size_t size,
+                   size_t *read_size);
+
+void container_index_build(Container_Index *index);
+void container_index_find(const Container_Index *index, guint64 start,
+                          guint64 end, guint64 *first, guint64 *last);
+gboolean container_index_map(const char *path, Container_Index *index);
+void container_index_free(Container_Index *index);
+void container_footer_init(Container_Footer *footer, guint64 index,
+                           guint64 count, guint64 size);
+
+void container_report();
+
+#endif
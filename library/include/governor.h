@@ -0,0 +1,26 @@
+#ifndef IOA_GOVERNOR_H
+#define IOA_GOVERNOR_H
+#include <glib.h>
+
+// Blocks per buffer if sampling is forced without --sample-blocks
+#define GOVERNOR_SAMPLE_BLOCKS 16
+
+// Escalation order, each step is cheaper than the previous one
+typedef enum {
+    GOVERNOR_FULL = 0,
+    GOVERNOR_SAMPLE,
+    GOVERNOR_SKIP,
+    GOVERNOR_DISABLED,
+    _GOVERNOR_STATE_COUNT
+} Governor_State;
+
+void governor_init(gfloat max_overhead);
+gboolean governor_admit();
+void governor_account(long duration);
+gboolean governor_forces_sampling();
+void governor_report();
+
+const char *governor_state_name(Governor_State state);
+gfloat parse_overhead(const gchar *text);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef IOA_INFERENCING_BANDIT_H
+#define IOA_INFERENCING_BANDIT_H
+#include <analysis/cache.h>
+#include <container.h>
+#include <glib.h>
+#include <inferencing/input.h>
+
+// Chooses the compressor of intercepted writes instead of the model
+typedef enum {
+    SELECTOR_MODEL = 0,
+    SELECTOR_BANDIT,
+    _SELECTOR_COUNT
+} Selector;
+
+Selector name_to_selector(const char *name);
+
+void bandit_init(double exploration, const char *state_path);
+gboolean bandit_enabled();
+void bandit_record(const void *buf, size_t buf_size, Input_Type type,
+                   const Cache_Key *key, gboolean evaluated,
+                   const Write_Target *target);
+void bandit_merge();
+void bandit_report();
+void bandit_cleanup();
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef IOA_INFERENCING_BATCH_H
+#define IOA_INFERENCING_BATCH_H
+#include <analysis/cache.h>
+#include <compression.h>
+#include <container.h>
+#include <glib.h>
+#include <inferencing/compression.h>
+#include <inferencing/decision.h>
+
+void inference_batch_init(int max_batch, int max_wait);
+gboolean inference_batching();
+void inference_batch_submit(const void *buf, size_t buf_size,
+                            Input_Type type, const Cache_Key *key,
+                            const Decision_Key *region, gboolean evaluated,
+                            const Write_Target *target);
+void inference_batch_flush();
+void inference_batch_cleanup();
+
+void record_inference(const Prediction *prediction, const void *buf,
+                      size_t buf_size, const Cache_Key *key,
+                      gboolean evaluated, const Write_Target *target);
+
+#endif
@@ -2,14 +2,50 @@
 #define IOA_INFERENCING_COMPRESSION_H
 #include <analysis/compression.h>
 #include <compression.h>
+#include <inferencing/input.h>
 #include <inferencing/onnxruntime_c_api.h>
 #include <stddef.h>
 
-CompressionAlgorithm_Level *parse_labels(char *path);
-Metric_Type parse_metric(char *path);
-int model_input_size(char *path);
-void init_ml(char *model_path, char *settings_path);
+typedef enum {
+    INFERENCE_BACKEND_ONNX = 0,
+    // In-tree MLP, see inferencing/mlp.h
+    INFERENCE_BACKEND_NATIVE,
+    _INFERENCE_BACKEND_COUNT
+} Inference_Backend;
+
+typedef enum {
+    INFERENCE_VOTE_MEAN = 0,
+    INFERENCE_VOTE_MAJORITY,
+    _INFERENCE_VOTE_COUNT
+} Inference_Vote;
+
+// Most compressors a prediction ranks
+#define MAX_CANDIDATES 8
+
+typedef struct {
+    CompressionAlgorithm_Level compressor;
+    // Mean probability of the predicted class over the windows of the buffer
+    float confidence;
+    // Classes by descending score, the first is the predicted one
+    CompressionAlgorithm_Level candidates[MAX_CANDIDATES];
+    int candidate_count;
+} Prediction;
+
+CompressionAlgorithm_Level *parse_labels(const char *path, int *count);
+Metric_Type parse_metric(const char *path);
+int model_input_size(const char *path);
+Inference_Backend name_to_inference_backend(const char *name);
+Inference_Vote name_to_inference_vote(const char *name);
+int name_to_ort_execution(const char *name);
+int name_to_ort_optimization(const char *name);
+void init_ml(const char *model_path, const char *settings_path);
 void cleanup_ml();
-CompressionAlgorithm_Level predict_compressor(const void *data, size_t length);
+void take_reloaded_model();
+Prediction predict_compressor(const void *data, size_t length,
+                              Input_Type type);
+void predict_compressors(const void **data, const size_t *lengths,
+                         const Input_Type *types, int count,
+                         Prediction *predictions);
+void inference_report();
 
 #endif
\ No newline at end of file
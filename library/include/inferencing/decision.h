@@ -0,0 +1,34 @@
+#ifndef IOA_INFERENCING_DECISION_H
+#define IOA_INFERENCING_DECISION_H
+#include <glib.h>
+#include <inferencing/compression.h>
+#include <inferencing/input.h>
+#include <mpi.h>
+
+// Regions with a decision, the least recently used one is evicted beyond
+#define DECISION_CAPACITY 65536
+
+// A region of a file that is written again in every output step
+typedef struct {
+    // Interned filename with digits replaced, see decision_cache_key
+    const gchar *file;
+    MPI_Offset offset;
+    size_t size;
+    MPI_Datatype datatype;
+} Decision_Key;
+
+void decision_cache_init(int max_reuse, double max_drift);
+gboolean decision_cache_enabled();
+Decision_Key decision_cache_key(MPI_File fh, MPI_Offset offset, size_t size,
+                                MPI_Datatype datatype);
+
+gboolean decision_cache_reuse(const Decision_Key *key, const void *buf,
+                              Input_Type type, Prediction *prediction);
+void decision_cache_store(const Decision_Key *key, const void *buf,
+                          Input_Type type, const Prediction *prediction);
+void decision_cache_clear();
+
+void decision_cache_report();
+void decision_cache_cleanup();
+
+#endif
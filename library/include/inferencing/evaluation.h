@@ -0,0 +1,11 @@
+#ifndef IOA_INFERENCING_EVALUATION_H
+#define IOA_INFERENCING_EVALUATION_H
+#include <glib.h>
+
+void evaluation_init(int rate, gfloat budget);
+gboolean evaluation_admit();
+void evaluation_account(long duration);
+gfloat evaluation_rate();
+void evaluation_report();
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef IOA_INFERENCING_INPUT_H
+#define IOA_INFERENCING_INPUT_H
+#include <mpi.h>
+#include <stddef.h>
+
+// Element types written buffers are converted from into the model input
+typedef enum {
+    // Also used for MPI_BYTE and derived datatypes that are not contiguous
+    INPUT_FLOAT = 0,
+    INPUT_DOUBLE,
+    INPUT_INT32,
+    INPUT_INT64,
+    INPUT_UINT8,
+    _INPUT_TYPE_COUNT
+} Input_Type;
+
+// Fractions of the bytes sampled from blocks spread over a buffer
+typedef struct {
+    double zeros;
+    // Shannon entropy in bits per byte divided by 8
+    double entropy;
+    // Equal to the previous byte
+    double runs;
+    // Equal to the same byte of the previous element, e.g. smooth fields
+    double strided;
+} Byte_Statistics;
+
+Input_Type datatype_to_input_type(MPI_Datatype datatype);
+size_t input_type_size(Input_Type type);
+const char *input_type_name(Input_Type type);
+void convert_input(Input_Type type, const void *data, size_t elements,
+                   float *out);
+void sample_statistics(const void *data, size_t size, size_t element_size,
+                       Byte_Statistics *stats);
+
+#endif
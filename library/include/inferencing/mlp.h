@@ -0,0 +1,37 @@
+#ifndef IOA_INFERENCING_MLP_H
+#define IOA_INFERENCING_MLP_H
+#include <glib.h>
+#include <stddef.h>
+
+typedef struct {
+    int inputs;
+    int outputs;
+    // Row-major, one row per output, NULL if quantized
+    float *weights;
+    // Symmetric int8 weights with one scale per row
+    gint8 *quantized;
+    float *scales;
+    float *bias;
+} MLP_Layer;
+
+/*
+ * Linear layers with ReLU in between, as trained by training.ipynb. Inputs are
+ * normalized element-wise like F.normalize on the channel dimension does.
+ */
+typedef struct {
+    int layer_count;
+    MLP_Layer *layers;
+    int max_rows;
+    int width;
+    // Activations of the current batch, max_rows * width each
+    float *activations[2];
+} MLP;
+
+MLP *mlp_load(const char *path, gboolean quantize, int max_rows);
+void mlp_forward(MLP *mlp, const float *input, int rows, float *logits);
+int mlp_inputs(const MLP *mlp);
+int mlp_outputs(const MLP *mlp);
+const char *mlp_kernel_name();
+void mlp_free(MLP *mlp);
+
+#endif
@@ -9,14 +9,56 @@ extern gboolean opt_tracing;
 extern gboolean opt_inferencing;
 extern gboolean opt_test_compression;
 extern gboolean opt_decompression;
+extern gboolean opt_pruned_search;
+extern gboolean opt_cache_cold;
+extern gboolean opt_ort_shared_model;
+extern gboolean opt_ort_global_threads;
+extern gboolean opt_native_int8;
 extern gboolean _opt_action_required;
 
 extern gint opt_min_chunk_size;
 extern gint opt_repeat_measurements;
+extern gint opt_analysis_threads;
+extern gint opt_read_threads;
+extern gint opt_container_block_size;
+extern gint opt_aggregators;
+extern gint opt_aggregator_threads;
+extern gint opt_sample_blocks;
+extern gint opt_sample_block_size;
+extern gint opt_sample_min_size;
+extern gint opt_async_workers;
+extern gint opt_async_buffer;
+extern gint opt_search_deadline;
+extern gint opt_search_audit;
+extern gint opt_result_cache;
+extern gint opt_inference_batch;
+extern gint opt_inference_wait;
+extern gint opt_inference_windows;
+extern gchar const *opt_inference_vote;
+extern gdouble opt_fallback_threshold;
+extern gint opt_fallback_top_k;
+extern gint opt_decision_reuse;
+extern gint opt_model_reload;
+extern gint opt_evaluation_rate;
+extern gchar const *opt_evaluation_budget;
+extern gdouble opt_decision_drift;
+extern gint opt_ort_intra_threads;
+extern gint opt_ort_inter_threads;
+extern gchar const *opt_async_policy;
+extern gchar const *opt_max_overhead;
 extern gchar const *opt_meta_data_path;
 extern gchar const *opt_chunk_path;
 extern gchar const *opt_model_path;
 extern gchar const *opt_setting_path;
+extern gchar const *opt_selector;
+extern gdouble opt_bandit_exploration;
+extern gchar const *opt_bandit_state;
+extern gchar const *opt_container;
+extern gchar const *opt_inference_backend;
+extern gchar const *opt_ort_execution;
+extern gchar const *opt_ort_optimization;
+extern gchar const *opt_ort_optimized_model;
+extern gchar const *opt_ort_profile;
 extern Metric_Type opt_metric_inferencing;
 
 #endif
\ No newline at end of file
@@ -3,7 +3,9 @@
 #include <analysis/compression.h>
 #include <compression.h>
 #include <glib.h>
+#include <governor.h>
 #include <hdf5.h>
+#include <inferencing/input.h>
 #include <meta.h>
 #include <mpi.h>
 #include <settings.h>
@@ -14,6 +16,9 @@
 extern GHashTable *trackingDB_fh;
 extern GArray *trackingDB_io;
 extern GArray *evaluation_ops;
+extern GArray *trace_counters;
+extern GHashTable *trace_counter_index;
+extern GArray *governor_decisions;
 extern gboolean stop_tracing;
 
 typedef enum {
@@ -44,6 +49,8 @@ typedef struct {
         } IO;
         struct {
             gchar datatype[MPI_MAX_DATAREP_STRING];
+            // Element type the model input is converted from
+            Input_Type input_type;
             gint count;
             gint size;
             MPI_Offset offset;
@@ -51,6 +58,12 @@ typedef struct {
             gint level;
             Metric_Type metric;
             gfloat metric_value;
+            long overhead;
+            size_t sample_size;
+            gfloat confidence;
+            Duration_Stats timing;
+            int batch;
+            gboolean cached;
             gchar *chunk_name;
         } compression;
     };
@@ -64,9 +77,17 @@ typedef struct {
     CompressionAlgorithm_Level compressor_predicted;
     gfloat predicted_metric_value;
     size_t predicted_compressed_size;
+    // Differs from the prediction if the fallback search found a better one
+    CompressionAlgorithm_Level compressor_chosen;
+    gfloat chosen_metric_value;
+    size_t chosen_compressed_size;
     CompressionAlgorithm_Level compressor_tested;
     gfloat tested_metric_value;
     size_t tested_compressed_size;
+    Inference_Choice choice;
+    gboolean cached;
+    // Share of the predictions that were evaluated
+    gfloat sampling_rate;
 } Evaluation_Operation;
 
 void add_compression_run(void *handler, const char *type, CompressionRun run,
@@ -80,8 +101,26 @@ void add_IO_operation(void *handler, const char *type, MPI_Datatype datatype,
                       MPI_Offset offset, gint count, size_t buf_size,
                       long duration);
 
-void add_evaluation_operation(size_t buf_size, CompressionSample predicted,
-                              CompressionSample tested);
+typedef struct {
+    gchar name[100];
+    long value;
+} Trace_Counter;
+
+typedef struct {
+    time_t time;
+    long write;
+    Governor_State state;
+    int skip_interval;
+    gfloat overhead;
+} Governor_Decision;
+
+void add_evaluation_operation(size_t buf_size, CompressionSample chosen,
+                              CompressionSample tested, Inference_Choice choice,
+                              gboolean cached);
+void add_governor_decision(Governor_State state, int skip_interval,
+                           gfloat overhead, long write);
+
+void add_counter(const char *name, long value);
 
 void write_dataset();
 gboolean tracing_stopped();
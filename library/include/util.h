@@ -1,5 +1,6 @@
 #ifndef IOA_UTIL_H
 #define IOA_UTIL_H
+#include <mpi.h>
 #include <sys/time.h>
 #include <time.h>
 
@@ -8,8 +9,15 @@
 
 long long timeInMilliseconds();
 long timeInMicroseconds();
+long long timeInNanoseconds();
+
+void pin_current_thread(int worker, int workers);
+void unpin_current_thread();
 
 void softmax(float *input, int elem, float *out);
 int max_value_index(float *array, int size);
 
+void free_view_type(MPI_Datatype type);
+int contiguous_type(MPI_Datatype type);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,411 @@
+#include <aggregation.h>
+#include <container.h>
+#include <inferencing/compression.h>
+#include <inferencing/input.h>
+#include <string.h>
+#include <tracing.h>
+
+typedef struct {
+    // Ranks of a node that send their data to the same aggregator, rank 0
+    MPI_Comm group;
+    // The aggregators of all nodes, MPI_COMM_NULL on the other ranks
+    MPI_Comm aggregators;
+} Aggregation;
+
+// Contiguous part of a rank, in bytes of the file
+typedef struct {
+    guint64 offset;
+    guint64 size;
+    // Position of its data in the data gathered by the aggregator
+    guint64 data;
+} Aggregated_Part;
+
+// Compressed independently of the other chunks of the region
+typedef struct {
+    guint64 offset;
+    size_t size;
+    const char *data;
+    void *compressed;
+    size_t compressed_size;
+} Aggregated_Chunk;
+
+// A compressor with the bytes of the regions it was predicted for
+typedef struct {
+    guint64 bytes;
+    gint32 algorithm;
+    gint32 level;
+} Compressor_Vote;
+
+static int aggregators_per_node = 0;
+static int threads = 1;
+static guint64 chunk_size = AGGREGATION_CHUNK;
+// Of every file with a container that is open for writing
+static GHashTable *aggregations = NULL;
+static long aggregated_writes = 0;
+static long aggregated_regions = 0;
+static long aggregated_bytes = 0;
+
+/*
+ * aggregators per node gather the parts of collective writes. Chunks follow
+ * the block size of the container, so they are written as one block each.
+ */
+void aggregation_init(int aggregators, int block_kib, int compress_threads) {
+    aggregators_per_node = aggregators;
+    threads = compress_threads;
+    if (block_kib > 0)
+        chunk_size = (guint64)block_kib * 1024;
+    if (aggregators_per_node > 0)
+        aggregations = g_hash_table_new(g_direct_hash, g_direct_equal);
+}
+
+// Collective over comm, consecutive ranks of a node share an aggregator
+void aggregation_open(MPI_Comm comm, MPI_File fh) {
+    if (aggregations == NULL || !container_writes(fh))
+        return;
+    int rank, node_rank, node_size, group_rank;
+    MPI_Comm node;
+    PMPI_Comm_rank(comm, &rank);
+    PMPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL,
+                         &node);
+    PMPI_Comm_rank(node, &node_rank);
+    PMPI_Comm_size(node, &node_size);
+    int groups = MIN(aggregators_per_node, node_size);
+
+    Aggregation *aggregation = g_new(Aggregation, 1);
+    PMPI_Comm_split(node, node_rank * groups / node_size, node_rank,
+                    &aggregation->group);
+    PMPI_Comm_free(&node);
+    PMPI_Comm_rank(aggregation->group, &group_rank);
+    PMPI_Comm_split(comm, group_rank == 0 ? 0 : MPI_UNDEFINED, rank,
+                    &aggregation->aggregators);
+    g_hash_table_insert(aggregations, (void *)fh, aggregation);
+}
+
+gboolean aggregation_active(MPI_File fh) {
+    return aggregations != NULL &&
+           g_hash_table_lookup(aggregations, (void *)fh) != NULL;
+}
+
+static gint compare_parts(gconstpointer a, gconstpointer b) {
+    const Aggregated_Part *part_a = a;
+    const Aggregated_Part *part_b = b;
+    if (part_a->offset != part_b->offset)
+        return (part_a->offset > part_b->offset) -
+               (part_a->offset < part_b->offset);
+    return (part_a->data > part_b->data) - (part_a->data < part_b->data);
+}
+
+/*
+ * Parts that follow each other form a region, which is split into chunks at
+ * multiples of the chunk size. data holds the parts in the order of parts.
+ */
+static GArray *chunk_regions(const Aggregated_Part *parts, int count,
+                             const char *data, GArray *regions) {
+    Aggregated_Chunk current = {0};
+    for (int i = 0; i <= count; ++i) {
+        if (i < count && parts[i].size == 0)
+            continue;
+        if (i < count && current.size > 0 &&
+            parts[i].offset == current.offset + current.size) {
+            current.size += parts[i].size;
+            data += parts[i].size;
+            continue;
+        }
+        if (current.size > 0)
+            g_array_append_val(regions, current);
+        if (i == count)
+            break;
+        current.offset = parts[i].offset;
+        current.size = parts[i].size;
+        current.data = data;
+        data += parts[i].size;
+    }
+
+    GArray *chunks = g_array_new(FALSE, TRUE, sizeof(Aggregated_Chunk));
+    for (guint r = 0; r < regions->len; ++r) {
+        Aggregated_Chunk *region = &g_array_index(regions, Aggregated_Chunk, r);
+        guint64 end = region->offset + region->size;
+        for (guint64 offset = region->offset; offset < end;) {
+            guint64 next = MIN(end, (offset / chunk_size + 1) * chunk_size);
+            Aggregated_Chunk chunk = {offset, next - offset,
+                                      region->data + (offset - region->offset)};
+            g_array_append_val(chunks, chunk);
+            offset = next;
+        }
+    }
+    return chunks;
+}
+
+/*
+ * Every aggregator predicts a compressor for each of its regions. The one
+ * predicted for the most bytes of all aggregators is used by all of them.
+ */
+static CompressionAlgorithm_Level agree_compressor(MPI_Comm aggregators,
+                                                   GArray *regions,
+                                                   Input_Type type) {
+    int count = regions->len;
+    const void **data = g_new(const void *, count);
+    size_t *lengths = g_new(size_t, count);
+    Input_Type *types = g_new(Input_Type, count);
+    Prediction *predictions = g_new(Prediction, count);
+    for (int i = 0; i < count; ++i) {
+        Aggregated_Chunk *region = &g_array_index(regions, Aggregated_Chunk, i);
+        data[i] = region->data;
+        lengths[i] = region->size;
+        types[i] = type;
+    }
+    if (count > 0)
+        predict_compressors(data, lengths, types, count, predictions);
+
+    // Local vote first, so every aggregator sends one
+    Compressor_Vote vote = {0};
+    for (int i = 0; i < count; ++i) {
+        guint64 bytes = 0;
+        for (int j = 0; j < count; ++j) {
+            if (predictions[j].compressor.algorithm ==
+                    predictions[i].compressor.algorithm &&
+                predictions[j].compressor.level ==
+                    predictions[i].compressor.level)
+                bytes += lengths[j];
+        }
+        if (bytes > vote.bytes) {
+            vote.bytes = bytes;
+            vote.algorithm = predictions[i].compressor.algorithm;
+            vote.level = predictions[i].compressor.level;
+        }
+    }
+    g_free(data);
+    g_free(lengths);
+    g_free(types);
+    g_free(predictions);
+
+    int size;
+    PMPI_Comm_size(aggregators, &size);
+    Compressor_Vote *votes = g_new(Compressor_Vote, size);
+    PMPI_Allgather(&vote, sizeof(vote), MPI_BYTE, votes, sizeof(vote),
+                   MPI_BYTE, aggregators);
+    Compressor_Vote best = {0};
+    for (int i = 0; i < size; ++i) {
+        guint64 bytes = 0;
+        for (int j = 0; j < size; ++j) {
+            if (votes[j].algorithm == votes[i].algorithm &&
+                votes[j].level == votes[i].level)
+                bytes += votes[j].bytes;
+        }
+        if (bytes > best.bytes) {
+            best = votes[i];
+            best.bytes = bytes;
+        }
+    }
+    g_free(votes);
+    return (CompressionAlgorithm_Level){best.algorithm, best.level};
+}
+
+static void compress_chunk(Aggregated_Chunk *chunk,
+                           CompressionAlgorithm_Level compressor) {
+    CompressionAlgorithm *algorithm = &g_array_index(
+        available_compressors, CompressionAlgorithm, compressor.algorithm);
+    size_t bound = algorithm->bound(chunk->size);
+    chunk->compressed = g_malloc(bound);
+    chunk->compressed_size = algorithm->compress(
+        chunk->compressed, bound, chunk->data, chunk->size, compressor.level);
+}
+
+// Compresses the regions of an aggregator and collects their blocks
+static void write_regions(MPI_File fh, MPI_Comm aggregators,
+                          const Aggregated_Part *parts, int count,
+                          const char *data, Input_Type type) {
+    GArray *regions = g_array_new(FALSE, TRUE, sizeof(Aggregated_Chunk));
+    GArray *chunks = chunk_regions(parts, count, data, regions);
+    CompressionAlgorithm_Level compressor =
+        agree_compressor(aggregators, regions, type);
+
+    Aggregated_Chunk *chunk = (Aggregated_Chunk *)chunks->data;
+    int workers = CLAMP(threads, 1, (int)chunks->len);
+#pragma omp parallel for num_threads(workers) if (workers > 1)                \
+    schedule(dynamic, 1)
+    for (int i = 0; i < (int)chunks->len; ++i)
+        compress_chunk(&chunk[i], compressor);
+
+    for (guint i = 0; i < chunks->len; ++i) {
+        Write_Target target = {fh, chunk[i].offset};
+        container_write(&target, chunk[i].data, chunk[i].size, compressor,
+                        chunk[i].compressed, chunk[i].compressed_size);
+        aggregated_bytes += chunk[i].size;
+    }
+    aggregated_regions += regions->len;
+    g_array_free(chunks, TRUE);
+    g_array_free(regions, TRUE);
+}
+
+/*
+ * Gathers the parts of all ranks of the group on its rank 0, in the order of
+ * the ranks and of their buffers. Returns their number there, sizes holds the
+ * bytes of every rank.
+ */
+static int gather_parts(MPI_Comm group, const GArray *runs,
+                        Aggregated_Part **parts, guint64 **sizes) {
+    int group_rank, group_size, count = runs->len, total = 0;
+    PMPI_Comm_rank(group, &group_rank);
+    PMPI_Comm_size(group, &group_size);
+    Aggregated_Part *own = g_new0(Aggregated_Part, count);
+    for (int i = 0; i < count; ++i) {
+        const Container_Run *run = &g_array_index(runs, Container_Run, i);
+        own[i].offset = run->offset;
+        own[i].size = run->size;
+    }
+
+    int *counts = NULL;
+    int *displacements = NULL;
+    if (group_rank == 0) {
+        counts = g_new(int, group_size);
+        displacements = g_new(int, group_size);
+    }
+    PMPI_Gather(&count, 1, MPI_INT, counts, 1, MPI_INT, 0, group);
+    if (group_rank == 0) {
+        for (int i = 0; i < group_size; ++i) {
+            displacements[i] = 3 * total;
+            total += counts[i];
+            counts[i] *= 3;
+        }
+        *parts = g_new(Aggregated_Part, total);
+    }
+    PMPI_Gatherv(own, 3 * count, MPI_UINT64_T, *parts, counts, displacements,
+                 MPI_UINT64_T, 0, group);
+    if (group_rank == 0) {
+        // The data of the parts arrives in the same order
+        *sizes = g_new0(guint64, group_size);
+        guint64 data = 0;
+        for (int r = 0, i = 0; r < group_size; ++r) {
+            for (int end = i + counts[r] / 3; i < end; ++i) {
+                (*parts)[i].data = data;
+                data += (*parts)[i].size;
+                (*sizes)[r] += (*parts)[i].size;
+            }
+        }
+    }
+    g_free(own);
+    g_free(counts);
+    g_free(displacements);
+    return total;
+}
+
+/*
+ * Point to point in pieces of at most AGGREGATION_PIECE bytes, so ranks and
+ * groups gather more than 2 GiB.
+ */
+static void gather_data(MPI_Comm group, const char *buf, size_t size,
+                        const guint64 *sizes, char *data) {
+    int group_rank, group_size;
+    PMPI_Comm_rank(group, &group_rank);
+    PMPI_Comm_size(group, &group_size);
+    if (group_rank != 0) {
+        for (size_t sent = 0; sent < size; sent += AGGREGATION_PIECE)
+            PMPI_Send(buf + sent, MIN(AGGREGATION_PIECE, size - sent),
+                      MPI_BYTE, 0, 0, group);
+        return;
+    }
+
+    memcpy(data, buf, size);
+    data += size;
+    GArray *requests = g_array_new(FALSE, FALSE, sizeof(MPI_Request));
+    for (int r = 1; r < group_size; ++r) {
+        for (guint64 received = 0; received < sizes[r];
+             received += AGGREGATION_PIECE) {
+            MPI_Request request;
+            PMPI_Irecv(data, MIN(AGGREGATION_PIECE, sizes[r] - received),
+                       MPI_BYTE, r, 0, group, &request);
+            g_array_append_val(requests, request);
+            data += MIN(AGGREGATION_PIECE, sizes[r] - received);
+        }
+    }
+    PMPI_Waitall(requests->len, (MPI_Request *)requests->data,
+                 MPI_STATUSES_IGNORE);
+    g_array_free(requests, TRUE);
+}
+
+/*
+ * Sorts the parts by offset. Returns their data in the new order, which is a
+ * copy when the parts of ranks interleave, e.g. through subarray views.
+ */
+static char *sort_parts(Aggregated_Part *parts, int count, char *data) {
+    qsort(parts, count, sizeof(Aggregated_Part), compare_parts);
+    gboolean ordered = TRUE;
+    guint64 total = 0;
+    for (int i = 0; i < count; ++i) {
+        ordered = ordered && parts[i].data == total;
+        total += parts[i].size;
+    }
+    if (ordered)
+        return data;
+
+    char *sorted = g_malloc(total);
+    total = 0;
+    for (int i = 0; i < count; ++i) {
+        memcpy(sorted + total, data + parts[i].data, parts[i].size);
+        parts[i].data = total;
+        total += parts[i].size;
+    }
+    return sorted;
+}
+
+/*
+ * Collective over the ranks of the file. The aggregators gather the parts of
+ * their ranks, one per contiguous run of their file view, sort them by offset
+ * and join those that follow each other into regions. The chunks of the
+ * regions are compressed in parallel by the compressor the aggregators agree
+ * on. Their blocks are written by the next container_collective_end.
+ */
+void aggregation_write(MPI_File fh, MPI_Offset offset, const void *buf,
+                       size_t size, MPI_Datatype datatype) {
+    Aggregation *aggregation = g_hash_table_lookup(aggregations, (void *)fh);
+    int group_rank, group_size;
+    PMPI_Comm_rank(aggregation->group, &group_rank);
+    PMPI_Comm_size(aggregation->group, &group_size);
+    GArray *runs = container_view_runs(fh, offset, size);
+    Aggregated_Part *parts = NULL;
+    guint64 *sizes = NULL;
+    int count = gather_parts(aggregation->group, runs, &parts, &sizes);
+    g_array_unref(runs);
+
+    char *data = NULL;
+    if (group_rank == 0) {
+        guint64 total = 0;
+        for (int r = 0; r < group_size; ++r)
+            total += sizes[r];
+        data = g_malloc(total);
+    }
+    gather_data(aggregation->group, buf, size, sizes, data);
+
+    if (group_rank == 0) {
+        char *sorted = sort_parts(parts, count, data);
+        write_regions(fh, aggregation->aggregators, parts, count, sorted,
+                      datatype_to_input_type(datatype));
+        if (sorted != data)
+            g_free(sorted);
+        g_free(parts);
+        g_free(sizes);
+        g_free(data);
+    }
+    ++aggregated_writes;
+}
+
+// Collective, before the container is closed
+void aggregation_close(MPI_File fh) {
+    if (!aggregation_active(fh))
+        return;
+    Aggregation *aggregation = g_hash_table_lookup(aggregations, (void *)fh);
+    g_hash_table_remove(aggregations, (void *)fh);
+    PMPI_Comm_free(&aggregation->group);
+    if (aggregation->aggregators != MPI_COMM_NULL)
+        PMPI_Comm_free(&aggregation->aggregators);
+    g_free(aggregation);
+}
+
+void aggregation_report() {
+    if (aggregations == NULL)
+        return;
+    add_counter("Aggregation: writes", aggregated_writes);
+    add_counter("Aggregation: regions", aggregated_regions);
+    add_counter("Aggregation: bytes", aggregated_bytes);
+}
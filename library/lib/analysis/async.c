@@ -0,0 +1,217 @@
+#include <analysis/async.h>
+#include <tracing.h>
+
+typedef struct {
+    MPI_File fh;
+    const char *operation;
+    void *buf;
+    size_t buf_size;
+    MPI_Datatype datatype;
+    gboolean datatype_owned;
+    MPI_Offset offset;
+    gint count;
+    GList *runs;
+} Analysis_Job;
+
+typedef struct {
+    GMutex lock;
+    // Owner takes from the head, thieves from the tail
+    GQueue jobs;
+    GThread *thread;
+    int id;
+} Async_Worker;
+
+static const char *async_policy_names[] = {[ASYNC_POLICY_BLOCK] = "block",
+                                           [ASYNC_POLICY_DROP] = "drop"};
+
+static Async_Worker *workers = NULL;
+static int worker_count = 0;
+// Of the worker running on this thread, -1 on others
+static __thread int current_worker = -1;
+static guint next_worker = 0;
+static size_t max_bytes;
+static Async_Policy queue_policy;
+
+// Guards the accounting below, workers sleep on state_cond
+static GMutex state_lock;
+static GCond state_cond;
+static int queued_jobs = 0;
+static int outstanding_jobs = 0;
+static size_t outstanding_bytes = 0;
+static gboolean shutting_down = FALSE;
+
+// Finished jobs, appended to the trace by the application thread
+static GAsyncQueue *finished_jobs;
+
+static Analysis_Job *take_job(Async_Worker *self) {
+    Analysis_Job *job;
+    g_mutex_lock(&self->lock);
+    job = g_queue_pop_head(&self->jobs);
+    g_mutex_unlock(&self->lock);
+
+    for (int i = 1; job == NULL && i < worker_count; ++i) {
+        Async_Worker *victim = &workers[(self->id + i) % worker_count];
+        g_mutex_lock(&victim->lock);
+        job = g_queue_pop_tail(&victim->jobs);
+        g_mutex_unlock(&victim->lock);
+    }
+
+    if (job != NULL) {
+        g_mutex_lock(&state_lock);
+        --queued_jobs;
+        g_mutex_unlock(&state_lock);
+    }
+    return job;
+}
+
+static gpointer async_worker(gpointer data) {
+    Async_Worker *self = data;
+    current_worker = self->id;
+    while (TRUE) {
+        Analysis_Job *job = take_job(self);
+        if (job == NULL) {
+            g_mutex_lock(&state_lock);
+            while (queued_jobs == 0 && !shutting_down)
+                g_cond_wait(&state_cond, &state_lock);
+            gboolean done = shutting_down && queued_jobs == 0;
+            g_mutex_unlock(&state_lock);
+            if (done)
+                break;
+            continue;
+        }
+
+        job->runs =
+            test_algorithms(job->fh, job->buf, job->buf_size, job->datatype);
+        g_free(job->buf);
+        job->buf = NULL;
+        g_async_queue_push(finished_jobs, job);
+
+        g_mutex_lock(&state_lock);
+        --outstanding_jobs;
+        outstanding_bytes -= job->buf_size;
+        g_cond_broadcast(&state_cond);
+        g_mutex_unlock(&state_lock);
+    }
+    release_compression_contexts();
+    return NULL;
+}
+
+void async_analysis_init(int count, size_t max_queued_bytes,
+                         Async_Policy policy) {
+    worker_count = count;
+    max_bytes = max_queued_bytes;
+    queue_policy = policy;
+    finished_jobs = g_async_queue_new();
+    workers = g_new0(Async_Worker, worker_count);
+    for (int i = 0; i < worker_count; ++i) {
+        workers[i].id = i;
+        g_mutex_init(&workers[i].lock);
+        g_queue_init(&workers[i].jobs);
+        workers[i].thread = g_thread_new("ioa-analysis", async_worker,
+                                         &workers[i]);
+    }
+}
+
+gboolean async_analysis_running() { return workers != NULL; }
+
+int async_analysis_worker() { return current_worker; }
+
+int async_analysis_worker_count() { return worker_count; }
+
+gboolean async_analysis_submit(MPI_File fh, const char *operation,
+                               const void *buf, size_t buf_size,
+                               MPI_Datatype datatype, MPI_Offset offset,
+                               gint count) {
+    async_analysis_collect();
+
+    g_mutex_lock(&state_lock);
+    // A single write larger than the limit is admitted on an empty queue
+    if (outstanding_bytes > 0 && outstanding_bytes + buf_size > max_bytes) {
+        if (queue_policy == ASYNC_POLICY_DROP) {
+            g_mutex_unlock(&state_lock);
+            add_counter("Async: dropped", 1);
+            return FALSE;
+        }
+        add_counter("Async: blocked", 1);
+        while (outstanding_bytes > 0 &&
+               outstanding_bytes + buf_size > max_bytes)
+            g_cond_wait(&state_cond, &state_lock);
+    }
+    ++outstanding_jobs;
+    outstanding_bytes += buf_size;
+    g_mutex_unlock(&state_lock);
+
+    Analysis_Job *job = g_new0(Analysis_Job, 1);
+    job->fh = fh;
+    job->operation = operation;
+    job->buf = g_memdup2(buf, buf_size);
+    job->buf_size = buf_size;
+    job->offset = offset;
+    job->count = count;
+    job->datatype = datatype;
+
+    // Derived datatypes might be freed by the application before collection
+    int num_integers, num_addresses, num_datatypes, combiner;
+    MPI_Type_get_envelope(datatype, &num_integers, &num_addresses,
+                          &num_datatypes, &combiner);
+    if (combiner != MPI_COMBINER_NAMED) {
+        MPI_Type_dup(datatype, &job->datatype);
+        job->datatype_owned = TRUE;
+    }
+
+    // Counted before a worker can take it, so queued_jobs never drops below 0
+    Async_Worker *worker = &workers[next_worker++ % worker_count];
+    g_mutex_lock(&state_lock);
+    g_mutex_lock(&worker->lock);
+    g_queue_push_tail(&worker->jobs, job);
+    g_mutex_unlock(&worker->lock);
+    ++queued_jobs;
+    g_cond_signal(&state_cond);
+    g_mutex_unlock(&state_lock);
+
+    add_counter("Async: submitted", 1);
+    return TRUE;
+}
+
+void async_analysis_collect() {
+    Analysis_Job *job;
+    while ((job = g_async_queue_try_pop(finished_jobs)) != NULL) {
+        add_compression_runs(job->fh, job->operation, job->runs, job->datatype,
+                             job->offset, job->count, job->buf_size);
+        if (job->datatype_owned)
+            MPI_Type_free(&job->datatype);
+        g_list_free_full(job->runs, g_free);
+        g_free(job);
+    }
+}
+
+void async_analysis_drain() {
+    if (workers == NULL)
+        return;
+
+    g_mutex_lock(&state_lock);
+    while (outstanding_jobs > 0)
+        g_cond_wait(&state_cond, &state_lock);
+    shutting_down = TRUE;
+    g_cond_broadcast(&state_cond);
+    g_mutex_unlock(&state_lock);
+
+    for (int i = 0; i < worker_count; ++i) {
+        g_thread_join(workers[i].thread);
+        g_mutex_clear(&workers[i].lock);
+    }
+    g_free(workers);
+    workers = NULL;
+
+    async_analysis_collect();
+    g_async_queue_unref(finished_jobs);
+}
+
+Async_Policy name_to_async_policy(const char *name) {
+    for (int i = 0; i < _ASYNC_POLICY_COUNT; i++) {
+        if (strcmp(name, async_policy_names[i]) == 0) {
+            return i;
+        }
+    }
+    return _ASYNC_POLICY_COUNT;
+}
\ No newline at end of file
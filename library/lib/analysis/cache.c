@@ -0,0 +1,208 @@
+#include <analysis/cache.h>
+#include <tracing.h>
+#include <xxhash.h>
+
+static const char *cache_kind_names[] = {
+    [CACHE_ANALYSIS] = "analysis",
+    [CACHE_INFERENCE] = "inference",
+};
+
+typedef struct {
+    Cache_Key key;
+    union {
+        GList *runs;
+        struct {
+            CompressionSample chosen;
+            CompressionSample best;
+            Inference_Choice choice;
+        } inference;
+    };
+    // Link of the entry in the LRU queue
+    GList link;
+} Cache_Entry;
+
+static int capacity = 0;
+// Analysis workers share the cache with the application thread
+static GMutex cache_lock;
+static GHashTable *entries;
+// Most recently used first
+static GQueue lru = G_QUEUE_INIT;
+static long hits[_CACHE_KIND_COUNT];
+static long misses[_CACHE_KIND_COUNT];
+static long evictions;
+
+static guint key_hash(gconstpointer key) {
+    const Cache_Key *k = key;
+    return (guint)(k->hash ^ (k->hash >> 32)) ^ k->kind;
+}
+
+static gboolean key_equal(gconstpointer a, gconstpointer b) {
+    const Cache_Key *k_a = a;
+    const Cache_Key *k_b = b;
+    return k_a->hash == k_b->hash && k_a->size == k_b->size &&
+           k_a->datatype == k_b->datatype && k_a->kind == k_b->kind;
+}
+
+static GList *copy_runs(GList *runs, gboolean cached) {
+    GList *copy = NULL;
+    // All runs of one analysis share their chunk name
+    gchar *chunk_name = g_strdup(((CompressionRun *)runs->data)->chunk_name);
+    for (GList *l = runs; l != NULL; l = l->next) {
+        CompressionRun *run = g_new(CompressionRun, 1);
+        *run = *(CompressionRun *)l->data;
+        run->chunk_name = chunk_name;
+        run->cached = cached;
+        copy = g_list_prepend(copy, run);
+    }
+    return g_list_reverse(copy);
+}
+
+static void free_entry(gpointer data) {
+    Cache_Entry *entry = data;
+    if (entry->key.kind == CACHE_ANALYSIS) {
+        g_free(((CompressionRun *)entry->runs->data)->chunk_name);
+        g_list_free_full(entry->runs, g_free);
+    }
+    g_free(entry);
+}
+
+void result_cache_init(int entry_capacity) {
+    capacity = entry_capacity;
+    if (capacity > 0)
+        entries = g_hash_table_new_full(key_hash, key_equal, NULL, free_entry);
+}
+
+gboolean result_cache_enabled() { return capacity > 0; }
+
+// 64 bit XXH3 of the buffer, collisions of equally sized buffers are ignored
+Cache_Key result_cache_key(Cache_Kind kind, const void *buf, size_t size,
+                           MPI_Datatype datatype) {
+    Cache_Key key = {XXH3_64bits(buf, size), size, datatype, kind};
+    return key;
+}
+
+// Requires cache_lock
+static Cache_Entry *lookup(const Cache_Key *key) {
+    Cache_Entry *entry = g_hash_table_lookup(entries, key);
+    if (entry == NULL) {
+        ++misses[key->kind];
+        return NULL;
+    }
+    ++hits[key->kind];
+    g_queue_unlink(&lru, &entry->link);
+    g_queue_push_head_link(&lru, &entry->link);
+    return entry;
+}
+
+// Requires cache_lock, the entry is filled in by the caller
+static Cache_Entry *insert(const Cache_Key *key) {
+    Cache_Entry *entry = g_hash_table_lookup(entries, key);
+    if (entry != NULL) {
+        // Stored concurrently by another worker
+        return NULL;
+    }
+    if (g_hash_table_size(entries) >= capacity) {
+        GList *oldest = g_queue_pop_tail_link(&lru);
+        g_hash_table_remove(entries, &((Cache_Entry *)oldest->data)->key);
+        ++evictions;
+    }
+    entry = g_new0(Cache_Entry, 1);
+    entry->key = *key;
+    entry->link.data = entry;
+    g_queue_push_head_link(&lru, &entry->link);
+    g_hash_table_insert(entries, &entry->key, entry);
+    return entry;
+}
+
+GList *result_cache_lookup_runs(const Cache_Key *key) {
+    GList *runs = NULL;
+    g_mutex_lock(&cache_lock);
+    Cache_Entry *entry = lookup(key);
+    if (entry != NULL)
+        runs = copy_runs(entry->runs, TRUE);
+    g_mutex_unlock(&cache_lock);
+    return runs;
+}
+
+void result_cache_store_runs(const Cache_Key *key, GList *runs) {
+    if (runs == NULL)
+        return;
+    g_mutex_lock(&cache_lock);
+    Cache_Entry *entry = insert(key);
+    if (entry != NULL)
+        entry->runs = copy_runs(runs, FALSE);
+    g_mutex_unlock(&cache_lock);
+}
+
+gboolean result_cache_lookup_inference(const Cache_Key *key,
+                                       CompressionSample *chosen,
+                                       CompressionSample *best,
+                                       Inference_Choice *choice) {
+    g_mutex_lock(&cache_lock);
+    Cache_Entry *entry = lookup(key);
+    if (entry != NULL) {
+        *chosen = entry->inference.chosen;
+        *best = entry->inference.best;
+        *choice = entry->inference.choice;
+    }
+    g_mutex_unlock(&cache_lock);
+    return entry != NULL;
+}
+
+void result_cache_store_inference(const Cache_Key *key,
+                                  CompressionSample chosen,
+                                  CompressionSample best,
+                                  Inference_Choice choice) {
+    g_mutex_lock(&cache_lock);
+    Cache_Entry *entry = insert(key);
+    if (entry != NULL) {
+        entry->inference.chosen = chosen;
+        entry->inference.best = best;
+        entry->inference.choice = choice;
+    }
+    g_mutex_unlock(&cache_lock);
+}
+
+// Entries of another model than the current one are no longer valid
+void result_cache_drop(Cache_Kind kind) {
+    if (!result_cache_enabled())
+        return;
+    g_mutex_lock(&cache_lock);
+    for (GList *l = lru.head; l != NULL;) {
+        Cache_Entry *entry = l->data;
+        l = l->next;
+        if (entry->key.kind != kind)
+            continue;
+        g_queue_unlink(&lru, &entry->link);
+        g_hash_table_remove(entries, &entry->key);
+    }
+    g_mutex_unlock(&cache_lock);
+}
+
+void result_cache_report() {
+    if (!result_cache_enabled())
+        return;
+    g_mutex_lock(&cache_lock);
+    for (int k = 0; k < _CACHE_KIND_COUNT; ++k) {
+        if (hits[k] == 0 && misses[k] == 0)
+            continue;
+        gchar *name = g_strdup_printf("Cache: %s hits", cache_kind_names[k]);
+        add_counter(name, hits[k]);
+        g_free(name);
+        name = g_strdup_printf("Cache: %s misses", cache_kind_names[k]);
+        add_counter(name, misses[k]);
+        g_free(name);
+    }
+    add_counter("Cache: evictions", evictions);
+    g_mutex_unlock(&cache_lock);
+}
+
+void result_cache_cleanup() {
+    if (!result_cache_enabled())
+        return;
+    g_mutex_lock(&cache_lock);
+    g_hash_table_destroy(entries);
+    g_queue_init(&lru);
+    capacity = 0;
+    g_mutex_unlock(&cache_lock);
+}
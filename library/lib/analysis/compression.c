@@ -1,5 +1,23 @@
+#include <analysis/async.h>
+#include <analysis/cache.h>
 #include <analysis/compression.h>
+#include <analysis/sampling.h>
 #include <settings.h>
+#include <tracing.h>
+#include <unistd.h>
+#ifdef _OPENMP
+#include <omp.h>
+#else
+#define omp_get_thread_num() 0
+#endif
+
+// First round of the pruned search: blocks and their initial size
+#define SEARCH_BLOCKS 8
+#define SEARCH_BLOCK_SIZE 4096
+// Sampled blocks of large buffers prune the candidates to at least this many,
+// and to all within SEARCH_TOLERANCE of the best, which are measured in full
+#define SEARCH_FINALISTS 2
+#define SEARCH_TOLERANCE 0.05
 
 const char *const metric_type_name[] = {
     [METRIC_CR] = "Compression Rate",
@@ -8,215 +26,599 @@ const char *const metric_type_name[] = {
     [METRIC_DECOMPRESSION_SPEED] = "Decompression Speed",
 };
 
+// Shortest duration timed at once, shorter calls are batched
+#define MIN_MEASURABLE_NS 20000
+#define MAX_BATCH 65536
+// Evicted if the size of the last level cache is unknown
+#define EVICTION_SIZE (64 * 1024 * 1024)
+
+typedef struct {
+    // Extrapolated to the whole buffer if only blocks of it were compressed
+    size_t compressed_size;
+    Duration_Stats compression;
+    Duration_Stats decompression;
+    int batch;
+    size_t sample_size;
+    gfloat confidence;
+} Measurement;
+
+static GPrivate eviction_buffer = G_PRIVATE_INIT(g_free);
+
+static size_t eviction_size() {
+    long size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    return size > 0 ? 2 * (size_t)size : EVICTION_SIZE;
+}
+
+// Replaces the cache contents by writing a buffer twice the last level cache
+static void evict_caches() {
+    size_t size = eviction_size();
+    volatile char *buffer = g_private_get(&eviction_buffer);
+    if (buffer == NULL) {
+        buffer = g_malloc(size);
+        g_private_set(&eviction_buffer, (gpointer)buffer);
+    }
+    for (size_t i = 0; i < size; i += 64)
+        buffer[i]++;
+}
+
+static size_t blocks_bound(CompressionAlgorithm *compressor,
+                           const Sample_Block *blocks, int block_count) {
+    size_t bound = 0;
+    for (int b = 0; b < block_count; ++b)
+        bound += compressor->bound(blocks[b].size);
+    return bound;
+}
+
+// Compressed blocks are stored back to back, each at its bound
+static gboolean compress_blocks(CompressionAlgorithm *compressor, gint level,
+                                const Sample_Block *blocks, int block_count,
+                                char *compressed_data,
+                                size_t *compressed_sizes) {
+    char *out = compressed_data;
+    for (int b = 0; b < block_count; ++b) {
+        size_t bound = compressor->bound(blocks[b].size);
+        compressed_sizes[b] = compressor->compress(out, bound, blocks[b].data,
+                                                   blocks[b].size, level);
+        // Compressor Error Handling
+        if (compressed_sizes[b] == 0)
+            return FALSE;
+        out += bound;
+    }
+    return TRUE;
+}
+
+static void decompress_blocks(CompressionAlgorithm *compressor,
+                              const Sample_Block *blocks, int block_count,
+                              const char *compressed_data,
+                              const size_t *compressed_sizes,
+                              char *decompressed_data) {
+    const char *in = compressed_data;
+    for (int b = 0; b < block_count; ++b) {
+        compressor->decompress((char *)in, decompressed_data,
+                               compressed_sizes[b], blocks[b].size);
+        in += compressor->bound(blocks[b].size);
+    }
+}
+
+static gint compare_durations(gconstpointer a, gconstpointer b) {
+    long long duration_a = *(const long long *)a;
+    long long duration_b = *(const long long *)b;
+    return (duration_a > duration_b) - (duration_a < duration_b);
+}
+
+// Nearest rank percentiles, scaled to the whole buffer
+static Duration_Stats duration_stats(long long *durations, int count,
+                                     double scale) {
+    Duration_Stats stats = {0, 0, 0};
+    if (count == 0)
+        return stats;
+    qsort(durations, count, sizeof(long long), compare_durations);
+    stats.median = durations[count / 2] * scale;
+    stats.p10 = durations[(count - 1) / 10] * scale;
+    stats.p90 = durations[(count * 9 + 9) / 10 - 1] * scale;
+    return stats;
+}
+
+// Calls needed for one timing to last at least MIN_MEASURABLE_NS
+static int batch_size(long long duration) {
+    if (duration >= MIN_MEASURABLE_NS)
+        return 1;
+    return MIN(MIN_MEASURABLE_NS / MAX(duration, 1) + 1, MAX_BATCH);
+}
+
+static gboolean time_compression(CompressionAlgorithm *compressor, gint level,
+                                 const Sample_Block *blocks, int block_count,
+                                 char *compressed_data,
+                                 size_t *compressed_sizes, int batch,
+                                 long long *duration) {
+    long long s = timeInNanoseconds();
+    for (int i = 0; i < batch; ++i) {
+        if (!compress_blocks(compressor, level, blocks, block_count,
+                             compressed_data, compressed_sizes))
+            return FALSE;
+    }
+    *duration = (timeInNanoseconds() - s) / batch;
+    return TRUE;
+}
+
+/*
+ * Compresses every block independently and keeps the per call durations of
+ * the repeats that succeeded. Calls below MIN_MEASURABLE_NS are timed in
+ * batches, unless caches are evicted before every repeat (--cache-cold).
+ * Decompression is only measured if decompressed_data is given.
+ */
+static gboolean measure(CompressionAlgorithm *compressor, gint level,
+                        const Sample_Block *blocks, int block_count,
+                        size_t buf_size, char *compressed_data,
+                        char *decompressed_data, int repeats,
+                        Measurement *result) {
+    size_t *compressed_sizes = g_new(size_t, block_count);
+    long long *durations = g_new(long long, repeats);
+    int batch = 1;
+    int successful = 0;
+
+    for (int t = 0; t < repeats; ++t) {
+        if (opt_cache_cold)
+            evict_caches();
+        long long duration;
+        gboolean timed =
+            time_compression(compressor, level, blocks, block_count,
+                             compressed_data, compressed_sizes, batch,
+                             &duration);
+        // Too short to be timed on its own, timed again as a larger batch
+        while (timed && !opt_cache_cold && batch < batch_size(duration)) {
+            batch = batch_size(duration);
+            timed = time_compression(compressor, level, blocks, block_count,
+                                     compressed_data, compressed_sizes, batch,
+                                     &duration);
+        }
+        if (timed)
+            durations[successful++] = duration;
+    }
+    if (successful == 0) {
+        g_free(compressed_sizes);
+        g_free(durations);
+        return FALSE;
+    }
+
+    double scale = (double)buf_size / sample_size(blocks, block_count);
+    result->compression = duration_stats(durations, successful, scale);
+    result->batch = batch;
+
+    Duration_Stats decompression = {0, 0, 0};
+    if (decompressed_data != NULL) {
+        for (int t = 0; t < repeats; ++t) {
+            if (opt_cache_cold)
+                evict_caches();
+            long long s = timeInNanoseconds();
+            for (int i = 0; i < batch; ++i)
+                decompress_blocks(compressor, blocks, block_count,
+                                  compressed_data, compressed_sizes,
+                                  decompressed_data);
+            durations[t] = (timeInNanoseconds() - s) / batch;
+        }
+        decompression = duration_stats(durations, repeats, scale);
+    }
+    result->decompression = decompression;
+
+    size_t compressed_total = 0;
+    for (int b = 0; b < block_count; ++b)
+        compressed_total += compressed_sizes[b];
+
+    result->sample_size = sample_size(blocks, block_count);
+    result->compressed_size = compressed_total * scale;
+    result->confidence =
+        sample_confidence(blocks, compressed_sizes, block_count, buf_size);
+    g_free(compressed_sizes);
+    g_free(durations);
+    return TRUE;
+}
+
+static gfloat metric_value(Metric_Type metric, size_t buf_size,
+                           const Measurement *measurement) {
+    gfloat cr = (gfloat)buf_size / (gfloat)measurement->compressed_size;
+    double seconds = measurement->compression.median / 1e9;
+    double decompression_seconds = measurement->decompression.median / 1e9;
+    switch (metric) {
+    case METRIC_CR:
+        return cr;
+    case METRIC_CR_TIME:
+        return seconds > 0 ? cr / seconds : 0;
+    case METRIC_COMPRESSION_SPEED:
+        // Throughput per Second
+        return seconds > 0 ? buf_size / seconds : 0;
+    case METRIC_DECOMPRESSION_SPEED:
+        return decompression_seconds > 0 ? buf_size / decompression_seconds
+                                         : 0;
+    default:
+        return 0;
+    }
+}
+
+static GList *measure_configuration(CompressionAlgorithm *compressor,
+                                    gint level, const Sample_Block *blocks,
+                                    int block_count, size_t buf_size,
+                                    char *compressed_data,
+                                    char *decompressed_data, char *chunk_name) {
+    GList *runs = NULL;
+    Measurement measurement;
+
+    if (!measure(compressor, level, blocks, block_count, buf_size,
+                 compressed_data, decompressed_data, opt_repeat_measurements,
+                 &measurement))
+        return NULL;
+
+    for (int m = 0; m < _METRIC_COUNT; ++m) {
+        // Decompression speed is only known with --decompression
+        gboolean decompression =
+            m == METRIC_DECOMPRESSION_SPEED && opt_decompression;
+        CompressionRun *run = g_malloc(sizeof(CompressionRun));
+        run->algorithmID = compressor->compression_id;
+        run->level = level;
+        run->timing = decompression ? measurement.decompression
+                                    : measurement.compression;
+        run->duration = run->timing.median / 1000;
+        run->batch = measurement.batch;
+        run->size = buf_size;
+        run->sample_size = measurement.sample_size;
+        run->confidence = measurement.confidence;
+        run->cached = FALSE;
+        run->metric = m;
+        run->metric_value =
+            decompression || m != METRIC_DECOMPRESSION_SPEED
+                ? metric_value(m, buf_size, &measurement)
+                : 0;
+        run->chunk_name = chunk_name;
+        runs = g_list_prepend(runs, run);
+    }
+    return runs;
+}
+
 GList *test_algorithms(MPI_File fh, const void *buf, size_t buf_size,
                        MPI_Datatype datatype) {
 
     GList *compressor_list = NULL;
+    long s_overhead = timeInMicroseconds();
+
+    Cache_Key key;
+    if (result_cache_enabled()) {
+        key = result_cache_key(CACHE_ANALYSIS, buf, buf_size, datatype);
+        compressor_list = result_cache_lookup_runs(&key);
+        if (compressor_list != NULL) {
+            long overhead = timeInMicroseconds() - s_overhead;
+            for (GList *l = compressor_list; l != NULL; l = l->next)
+                ((CompressionRun *)l->data)->overhead = overhead;
+            // The chunk was stored with the original analysis
+            return compressor_list;
+        }
+    }
     char *chunk_name = g_strdup_printf("%s.data", g_uuid_string_random());
 
+    Sample_Block *blocks;
+    int block_count = sample_blocks(buf, buf_size, &blocks);
+    size_t largest_block = 0;
+    for (int b = 0; b < block_count; ++b)
+        largest_block = MAX(largest_block, blocks[b].size);
+
+    // Flatten the compressor x level grid, so it can be spread across workers
+    GArray *configurations =
+        g_array_new(FALSE, FALSE, sizeof(CompressionAlgorithm_Level));
+    size_t max_bound = 0;
     CompressionAlgorithm *compressor;
     for (int i = 0; i < available_compressors->len; ++i) {
-        size_t max_bound, compressed_size;
-        char *compressed_data;
         compressor =
             &g_array_index(available_compressors, CompressionAlgorithm, i);
-
-        int *compression_levels = compressor->levels;
+        max_bound =
+            MAX(max_bound, blocks_bound(compressor, blocks, block_count));
         for (int l = 0; l < compressor->levels_count; ++l) {
-            gint level = compression_levels[l];
-
-            max_bound = compressor->bound(buf_size);
-            compressed_data = g_malloc(max_bound);
-            long time_average = 0;
-            for (int t = 0; t < opt_repeat_measurements; ++t) {
-                long s = timeInMicroseconds();
-                compressed_size = compressor->compress(
-                    compressed_data, max_bound, buf, buf_size, level);
-                // Compressor Error Handling
-                if (compressed_size == 0) {
-                    // g_free(compressed_data);
-                    continue;
-                }
-                time_average += (timeInMicroseconds() - s);
-            }
-            time_average = time_average / opt_repeat_measurements;
-
-            gfloat cr = (gfloat)buf_size / (gfloat)compressed_size;
-            gfloat cr_time = cr / (time_average / 1000000.0);
-            // Throughput per Second
-            gfloat compression_throughput =
-                buf_size / (time_average / 1000000.0);
-
-            for (int m = 0; m < _METRIC_COUNT; ++m) {
-                if (m == METRIC_DECOMPRESSION_SPEED && opt_decompression) {
-                    long time_decomp_average = 0;
-                    for (int t = 0; t < opt_repeat_measurements; ++t) {
-                        long s_decomp = timeInMicroseconds();
-                        // TODO: Too risky? Uses original buffer to decompress
-                        size_t decompressed_size = compressor->decompress(
-                            compressed_data, buf, compressed_size, buf_size);
-                        time_decomp_average +=
-                            (timeInMicroseconds() - s_decomp);
-                    }
-                    time_decomp_average =
-                        time_decomp_average / opt_repeat_measurements;
-                    gfloat decompression_speed =
-                        buf_size / (time_decomp_average / 1000000.0);
-
-                    CompressionRun *run = g_malloc(sizeof(CompressionRun));
-                    run->algorithmID = compressor->compression_id;
-                    run->level = level;
-                    run->duration = time_decomp_average;
-                    run->size = buf_size;
-                    run->metric = m;
-                    run->metric_value = decompression_speed;
-                    run->chunk_name = chunk_name;
-                    compressor_list = g_list_prepend(compressor_list, run);
-                } else {
-                    CompressionRun *run = g_malloc(sizeof(CompressionRun));
-                    run->algorithmID = compressor->compression_id;
-                    run->level = level;
-                    run->duration = time_average;
-                    run->size = buf_size;
-                    run->metric = m;
-                    run->chunk_name = chunk_name;
-
-                    if (m == METRIC_CR)
-                        run->metric_value = cr;
-                    else if (m == METRIC_CR_TIME)
-                        run->metric_value = cr_time;
-                    else if (m == METRIC_COMPRESSION_SPEED)
-                        run->metric_value = compression_throughput;
-                    compressor_list = g_list_prepend(compressor_list, run);
-                }
-            }
-            g_free(compressed_data);
+            CompressionAlgorithm_Level configuration = {
+                compressor->compression_id, compressor->levels[l]};
+            g_array_append_val(configurations, configuration);
+        }
+    }
+
+    int configuration_count = configurations->len;
+    int workers = CLAMP(opt_analysis_threads, 1, configuration_count);
+    GList **results = g_new0(GList *, configuration_count);
+    /*
+     * The teams of async workers measure at the same time, each on its own
+     * opt_analysis_threads cores. Other threads don't pin while they run.
+     */
+    int team = 0, teams = 1;
+    if (async_analysis_running()) {
+        team = async_analysis_worker();
+        teams = async_analysis_worker_count();
+    }
+    int stride = MAX(opt_analysis_threads, 1);
+    gboolean pinned = workers > 1 && team >= 0;
+
+#pragma omp parallel num_threads(workers) if (workers > 1)
+    {
+        // Each worker measures on its own core with its own scratch buffers
+        if (pinned)
+            pin_current_thread(team * stride + omp_get_thread_num(),
+                               teams * stride);
+        char *compressed_data = g_malloc(max_bound);
+        char *decompressed_data =
+            opt_decompression ? g_malloc(largest_block) : NULL;
+
+#pragma omp for schedule(dynamic, 1)
+        for (int c = 0; c < configuration_count; ++c) {
+            CompressionAlgorithm_Level *configuration =
+                &g_array_index(configurations, CompressionAlgorithm_Level, c);
+            results[c] = measure_configuration(
+                &g_array_index(available_compressors, CompressionAlgorithm,
+                               configuration->algorithm),
+                configuration->level, blocks, block_count, buf_size,
+                compressed_data, decompressed_data, chunk_name);
         }
+
+        g_free(compressed_data);
+        g_free(decompressed_data);
+        if (pinned)
+            unpin_current_thread();
+    }
+
+    for (int c = 0; c < configuration_count; ++c) {
+        compressor_list = g_list_concat(results[c], compressor_list);
+    }
+    g_free(results);
+    g_free(blocks);
+    g_array_free(configurations, TRUE);
+
+    long overhead = timeInMicroseconds() - s_overhead;
+    g_debug("test_algorithms: %ld bytes, %d workers, overhead %ld µs",
+            buf_size, workers, overhead);
+    for (GList *l = compressor_list; l != NULL; l = l->next) {
+        ((CompressionRun *)l->data)->overhead = overhead;
     }
 
+    if (result_cache_enabled())
+        result_cache_store_runs(&key, compressor_list);
     if (opt_store_chunks)
         store_training_chunk(chunk_name, buf, buf_size, datatype);
 
     return compressor_list;
 }
 
-CompressionSample best_compressor(const void *buf, size_t buf_size,
-                                  Metric_Type metric,
-                                  CompressionAlgorithm_Level *skip) {
-
-    CompressionSample best;
-    best.metric = metric;
+typedef struct {
+    CompressionAlgorithm_Level configuration;
+    gfloat metric_value;
+    size_t compressed_size;
+} Candidate;
 
+static GArray *search_candidates(CompressionAlgorithm_Level *skip) {
+    GArray *candidates = g_array_new(FALSE, TRUE, sizeof(Candidate));
     CompressionAlgorithm *compressor;
     for (int i = 0; i < available_compressors->len; ++i) {
-        size_t max_bound, compressed_size;
-        char *compressed_data;
         compressor =
             &g_array_index(available_compressors, CompressionAlgorithm, i);
-
-        int *compression_levels = compressor->levels;
         for (int l = 0; l < compressor->levels_count; ++l) {
-            gint level = compression_levels[l];
+            gint level = compressor->levels[l];
             // Might want to skip a compressor that has been tested before
             if (skip && skip->algorithm == compressor->compression_id &&
                 skip->level == level)
                 continue;
+            Candidate candidate = {{compressor->compression_id, level}, 0, 0};
+            g_array_append_val(candidates, candidate);
+        }
+    }
+    return candidates;
+}
 
-            max_bound = compressor->bound(buf_size);
-            compressed_data = g_malloc(max_bound);
-            long s = timeInMicroseconds();
-            compressed_size = compressor->compress(compressed_data, max_bound,
-                                                   buf, buf_size, level);
-            // Compressor Error Handling
-            if (compressed_size == 0) {
-                g_free(compressed_data);
-                continue;
-            }
-            long e = timeInMicroseconds() - s;
-            gfloat cr = (gfloat)buf_size / (gfloat)compressed_size;
-            gfloat cr_time = cr / (e / 1000000.0);
-            // Throughput per Second
-            gfloat compression_throughput = buf_size / (e / 1000000.0);
-
-            gboolean winner = FALSE;
-            if (metric == METRIC_DECOMPRESSION_SPEED) {
-                long s_decomp = timeInMicroseconds();
-                size_t decompressed_size = compressor->decompress(
-                    compressed_data, buf, compressed_size, buf_size);
-                long e_decomp = timeInMicroseconds() - s_decomp;
-                gfloat decompression_speed = buf_size / (e_decomp / 1000000.0);
-
-                if (decompression_speed > best.metric_value) {
-                    winner = TRUE;
-                    best.metric_value = decompression_speed;
-                }
-            } else if (metric == METRIC_CR && cr > best.metric_value) {
-                winner = TRUE;
-                best.metric_value = cr;
-            } else if (metric == METRIC_CR_TIME &&
-                       cr_time > best.metric_value) {
-                winner = TRUE;
-                best.metric_value = cr_time;
-            } else if (metric == METRIC_COMPRESSION_SPEED &&
-                       compression_throughput > best.metric_value) {
-                winner = TRUE;
-                best.metric_value = compression_throughput;
-            }
-
-            if (winner) {
-                best.compressor.algorithm = compressor->compression_id;
-                best.compressor.level = level;
-                best.compressed_size = compressed_size;
-            }
-            g_free(compressed_data);
+/*
+ * Scores the candidates on the given blocks. Returns FALSE if the deadline
+ * (in µs, 0 for none) passed, candidates not reached keep their old score.
+ */
+static gboolean score_candidates(GArray *candidates, const Sample_Block *blocks,
+                                 int block_count, size_t buf_size,
+                                 Metric_Type metric, long deadline) {
+    char *decompressed_data = NULL;
+    if (metric == METRIC_DECOMPRESSION_SPEED)
+        decompressed_data = g_malloc(blocks[0].size);
+
+    gboolean in_time = TRUE;
+    for (int c = 0; c < candidates->len && in_time; ++c) {
+        Candidate *candidate = &g_array_index(candidates, Candidate, c);
+        CompressionAlgorithm *compressor =
+            &g_array_index(available_compressors, CompressionAlgorithm,
+                           candidate->configuration.algorithm);
+        char *compressed_data =
+            g_malloc(blocks_bound(compressor, blocks, block_count));
+
+        Measurement measurement;
+        if (measure(compressor, candidate->configuration.level, blocks,
+                    block_count, buf_size, compressed_data, decompressed_data,
+                    1, &measurement)) {
+            candidate->metric_value =
+                metric_value(metric, buf_size, &measurement);
+            candidate->compressed_size = measurement.compressed_size;
+        } else {
+            candidate->metric_value = 0;
+        }
+        g_free(compressed_data);
+        in_time = deadline == 0 || timeInMicroseconds() < deadline;
+    }
+    g_free(decompressed_data);
+    return in_time;
+}
+
+static gint compare_candidates(gconstpointer a, gconstpointer b) {
+    gfloat value_a = ((const Candidate *)a)->metric_value;
+    gfloat value_b = ((const Candidate *)b)->metric_value;
+    return (value_a < value_b) - (value_a > value_b);
+}
+
+static CompressionSample best_candidate(GArray *candidates,
+                                        Metric_Type metric) {
+    CompressionSample best;
+    best.metric = metric;
+    best.metric_value = 0;
+    for (int c = 0; c < candidates->len; ++c) {
+        Candidate *candidate = &g_array_index(candidates, Candidate, c);
+        if (candidate->metric_value > best.metric_value) {
+            best.metric_value = candidate->metric_value;
+            best.compressor = candidate->configuration;
+            best.compressed_size = candidate->compressed_size;
         }
     }
     return best;
 }
 
+/*
+ * The winner is measured on the whole buffer. Sampled blocks only prune the
+ * candidates, since they misjudge compressors whose matches span more than a
+ * block, e.g. ZSTD-22, and then tie with the others.
+ */
+static gboolean score_buffer(GArray *candidates, const void *buf,
+                             size_t buf_size, Metric_Type metric,
+                             long deadline) {
+    if (sampling_applies(buf_size) && candidates->len > SEARCH_FINALISTS) {
+        Sample_Block *blocks;
+        int block_count = sample_blocks(buf, buf_size, &blocks);
+        gboolean in_time = score_candidates(candidates, blocks, block_count,
+                                            buf_size, metric, deadline);
+        g_free(blocks);
+        if (!in_time)
+            return FALSE;
+        g_array_sort(candidates, compare_candidates);
+        gfloat threshold =
+            g_array_index(candidates, Candidate, 0).metric_value *
+            (1 - SEARCH_TOLERANCE);
+        guint finalists = SEARCH_FINALISTS;
+        while (finalists < candidates->len &&
+               g_array_index(candidates, Candidate, finalists).metric_value >=
+                   threshold)
+            ++finalists;
+        g_array_set_size(candidates, finalists);
+    }
+    Sample_Block whole = {buf, buf_size};
+    return score_candidates(candidates, &whole, 1, buf_size, metric,
+                            deadline);
+}
+
+static CompressionSample exhaustive_search(const void *buf, size_t buf_size,
+                                           Metric_Type metric,
+                                           CompressionAlgorithm_Level *skip,
+                                           long deadline) {
+    GArray *candidates = search_candidates(skip);
+    if (!score_buffer(candidates, buf, buf_size, metric, deadline))
+        add_counter("Search: deadline hit", 1);
+
+    CompressionSample best = best_candidate(candidates, metric);
+    g_array_free(candidates, TRUE);
+    return best;
+}
+
+/*
+ * Successive halving: all candidates are scored on small stratified blocks,
+ * the better half survives and the blocks double in size, until two
+ * candidates are left. Only these are measured on the whole buffer.
+ */
+static CompressionSample pruned_search(const void *buf, size_t buf_size,
+                                       Metric_Type metric,
+                                       CompressionAlgorithm_Level *skip,
+                                       long deadline) {
+    GArray *candidates = search_candidates(skip);
+    gboolean in_time = TRUE;
+    Sample_Block *blocks;
+    int block_count;
+
+    // Rounds only pay off while they compress less than half of the buffer
+    for (size_t block_size = SEARCH_BLOCK_SIZE;
+         in_time && candidates->len > 2 &&
+         2 * SEARCH_BLOCKS * block_size <= buf_size;
+         block_size *= 2) {
+        block_count = stratified_blocks(buf, buf_size, SEARCH_BLOCKS,
+                                        block_size, &blocks);
+        in_time = score_candidates(candidates, blocks, block_count, buf_size,
+                                   metric, deadline);
+        g_free(blocks);
+        g_array_sort(candidates, compare_candidates);
+        if (in_time)
+            g_array_set_size(candidates, (candidates->len + 1) / 2);
+    }
+
+    if (in_time)
+        in_time = score_buffer(candidates, buf, buf_size, metric, deadline);
+    if (!in_time)
+        add_counter("Search: deadline hit", 1);
+
+    CompressionSample best = best_candidate(candidates, metric);
+    g_array_free(candidates, TRUE);
+    return best;
+}
+
+CompressionSample best_compressor(const void *buf, size_t buf_size,
+                                  Metric_Type metric,
+                                  CompressionAlgorithm_Level *skip) {
+    static long searches = 0;
+    long deadline = 0;
+    if (opt_search_deadline > 0)
+        deadline = timeInMicroseconds() + opt_search_deadline * 1000L;
+
+    if (!opt_pruned_search)
+        return exhaustive_search(buf, buf_size, metric, skip, deadline);
+
+    CompressionSample best =
+        pruned_search(buf, buf_size, metric, skip, deadline);
+
+    // Compare against the exhaustive search now and then
+    if (opt_search_audit > 0 && ++searches % opt_search_audit == 0) {
+        CompressionSample reference =
+            exhaustive_search(buf, buf_size, metric, skip, 0);
+        add_counter("Search: audited", 1);
+        if (reference.compressor.algorithm != best.compressor.algorithm ||
+            reference.compressor.level != best.compressor.level)
+            add_counter("Search: winner changed", 1);
+    }
+    return best;
+}
+
 CompressionSample evaluate(CompressionAlgorithm_Level compressor_info,
                            const void *buf, size_t buf_size) {
-    size_t max_bound, compressed_size;
-    char *compressed_data;
+    return evaluate_output(compressor_info, buf, buf_size, NULL);
+}
+
+// The compressed buffer is handed to output if given, NULL if it failed
+CompressionSample evaluate_output(CompressionAlgorithm_Level compressor_info,
+                                  const void *buf, size_t buf_size,
+                                  void **output) {
     CompressionSample run;
+    Measurement measurement = {0};
     CompressionAlgorithm *compressor = &g_array_index(
         available_compressors, CompressionAlgorithm, compressor_info.algorithm);
 
-    max_bound = compressor->bound(buf_size);
-    compressed_data = g_malloc(max_bound);
-    // Compress
-    long s = timeInMicroseconds();
-    compressed_size = compressor->compress(compressed_data, max_bound, buf,
-                                           buf_size, compressor_info.level);
-    long e = timeInMicroseconds() - s;
-
-    gfloat cr = (gfloat)buf_size / (gfloat)compressed_size;
-    gfloat cr_time = cr / (e / 1000000.0);
-    gfloat compression_throughput = buf_size / (e / 1000000.0);
-    g_debug(
-        "Predicted Compressor: %s(%d) - CR: %.6f | Input: %ld - Output: %ld",
-        compressor->name, compressor_info.level, cr, buf_size, compressed_size);
+    // The predicted compressor is always measured on the whole buffer
+    Sample_Block block = {buf, buf_size};
+    char *compressed_data = g_malloc(compressor->bound(buf_size));
+    char *decompressed_data = NULL;
+    if (opt_metric_inferencing == METRIC_DECOMPRESSION_SPEED)
+        decompressed_data = g_malloc(buf_size);
 
-    if (opt_metric_inferencing == METRIC_DECOMPRESSION_SPEED) {
-        long s_decomp = timeInMicroseconds();
-        size_t decompressed_size = compressor->decompress(
-            compressed_data, buf, compressed_size, buf_size);
-        long e_decomp = timeInMicroseconds() - s_decomp;
-        gfloat decompression_speed = buf_size / (e_decomp / 1000000.0);
-
-        run.metric_value = decompression_speed;
-    } else if (opt_metric_inferencing == METRIC_CR) {
-        run.metric_value = cr;
-    } else if (opt_metric_inferencing == METRIC_CR_TIME) {
-        run.metric_value = cr_time;
-    } else if (opt_metric_inferencing == METRIC_COMPRESSION_SPEED) {
-        run.metric_value = compression_throughput;
+    if (measure(compressor, compressor_info.level, &block, 1, buf_size,
+                compressed_data, decompressed_data, 1, &measurement)) {
+        run.metric_value =
+            metric_value(opt_metric_inferencing, buf_size, &measurement);
+    } else {
+        run.metric_value = 0;
+        g_free(compressed_data);
+        compressed_data = NULL;
     }
+    g_debug(
+        "Predicted Compressor: %s(%d) - CR: %.6f | Input: %ld - Output: %ld",
+        compressor->name, compressor_info.level,
+        metric_value(METRIC_CR, buf_size, &measurement), buf_size,
+        measurement.compressed_size);
 
-    g_free(compressed_data);
+    if (output != NULL)
+        *output = compressed_data;
+    else
+        g_free(compressed_data);
+    g_free(decompressed_data);
     run.metric = opt_metric_inferencing;
     run.compressor = compressor_info;
-    run.compressed_size = compressed_size;
+    run.compressed_size = measurement.compressed_size;
     return run;
 }
 
@@ -235,6 +637,7 @@ const char *metric_enum_name(Metric_Type type) {
     return metric_type_name[type];
 }
 
+// Returns _METRIC_COUNT for unknown names
 Metric_Type name_to_metric(char *name) {
     for (int i = 0; i < _METRIC_COUNT; i++) {
         if (strcmp(name, metric_type_name[i]) == 0) {
@@ -242,5 +645,5 @@ Metric_Type name_to_metric(char *name) {
         }
     }
     g_printerr("Metric not found: %s\n", name);
-    exit(EXIT_FAILURE);
+    return _METRIC_COUNT;
 }
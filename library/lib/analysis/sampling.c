@@ -0,0 +1,89 @@
+#include <analysis/sampling.h>
+#include <governor.h>
+#include <math.h>
+#include <settings.h>
+
+// Number of blocks to sample, 0 if the whole buffer is compressed
+static int sampled_blocks(size_t buf_size) {
+    int count = opt_sample_blocks;
+    if (governor_forces_sampling()) {
+        // Throttled by the governor: sample regardless of --sample-min-size
+        if (count <= 0)
+            count = GOVERNOR_SAMPLE_BLOCKS;
+    } else if (count <= 0 || buf_size < opt_sample_min_size) {
+        return 0;
+    }
+    // Sampling only pays off if most of the buffer is skipped
+    if (buf_size <= 2 * (size_t)count * opt_sample_block_size)
+        return 0;
+    return count;
+}
+
+gboolean sampling_applies(size_t buf_size) {
+    return sampled_blocks(buf_size) > 0;
+}
+
+int sample_blocks(const void *buf, size_t buf_size, Sample_Block **blocks) {
+    int count = sampled_blocks(buf_size);
+    if (count == 0) {
+        *blocks = g_new(Sample_Block, 1);
+        (*blocks)[0].data = buf;
+        (*blocks)[0].size = buf_size;
+        return 1;
+    }
+    return stratified_blocks(buf, buf_size, count, opt_sample_block_size,
+                             blocks);
+}
+
+// Requires buf_size >= count * block_size
+int stratified_blocks(const void *buf, size_t buf_size, int count,
+                      size_t block_size, Sample_Block **blocks) {
+    size_t stratum = buf_size / count;
+    // Same buffer size, same positions: keeps repeated writes comparable
+    GRand *rand = g_rand_new_with_seed(buf_size);
+
+    *blocks = g_new(Sample_Block, count);
+    for (int i = 0; i < count; ++i) {
+        // One block per stratum, at a random position inside of it
+        size_t jitter = g_rand_double(rand) * (stratum - block_size);
+        size_t offset = i * stratum + (jitter & ~(size_t)7);
+        (*blocks)[i].data = (const char *)buf + offset;
+        (*blocks)[i].size = block_size;
+    }
+    g_rand_free(rand);
+    return count;
+}
+
+size_t sample_size(const Sample_Block *blocks, int count) {
+    size_t size = 0;
+    for (int i = 0; i < count; ++i)
+        size += blocks[i].size;
+    return size;
+}
+
+gfloat sample_confidence(const Sample_Block *blocks,
+                         const size_t *compressed_sizes, int count,
+                         size_t buf_size) {
+    size_t sampled = sample_size(blocks, count);
+    if (sampled >= buf_size)
+        return 1.0;
+    if (count < 2)
+        return 0.0;
+
+    double mean = 0.0, variance = 0.0;
+    for (int i = 0; i < count; ++i)
+        mean += (double)compressed_sizes[i] / blocks[i].size;
+    mean /= count;
+    for (int i = 0; i < count; ++i) {
+        double ratio = (double)compressed_sizes[i] / blocks[i].size;
+        variance += (ratio - mean) * (ratio - mean);
+    }
+    variance /= count - 1;
+
+    // Relative half-width of the 95% interval of the compressed fraction,
+    // including the finite population correction
+    double standard_error =
+        sqrt(variance / count * (1.0 - (double)sampled / buf_size));
+    double half_width = 1.96 * standard_error / mean;
+    return CLAMP(1.0 - half_width, 0.0, 1.0);
+}
\ No newline at end of file
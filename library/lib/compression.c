@@ -4,6 +4,23 @@ GArray *available_compressors;
 static const char *compressor_names[] = {
     [LZ4] = "LZ4", [LZ4_FAST] = "LZ4-fast", [ZSTD] = "ZSTD", [ZLIB] = "ZLIB"};
 
+static CompressionAlgorithm *compressor_table[] = {[LZ4] = &IOA_lz4,
+                                                   [LZ4_FAST] = &IOA_lz4_fast,
+                                                   [ZSTD] = &IOA_zstd,
+                                                   [ZLIB] = &IOA_zlib};
+
+static void free_contexts(gpointer data) {
+    void **contexts = data;
+    for (int i = 0; i < _COMPRESSOR_COUNT; i++) {
+        if (contexts[i] != NULL)
+            compressor_table[i]->context_free(contexts[i]);
+    }
+    g_free(contexts);
+}
+
+// One context per compressor and thread, released on thread exit
+static GPrivate thread_contexts = G_PRIVATE_INIT(free_contexts);
+
 void init_compressors() {
     available_compressors =
         g_array_new(FALSE, FALSE, sizeof(CompressionAlgorithm));
@@ -13,10 +30,33 @@ void init_compressors() {
     g_array_append_val(available_compressors, IOA_zlib);
 }
 
+// NULL if the context can't be created, compressors then fail the call
+void *compression_context(CompressionAlgorithm *compressor) {
+    void **contexts = g_private_get(&thread_contexts);
+    if (contexts == NULL) {
+        contexts = g_new0(void *, _COMPRESSOR_COUNT);
+        g_private_set(&thread_contexts, contexts);
+    }
+
+    void *context = contexts[compressor->compression_id];
+    if (context == NULL) {
+        context = compressor->context_create();
+        contexts[compressor->compression_id] = context;
+    } else if (compressor->context_reset != NULL) {
+        compressor->context_reset(context);
+    }
+    return context;
+}
+
+void release_compression_contexts() {
+    g_private_replace(&thread_contexts, NULL);
+}
+
 const char *compressor_to_name(CompressionAlgorithmID id) {
     return compressor_names[id];
 }
 
+// Returns _COMPRESSOR_COUNT for unknown names
 CompressionAlgorithmID name_to_compressor(char *name) {
     for (int i = 0; i < _COMPRESSOR_COUNT; i++) {
         if (strcmp(name, compressor_names[i]) == 0) {
@@ -24,5 +64,5 @@ CompressionAlgorithmID name_to_compressor(char *name) {
         }
     }
     g_printerr("Compressor not found: %s\n", name);
-    exit(1);
+    return _COMPRESSOR_COUNT;
 }
\ No newline at end of file
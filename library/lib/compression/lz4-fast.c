@@ -4,12 +4,17 @@
 
 static int level_values[] = {1, 7, 17};
 
+void *create_context_LZ4_fast() { return g_malloc(LZ4_sizeofState()); }
+
+void free_context_LZ4_fast(void *context) { g_free(context); }
+
 size_t bound_LZ4_fast(size_t length) { return LZ4_compressBound(length); }
 
 size_t compress_LZ4_fast(void *dst, size_t dstCapacity, const void *src,
                          size_t srcSize, int compressionLevel) {
-    int ret =
-        LZ4_compress_fast(src, dst, srcSize, dstCapacity, compressionLevel);
+    int ret = LZ4_compress_fast_extState(compression_context(&IOA_lz4_fast),
+                                         src, dst, srcSize, dstCapacity,
+                                         compressionLevel);
     if (ret > 0) {
         return ret;
     }
@@ -31,6 +36,7 @@ size_t decompress_LZ4_fast(const char *src, char *dst, size_t compressedSize,
 }
 
 CompressionAlgorithm IOA_lz4_fast = {
-    bound_LZ4_fast, compress_LZ4_fast,      decompress_LZ4_fast,
-    level_values,   COUNT_OF(level_values), "LZ4-fast",
+    bound_LZ4_fast,          compress_LZ4_fast,      decompress_LZ4_fast,
+    create_context_LZ4_fast, NULL,                   free_context_LZ4_fast,
+    level_values,            COUNT_OF(level_values), "LZ4-fast",
     LZ4_FAST};
@@ -4,12 +4,26 @@
 
 static int level_values[] = {12, 9, 6, 3, 1};
 
+// Returns NULL if the allocation failed, the next compression tries again
+void *create_context_LZ4() {
+    LZ4_streamHC_t *state = LZ4_createStreamHC();
+    if (state == NULL)
+        g_printerr("COMPRESSION-ERROR: LZ4 context allocation failed\n");
+    return state;
+}
+
+void free_context_LZ4(void *context) { LZ4_freeStreamHC(context); }
+
 size_t bound_LZ4(size_t length) { return LZ4_compressBound(length); }
 
 size_t compress_LZ4(void *dst, size_t dstCapacity, const void *src,
                     size_t srcSize, int compressionLevel) {
-    // LZ4_compress_default
-    int ret = LZ4_compress_HC(src, dst, srcSize, dstCapacity, compressionLevel);
+    void *state = compression_context(&IOA_lz4);
+    if (state == NULL)
+        return 0;
+    // LZ4_compress_HC on a cached state, initialized by the call itself
+    int ret = LZ4_compress_HC_extStateHC(state, src, dst, srcSize, dstCapacity,
+                                         compressionLevel);
     if (ret > 0) {
         return ret;
     }
@@ -30,6 +44,7 @@ size_t decompress_LZ4(const char *src, char *dst, size_t compressedSize,
 }
 
 CompressionAlgorithm IOA_lz4 = {
-    bound_LZ4,    compress_LZ4,           decompress_LZ4,
-    level_values, COUNT_OF(level_values), "LZ4",
+    bound_LZ4,          compress_LZ4,           decompress_LZ4,
+    create_context_LZ4, NULL,                   free_context_LZ4,
+    level_values,       COUNT_OF(level_values), "LZ4",
     LZ4};
@@ -1,15 +1,74 @@
 #include <compression.h>
+#include <limits.h>
 #include <zlib.h>
 
 static int level_values[] = {9, 6, 3, 1};
 
+typedef struct {
+    // Deflate state depends on the level, keep one stream per level
+    z_stream deflate[Z_BEST_COMPRESSION + 1];
+    gboolean deflate_ready[Z_BEST_COMPRESSION + 1];
+    z_stream inflate;
+    gboolean inflate_ready;
+} ZLIB_Context;
+
+void *create_context_ZLIB() { return g_new0(ZLIB_Context, 1); }
+
+void free_context_ZLIB(void *context) {
+    ZLIB_Context *ctx = context;
+    for (int l = 0; l <= Z_BEST_COMPRESSION; ++l) {
+        if (ctx->deflate_ready[l])
+            deflateEnd(&ctx->deflate[l]);
+    }
+    if (ctx->inflate_ready)
+        inflateEnd(&ctx->inflate);
+    g_free(ctx);
+}
+
 size_t bound_ZLIB(size_t length) { return compressBound(length); }
 
+// avail_in and avail_out are uInt, larger buffers are passed in pieces
+static void refill(z_stream *stream, size_t *in_left, size_t *out_left) {
+    if (stream->avail_in == 0) {
+        stream->avail_in = MIN(*in_left, UINT_MAX);
+        *in_left -= stream->avail_in;
+    }
+    if (stream->avail_out == 0) {
+        stream->avail_out = MIN(*out_left, UINT_MAX);
+        *out_left -= stream->avail_out;
+    }
+}
+
 size_t compress_ZLIB(void *dst, size_t dstCapacity, const void *src,
                      size_t srcSize, int compressionLevel) {
-    int ret = compress2(dst, &dstCapacity, src, srcSize, compressionLevel);
+    int ret;
+    ZLIB_Context *ctx = compression_context(&IOA_zlib);
+    int l = CLAMP(compressionLevel, Z_NO_COMPRESSION, Z_BEST_COMPRESSION);
+    z_stream *stream = &ctx->deflate[l];
+
+    if (ctx->deflate_ready[l]) {
+        ret = deflateReset(stream);
+    } else {
+        ret = deflateInit(stream, l);
+        ctx->deflate_ready[l] = (ret == Z_OK);
+    }
+
     if (ret == Z_OK) {
-        return dstCapacity;
+        size_t in_left = srcSize, out_left = dstCapacity;
+        stream->next_in = (Bytef *)src;
+        stream->avail_in = 0;
+        stream->next_out = dst;
+        stream->avail_out = 0;
+        do {
+            refill(stream, &in_left, &out_left);
+            ret = deflate(stream, in_left == 0 ? Z_FINISH : Z_NO_FLUSH);
+        } while (ret == Z_OK && (stream->avail_out > 0 || out_left > 0));
+        // Same contract as compress2: Z_BUF_ERROR if the output is too small
+        if (ret == Z_STREAM_END) {
+            return stream->total_out;
+        }
+        if (ret == Z_OK)
+            ret = Z_BUF_ERROR;
     }
     // Error: Z_BUF_ERROR, Z_MEM_ERROR
     g_printerr("COMPRESSION-ERROR: ZLIB(%d) Error: %d | srcSize: %ld\n",
@@ -19,9 +78,31 @@ size_t compress_ZLIB(void *dst, size_t dstCapacity, const void *src,
 
 size_t decompress_ZLIB(const char *src, char *dst, size_t compressedSize,
                        size_t dstCapacity) {
-    int ret = uncompress(dst, &dstCapacity, src, compressedSize);
+    int ret;
+    ZLIB_Context *ctx = compression_context(&IOA_zlib);
+    z_stream *stream = &ctx->inflate;
+
+    if (ctx->inflate_ready) {
+        ret = inflateReset(stream);
+    } else {
+        ret = inflateInit(stream);
+        ctx->inflate_ready = (ret == Z_OK);
+    }
+
     if (ret == Z_OK) {
-        return dstCapacity;
+        size_t in_left = compressedSize, out_left = dstCapacity;
+        stream->next_in = (Bytef *)src;
+        stream->avail_in = 0;
+        stream->next_out = (Bytef *)dst;
+        stream->avail_out = 0;
+        // Z_BUF_ERROR once the input ends early or the output is full
+        do {
+            refill(stream, &in_left, &out_left);
+            ret = inflate(stream, Z_NO_FLUSH);
+        } while (ret == Z_OK);
+        if (ret == Z_STREAM_END) {
+            return stream->total_out;
+        }
     }
     g_printerr("DECOMPRESSION-ERROR: ZLIB Error: %d | compressedSize: %ld\n",
                ret, compressedSize);
@@ -29,6 +110,7 @@ size_t decompress_ZLIB(const char *src, char *dst, size_t compressedSize,
 }
 
 CompressionAlgorithm IOA_zlib = {
-    bound_ZLIB,   compress_ZLIB,          decompress_ZLIB,
-    level_values, COUNT_OF(level_values), "ZLIB",
+    bound_ZLIB,          compress_ZLIB,          decompress_ZLIB,
+    create_context_ZLIB, NULL,                   free_context_ZLIB,
+    level_values,        COUNT_OF(level_values), "ZLIB",
     ZLIB};
\ No newline at end of file
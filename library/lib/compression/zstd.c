@@ -3,12 +3,44 @@
 
 static int level_values[] = {22, 10, 3, 1};
 
+typedef struct {
+    ZSTD_CCtx *cctx;
+    ZSTD_DCtx *dctx;
+} ZSTD_Context;
+
+// Returns NULL if an allocation failed, the next compression tries again
+void *create_context_ZSTD() {
+    ZSTD_Context *context = g_new(ZSTD_Context, 1);
+    context->cctx = ZSTD_createCCtx();
+    context->dctx = ZSTD_createDCtx();
+    if (context->cctx == NULL || context->dctx == NULL) {
+        g_printerr("COMPRESSION-ERROR: ZSTD context allocation failed\n");
+        ZSTD_freeCCtx(context->cctx);
+        ZSTD_freeDCtx(context->dctx);
+        g_free(context);
+        return NULL;
+    }
+    return context;
+}
+
+void free_context_ZSTD(void *context) {
+    ZSTD_Context *ctx = context;
+    ZSTD_freeCCtx(ctx->cctx);
+    ZSTD_freeDCtx(ctx->dctx);
+    g_free(ctx);
+}
+
 size_t bound_ZSTD(size_t length) { return ZSTD_compressBound(length); }
 
+// ZSTD_compressCCtx starts a new frame at the level, so contexts aren't reset
 size_t compress_ZSTD(void *dst, size_t dstCapacity, const void *src,
                      size_t srcSize, int compressionLevel) {
     size_t ret;
-    ret = ZSTD_compress(dst, dstCapacity, src, srcSize, compressionLevel);
+    ZSTD_Context *ctx = compression_context(&IOA_zstd);
+    if (ctx == NULL)
+        return 0;
+    ret = ZSTD_compressCCtx(ctx->cctx, dst, dstCapacity, src, srcSize,
+                            compressionLevel);
     if (ZSTD_isError(ret)) {
         g_printerr("COMPRESSION-ERROR: ZSTD(%d) Error: %s | srcSize: %ld\n",
                    compressionLevel, ZSTD_getErrorName(ret), srcSize);
@@ -19,7 +51,11 @@ size_t compress_ZSTD(void *dst, size_t dstCapacity, const void *src,
 
 size_t decompress_ZSTD(const char *src, char *dst, size_t compressedSize,
                        size_t dstCapacity) {
-    int ret = ZSTD_decompress(dst, dstCapacity, src, compressedSize);
+    ZSTD_Context *ctx = compression_context(&IOA_zstd);
+    if (ctx == NULL)
+        return 0;
+    size_t ret =
+        ZSTD_decompressDCtx(ctx->dctx, dst, dstCapacity, src, compressedSize);
     if (ZSTD_isError(ret)) {
         g_printerr(
             "DECOMPRESSION-ERROR: ZSTD, Error: %s | compressedSize: %ld\n",
@@ -30,6 +66,7 @@ size_t decompress_ZSTD(const char *src, char *dst, size_t compressedSize,
 }
 
 CompressionAlgorithm IOA_zstd = {
-    bound_ZSTD,   compress_ZSTD,          decompress_ZSTD,
-    level_values, COUNT_OF(level_values), "ZSTD",
+    bound_ZSTD,          compress_ZSTD,      decompress_ZSTD,
+    create_context_ZSTD, NULL,               free_context_ZSTD,
+    level_values,        COUNT_OF(level_values), "ZSTD",
     ZSTD};
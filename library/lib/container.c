@@ -0,0 +1,1026 @@
+#include <container.h>
+#include <settings.h>
+#include <string.h>
+#include <tracing.h>
+#include <xxhash.h>
+
+static const char container_magic[8] = "IOACNT01";
+static const char block_magic[4] = "IOAB";
+static const char index_magic[8] = "IOAIDX01";
+
+static const char *container_mode_names[] = {
+    [CONTAINER_OFF] = "off",
+    [CONTAINER_BESIDE] = "beside",
+    [CONTAINER_REPLACE] = "replace",
+};
+
+typedef struct {
+    MPI_File container;
+    MPI_Comm comm;
+    // Next free position of the container, on rank 0
+    MPI_Win window;
+    // Blocks written by this rank
+    GArray *blocks;
+    // Blocks of the collective write in progress
+    GArray *collected;
+    gboolean collecting;
+} Container_Writer;
+
+// Block of a collective write, with a copy of its data
+typedef struct {
+    Container_Block_Header header;
+    void *data;
+} Collected_Block;
+
+typedef struct {
+    MPI_File container;
+    Container_Index index;
+    // Blocks of the writer of a read-write handle that are in the index
+    guint synced;
+    gboolean shared;
+} Container_Reader;
+
+// Block of a read, with its compressed data and where it decompresses to
+typedef struct {
+    const Container_Index_Entry *block;
+    char *compressed;
+    char *raw;
+    gboolean in_place;
+} Block_Read;
+
+static Container_Mode mode = CONTAINER_OFF;
+static guint64 block_size = 0;
+static int threads = 1;
+// Container of every intercepted file that is open for writing
+static GHashTable *containers = NULL;
+// And of those open for reading that have one
+static GHashTable *readers = NULL;
+static long blocks = 0;
+static long stored_blocks = 0;
+static long raw_bytes = 0;
+static long written_bytes = 0;
+static long collective_writes = 0;
+static long reads = 0;
+static long read_blocks = 0;
+static long read_bytes = 0;
+static long read_compressed_bytes = 0;
+
+Container_Mode name_to_container_mode(const char *name) {
+    for (int i = 0; i < _CONTAINER_MODE_COUNT; i++) {
+        if (strcmp(name, container_mode_names[i]) == 0)
+            return i;
+    }
+    return _CONTAINER_MODE_COUNT;
+}
+
+/*
+ * Writes are split into blocks of block_kib KiB at multiples of it in the
+ * original file, 0 keeps every write in one block. read_threads decompress
+ * the blocks of a read in parallel.
+ */
+void container_init(Container_Mode container_mode, int block_kib,
+                    int read_threads) {
+    mode = container_mode;
+    block_size = (guint64)block_kib * 1024;
+    threads = read_threads;
+    if (container_enabled()) {
+        containers = g_hash_table_new(g_direct_hash, g_direct_equal);
+        readers = g_hash_table_new(g_direct_hash, g_direct_equal);
+    }
+}
+
+gboolean container_enabled() { return mode != CONTAINER_OFF; }
+
+static gint compare_blocks(gconstpointer a, gconstpointer b) {
+    const Container_Index_Entry *block_a = a;
+    const Container_Index_Entry *block_b = b;
+    if (block_a->offset != block_b->offset)
+        return (block_a->offset > block_b->offset) -
+               (block_a->offset < block_b->offset);
+    return (block_a->data > block_b->data) - (block_a->data < block_b->data);
+}
+
+/*
+ * Sorts the blocks and sets their max_end and the size. Blocks partly covered
+ * by others are decompressed aside, in write order.
+ */
+void container_index_build(Container_Index *index) {
+    qsort(index->blocks, index->count, sizeof(Container_Index_Entry),
+          compare_blocks);
+    guint64 max_end = 0;
+    for (guint64 i = 0; i < index->count; ++i) {
+        Container_Index_Entry *block = &index->blocks[i];
+        block->overlapped = FALSE;
+        for (guint64 j = i; j > 0; --j) {
+            Container_Index_Entry *before = &index->blocks[j - 1];
+            if (before->max_end <= block->offset)
+                break;
+            if (before->offset + before->raw_size > block->offset) {
+                before->overlapped = TRUE;
+                block->overlapped = TRUE;
+            }
+        }
+        max_end = MAX(max_end, block->offset + block->raw_size);
+        block->max_end = max_end;
+    }
+    index->size = max_end;
+}
+
+void container_footer_init(Container_Footer *footer, guint64 index,
+                           guint64 count, guint64 size) {
+    memcpy(footer->magic, index_magic, sizeof(footer->magic));
+    footer->index = index;
+    footer->count = count;
+    footer->size = size;
+}
+
+// The index follows the last block, at an 8 byte aligned position
+static guint64 index_position(guint64 end) { return (end + 7) & ~(guint64)7; }
+
+static gboolean valid_footer(const Container_Footer *footer, guint64 size) {
+    return memcmp(footer->magic, index_magic, sizeof(footer->magic)) == 0 &&
+           footer->index >= sizeof(Container_Header) &&
+           footer->index % 8 == 0 &&
+           footer->index <= size - sizeof(*footer) &&
+           footer->count <= (size - footer->index) /
+                                sizeof(Container_Index_Entry) &&
+           footer->index + footer->count * sizeof(Container_Index_Entry) +
+                   sizeof(*footer) ==
+               size;
+}
+
+/*
+ * Maps the index at the end of a closed container, so lookups read only the
+ * pages they touch. Containers without an index aren't mapped.
+ */
+gboolean container_index_map(const char *path, Container_Index *index) {
+    GMappedFile *mapped = g_mapped_file_new(path, FALSE, NULL);
+    if (mapped == NULL)
+        return FALSE;
+    gsize size = g_mapped_file_get_length(mapped);
+    char *contents = g_mapped_file_get_contents(mapped);
+    Container_Footer footer;
+    if (size < sizeof(Container_Header) + sizeof(footer) ||
+        memcmp(contents, container_magic, sizeof(container_magic)) != 0) {
+        g_mapped_file_unref(mapped);
+        return FALSE;
+    }
+    memcpy(&footer, contents + size - sizeof(footer), sizeof(footer));
+    if (!valid_footer(&footer, size)) {
+        g_mapped_file_unref(mapped);
+        return FALSE;
+    }
+    index->blocks = (Container_Index_Entry *)(contents + footer.index);
+    index->count = footer.count;
+    index->size = footer.size;
+    index->mapped = mapped;
+    return TRUE;
+}
+
+void container_index_free(Container_Index *index) {
+    if (index->mapped != NULL)
+        g_mapped_file_unref(index->mapped);
+    else
+        g_free(index->blocks);
+    memset(index, 0, sizeof(*index));
+}
+
+// Entries are sent as one element each, indexes of up to G_MAXINT blocks
+static MPI_Datatype entry_type() {
+    MPI_Datatype type;
+    MPI_Type_contiguous(sizeof(Container_Index_Entry), MPI_BYTE, &type);
+    MPI_Type_commit(&type);
+    return type;
+}
+
+/*
+ * Reads the index of a closed container, FALSE if it has none. end is where
+ * its blocks end.
+ */
+static gboolean read_index(MPI_File container, MPI_Offset size,
+                           Container_Index *index, guint64 *end) {
+    Container_Footer footer;
+    if (size < sizeof(Container_Header) + sizeof(footer))
+        return FALSE;
+    PMPI_File_read_at(container, size - sizeof(footer), &footer,
+                      sizeof(footer), MPI_BYTE, MPI_STATUS_IGNORE);
+    if (!valid_footer(&footer, size) || footer.count > G_MAXINT)
+        return FALSE;
+    index->count = footer.count;
+    index->size = footer.size;
+    index->blocks = g_new(Container_Index_Entry, footer.count);
+    *end = footer.index;
+    MPI_Datatype type = entry_type();
+    PMPI_File_read_at(container, footer.index, index->blocks, footer.count,
+                      type, MPI_STATUS_IGNORE);
+    MPI_Type_free(&type);
+    return TRUE;
+}
+
+/*
+ * Reads all block headers of containers that weren't closed, or were written
+ * by version 1 without an index
+ */
+static void scan_blocks(MPI_File container, MPI_Offset size,
+                        Container_Index *index, guint64 *end) {
+    GArray *blocks = g_array_new(FALSE, TRUE, sizeof(Container_Index_Entry));
+    MPI_Offset position = sizeof(Container_Header);
+    *end = position;
+    while (position + sizeof(Container_Block_Header) <= size) {
+        Container_Block_Header block;
+        PMPI_File_read_at(container, position, &block, sizeof(block),
+                          MPI_BYTE, MPI_STATUS_IGNORE);
+        Container_Index_Entry entry = {
+            .offset = block.offset,
+            .raw_size = block.raw_size,
+            .data = position + sizeof(block),
+            .compressed_size = block.compressed_size,
+            .checksum = block.checksum,
+            .algorithm = block.algorithm,
+            .level = block.level};
+        position = entry.data + entry.compressed_size;
+        // Cut off by a failed write, the blocks before are still valid
+        if (memcmp(block.magic, block_magic, sizeof(block.magic)) != 0 ||
+            position > size)
+            break;
+        g_array_append_val(blocks, entry);
+        *end = position;
+    }
+    index->count = blocks->len;
+    index->blocks = (Container_Index_Entry *)g_array_free(blocks, FALSE);
+    container_index_build(index);
+}
+
+// FALSE if it isn't a valid container, end is where its blocks end
+static gboolean load_index(MPI_File container, Container_Index *index,
+                           guint64 *end) {
+    MPI_Offset size;
+    Container_Header header;
+    PMPI_File_get_size(container, &size);
+    if (size < sizeof(header))
+        return FALSE;
+    PMPI_File_read_at(container, 0, &header, sizeof(header), MPI_BYTE,
+                      MPI_STATUS_IGNORE);
+    if (memcmp(header.magic, container_magic, sizeof(header.magic)) != 0 ||
+        header.block_header_size != sizeof(Container_Block_Header))
+        return FALSE;
+    if (!read_index(container, size, index, end))
+        scan_blocks(container, size, index, end);
+    return TRUE;
+}
+
+/*
+ * Collective over comm, rank 0 loads the index if load is set and shares it.
+ * Returns where the blocks end, 0 if the container isn't loaded or valid.
+ */
+static guint64 share_index(MPI_Comm comm, MPI_File container, gboolean load,
+                           Container_Index *index) {
+    int rank;
+    PMPI_Comm_rank(comm, &rank);
+    guint64 shape[3] = {G_MAXUINT64, 0, 0};
+    if (rank == 0 && load && load_index(container, index, &shape[2])) {
+        shape[0] = index->count;
+        shape[1] = index->size;
+    }
+    PMPI_Bcast(shape, 3, MPI_UINT64_T, 0, comm);
+    if (shape[0] > G_MAXINT) {
+        container_index_free(index);
+        return 0;
+    }
+
+    index->count = shape[0];
+    index->size = shape[1];
+    if (rank != 0)
+        index->blocks = g_new(Container_Index_Entry, shape[0]);
+    MPI_Datatype type = entry_type();
+    PMPI_Bcast(index->blocks, shape[0], type, 0, comm);
+    MPI_Type_free(&type);
+    return shape[2];
+}
+
+// Rank 0 reads the index and shares it, files without a container are skipped
+static void open_reader(MPI_Comm comm, const char *path, MPI_Info info,
+                        MPI_File fh) {
+    int rank;
+    int count = -1;
+    PMPI_Comm_rank(comm, &rank);
+    if (rank == 0)
+        count = g_file_test(path, G_FILE_TEST_EXISTS) ? 0 : -1;
+    PMPI_Bcast(&count, 1, MPI_INT, 0, comm);
+    if (count < 0)
+        return;
+
+    MPI_File container;
+    if (PMPI_File_open(comm, path, MPI_MODE_RDONLY, info, &container) !=
+        MPI_SUCCESS) {
+        g_warning("Can't open container %s", path);
+        return;
+    }
+    Container_Reader *reader = g_new0(Container_Reader, 1);
+    reader->container = container;
+    if (share_index(comm, container, TRUE, &reader->index) == 0) {
+        if (rank == 0)
+            g_warning("Ignoring invalid container %s", path);
+        PMPI_File_close(&container);
+        g_free(reader);
+        return;
+    }
+    g_hash_table_insert(readers, (void *)fh, reader);
+}
+
+/*
+ * Before the open of the original file, whether the open creates it. Only the
+ * answer of rank 0 of comm counts.
+ */
+gboolean container_creates(MPI_Comm comm, const char *filename, int amode) {
+    int rank;
+    if (!container_enabled() || !(amode & MPI_MODE_CREATE))
+        return FALSE;
+    PMPI_Comm_rank(comm, &rank);
+    return rank == 0 && !g_file_test(filename, G_FILE_TEST_EXISTS);
+}
+
+/*
+ * Collective over comm, like the open of the original file. Files opened for
+ * reading are read from their container. Files opened for writing keep the
+ * blocks of their container and append to it, unless the open created them.
+ * Read-write handles also read from it, including the blocks they wrote.
+ */
+void container_open(MPI_Comm comm, const char *filename, int amode,
+                    MPI_Info info, MPI_File fh, gboolean created) {
+    if (!container_enabled())
+        return;
+    gchar *path = g_strconcat(filename, CONTAINER_SUFFIX, NULL);
+    if (amode & MPI_MODE_RDONLY) {
+        open_reader(comm, path, info, fh);
+        g_free(path);
+        return;
+    }
+    if (!opt_inferencing) {
+        g_free(path);
+        return;
+    }
+
+    MPI_File container;
+    if (PMPI_File_open(comm, path, MPI_MODE_RDWR | MPI_MODE_CREATE, info,
+                       &container) != MPI_SUCCESS) {
+        g_warning("Can't open container %s, writing %s uncompressed", path,
+                  filename);
+        g_free(path);
+        return;
+    }
+    g_free(path);
+
+    int rank;
+    PMPI_Comm_rank(comm, &rank);
+    PMPI_Bcast(&created, 1, MPI_INT, 0, comm);
+    Container_Index index = {0};
+    // The old index and footer are overwritten by the next blocks
+    guint64 end = share_index(comm, container, !created, &index);
+    PMPI_File_set_size(container, end);
+
+    // Blocks are written at positions taken from a counter on rank 0
+    Container_Writer *writer = g_new0(Container_Writer, 1);
+    writer->container = container;
+    writer->blocks = g_array_new(FALSE, FALSE, sizeof(Container_Index_Entry));
+    writer->collected = g_array_new(FALSE, FALSE, sizeof(Collected_Block));
+    PMPI_Comm_dup(comm, &writer->comm);
+    guint64 *next;
+    PMPI_Win_allocate(rank == 0 ? sizeof(guint64) : 0, sizeof(guint64),
+                      MPI_INFO_NULL, writer->comm, &next, &writer->window);
+    if (rank == 0) {
+        if (end == 0) {
+            Container_Header header = {.version = 2};
+            memcpy(header.magic, container_magic, sizeof(header.magic));
+            header.block_header_size = sizeof(Container_Block_Header);
+            PMPI_File_write_at(container, 0, &header, sizeof(header),
+                               MPI_BYTE, MPI_STATUS_IGNORE);
+            end = sizeof(header);
+        }
+        // Rank 0 writes the old blocks to the new index
+        g_array_append_vals(writer->blocks, index.blocks, index.count);
+        PMPI_Win_lock(MPI_LOCK_EXCLUSIVE, 0, 0, writer->window);
+        *next = end;
+        PMPI_Win_unlock(0, writer->window);
+    }
+    PMPI_Barrier(writer->comm);
+    g_hash_table_insert(containers, (void *)fh, writer);
+
+    if (amode & MPI_MODE_RDWR) {
+        Container_Reader *reader = g_new0(Container_Reader, 1);
+        reader->container = container;
+        reader->index = index;
+        reader->synced = writer->blocks->len;
+        reader->shared = TRUE;
+        g_hash_table_insert(readers, (void *)fh, reader);
+    } else {
+        container_index_free(&index);
+    }
+}
+
+static Container_Writer *lookup(MPI_File fh) {
+    if (!container_enabled())
+        return NULL;
+    return g_hash_table_lookup(containers, (void *)fh);
+}
+
+gboolean container_writes(MPI_File fh) { return lookup(fh) != NULL; }
+
+gboolean container_replaces(MPI_File fh) {
+    return mode == CONTAINER_REPLACE && lookup(fh) != NULL;
+}
+
+/*
+ * The runs of bytes of the file that size bytes at offset, in etypes of the
+ * file view, cover, in the order of the buffer. Contiguous views have one.
+ * Filetypes are monotonic, so the end of each run is found with a binary
+ * search over the etypes.
+ */
+GArray *container_view_runs(MPI_File fh, MPI_Offset offset, size_t size) {
+    MPI_Offset disp;
+    MPI_Datatype etype, filetype;
+    char datarep[MPI_MAX_DATAREP_STRING];
+    int etype_size;
+    MPI_File_get_view(fh, &disp, &etype, &filetype, datarep);
+    MPI_Type_size(etype, &etype_size);
+    gboolean contiguous = contiguous_type(filetype);
+    free_view_type(etype);
+    free_view_type(filetype);
+
+    GArray *runs = g_array_new(FALSE, FALSE, sizeof(Container_Run));
+    MPI_Offset end = offset + size / etype_size;
+    while (offset < end) {
+        MPI_Offset start, low = contiguous ? end - 1 : offset, high = end - 1;
+        MPI_File_get_byte_offset(fh, offset, &start);
+        while (low < high) {
+            MPI_Offset middle = low + (high - low + 1) / 2, position;
+            MPI_File_get_byte_offset(fh, middle, &position);
+            if (position == start + (middle - offset) * etype_size)
+                low = middle;
+            else
+                high = middle - 1;
+        }
+        Container_Run run = {start, (low - offset + 1) * etype_size};
+        g_array_append_val(runs, run);
+        offset = low + 1;
+    }
+    return runs;
+}
+
+/*
+ * offset is in etypes of the file view, the target in bytes of the file.
+ * Writes through non-contiguous views get their runs, which are cleared with
+ * container_target_clear.
+ */
+gboolean container_target(MPI_File fh, MPI_Offset offset, size_t size,
+                          Write_Target *target) {
+    if (lookup(fh) == NULL)
+        return FALSE;
+    target->fh = fh;
+    target->runs = container_view_runs(fh, offset, size);
+    if (target->runs->len > 0)
+        target->offset =
+            g_array_index(target->runs, Container_Run, 0).offset;
+    else
+        MPI_File_get_byte_offset(fh, offset, &target->offset);
+    if (target->runs->len <= 1) {
+        g_array_unref(target->runs);
+        target->runs = NULL;
+    }
+    return TRUE;
+}
+
+// Queued writes keep the runs of their target
+void container_target_copy(Write_Target *copy, const Write_Target *target) {
+    *copy = *target;
+    if (copy->runs != NULL)
+        g_array_ref(copy->runs);
+}
+
+void container_target_clear(Write_Target *target) {
+    if (target->runs != NULL)
+        g_array_unref(target->runs);
+    target->runs = NULL;
+}
+
+static guint64 allocate(Container_Writer *writer, guint64 size) {
+    guint64 position;
+    PMPI_Win_lock(MPI_LOCK_SHARED, 0, 0, writer->window);
+    PMPI_Fetch_and_op(&size, &position, MPI_UINT64_T, 0, 0, MPI_SUM,
+                      writer->window);
+    PMPI_Win_unlock(0, writer->window);
+    return position;
+}
+
+static void add_entry(Container_Writer *writer,
+                      const Container_Block_Header *header, guint64 position) {
+    Container_Index_Entry entry = {.offset = header->offset,
+                                   .raw_size = header->raw_size,
+                                   .data = position + sizeof(*header),
+                                   .compressed_size = header->compressed_size,
+                                   .checksum = header->checksum,
+                                   .algorithm = header->algorithm,
+                                   .level = header->level};
+    g_array_append_val(writer->blocks, entry);
+
+    ++blocks;
+    if (header->algorithm == CONTAINER_STORED)
+        ++stored_blocks;
+    raw_bytes += header->raw_size;
+    written_bytes += sizeof(*header) + header->compressed_size;
+}
+
+// The header and data are written at once, without copying them together
+static void append_block(Container_Writer *writer,
+                         Container_Block_Header *header, const void *data) {
+    if (writer->collecting) {
+        Collected_Block block = {*header,
+                                 g_memdup2(data, header->compressed_size)};
+        g_array_append_val(writer->collected, block);
+        return;
+    }
+    guint64 position =
+        allocate(writer, sizeof(*header) + header->compressed_size);
+    MPI_Aint displacements[2];
+    int lengths[2] = {sizeof(*header), header->compressed_size};
+    MPI_Datatype block;
+    MPI_Get_address(header, &displacements[0]);
+    MPI_Get_address(data, &displacements[1]);
+    MPI_Type_create_hindexed(2, lengths, displacements, MPI_BYTE, &block);
+    MPI_Type_commit(&block);
+    PMPI_File_write_at(writer->container, position, MPI_BOTTOM, 1, block,
+                       MPI_STATUS_IGNORE);
+    MPI_Type_free(&block);
+    add_entry(writer, header, position);
+}
+
+static void init_block_header(Container_Block_Header *header, guint64 offset,
+                              const void *buf, size_t size) {
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, block_magic, sizeof(header->magic));
+    header->algorithm = CONTAINER_STORED;
+    header->offset = offset;
+    header->raw_size = size;
+    header->compressed_size = size;
+    header->checksum = XXH3_64bits(buf, size);
+}
+
+/*
+ * Appends one block compressed by compressor, or stored if it is NULL.
+ * compressed is NULL to compress it here, and is freed. Data that doesn't get
+ * smaller is stored as is.
+ */
+static void write_block(Container_Writer *writer, guint64 offset,
+                        const void *buf, size_t size,
+                        const CompressionAlgorithm_Level *compressor,
+                        void *compressed, size_t compressed_size) {
+    if (compressor != NULL && compressed == NULL) {
+        CompressionAlgorithm *algorithm =
+            &g_array_index(available_compressors, CompressionAlgorithm,
+                           compressor->algorithm);
+        size_t bound = algorithm->bound(size);
+        compressed = g_malloc(bound);
+        compressed_size = algorithm->compress(compressed, bound, buf, size,
+                                              compressor->level);
+    }
+
+    Container_Block_Header header;
+    init_block_header(&header, offset, buf, size);
+    if (compressor != NULL && compressed_size > 0 && compressed_size < size) {
+        header.algorithm = compressor->algorithm;
+        header.level = compressor->level;
+        header.compressed_size = compressed_size;
+        append_block(writer, &header, compressed);
+    } else {
+        append_block(writer, &header, buf);
+    }
+    g_free(compressed);
+}
+
+// With a block size, writes spanning several blocks are compressed per block
+static void write_blocks(Container_Writer *writer, guint64 offset,
+                         const char *buf, size_t size,
+                         const CompressionAlgorithm_Level *compressor) {
+    guint64 end = offset + size;
+    while (offset < end) {
+        guint64 next = MIN(end, (offset / block_size + 1) * block_size);
+        write_block(writer, offset, buf, next - offset, compressor, NULL, 0);
+        buf += next - offset;
+        offset = next;
+    }
+}
+
+static gboolean spans_blocks(guint64 offset, size_t size) {
+    return block_size > 0 && size > 0 &&
+           offset / block_size != (offset + size - 1) / block_size;
+}
+
+// Each run of a non-contiguous write is compressed on its own
+static void write_runs(Container_Writer *writer, const GArray *runs,
+                       const char *buf,
+                       const CompressionAlgorithm_Level *compressor) {
+    for (guint i = 0; i < runs->len; ++i) {
+        const Container_Run *run = &g_array_index(runs, Container_Run, i);
+        if (spans_blocks(run->offset, run->size))
+            write_blocks(writer, run->offset, buf, run->size, compressor);
+        else
+            write_block(writer, run->offset, buf, run->size, compressor, NULL,
+                        0);
+        buf += run->size;
+    }
+}
+
+/*
+ * Appends the write compressed by compressor. compressed is the output of an
+ * earlier evaluation, or NULL to compress it here, and is freed.
+ */
+void container_write(const Write_Target *target, const void *buf,
+                     size_t size, CompressionAlgorithm_Level compressor,
+                     void *compressed, size_t compressed_size) {
+    Container_Writer *writer = lookup(target->fh);
+    if (writer == NULL) {
+        g_free(compressed);
+        return;
+    }
+    if (target->runs != NULL) {
+        g_free(compressed);
+        write_runs(writer, target->runs, buf, &compressor);
+        return;
+    }
+    if (spans_blocks(target->offset, size)) {
+        g_free(compressed);
+        write_blocks(writer, target->offset, buf, size, &compressor);
+        return;
+    }
+    write_block(writer, target->offset, buf, size, &compressor, compressed,
+                compressed_size);
+}
+
+// Writes that weren't inferred, so the container holds all data of the file
+void container_store(MPI_File fh, MPI_Offset offset, const void *buf,
+                     size_t size) {
+    Write_Target target;
+    if (!container_target(fh, offset, size, &target))
+        return;
+    if (target.runs != NULL)
+        write_runs(lookup(fh), target.runs, buf, NULL);
+    else if (spans_blocks(target.offset, size))
+        write_blocks(lookup(fh), target.offset, buf, size, NULL);
+    else
+        write_block(lookup(fh), target.offset, buf, size, NULL, NULL, 0);
+    container_target_clear(&target);
+}
+
+/*
+ * Blocks of the ranks' parts of a collective write are kept until
+ * container_collective_end. Returns FALSE if the file has no container.
+ */
+gboolean container_collective_begin(MPI_File fh) {
+    Container_Writer *writer = lookup(fh);
+    if (writer == NULL)
+        return FALSE;
+    writer->collecting = TRUE;
+    return TRUE;
+}
+
+/*
+ * Collective over the ranks of the file. The collected blocks of all ranks
+ * are written densely with one collective write, each rank at the sum of the
+ * sizes of the ranks before it.
+ */
+void container_collective_end(MPI_File fh) {
+    Container_Writer *writer = lookup(fh);
+    if (writer == NULL)
+        return;
+    writer->collecting = FALSE;
+    int count = writer->collected->len;
+    Collected_Block *collected = (Collected_Block *)writer->collected->data;
+    guint64 size = 0;
+    for (int i = 0; i < count; ++i)
+        size += sizeof(Container_Block_Header) +
+                collected[i].header.compressed_size;
+
+    int rank, ranks;
+    PMPI_Comm_rank(writer->comm, &rank);
+    PMPI_Comm_size(writer->comm, &ranks);
+    guint64 before = 0;
+    guint64 position;
+    PMPI_Exscan(&size, &before, 1, MPI_UINT64_T, MPI_SUM, writer->comm);
+    if (rank == 0)
+        before = 0;
+    // The last rank knows the size of all blocks
+    if (rank == ranks - 1)
+        position = allocate(writer, before + size);
+    PMPI_Bcast(&position, 1, MPI_UINT64_T, ranks - 1, writer->comm);
+    position += before;
+
+    MPI_Aint *displacements = g_new(MPI_Aint, 2 * count);
+    int *lengths = g_new(int, 2 * count);
+    for (int i = 0; i < count; ++i) {
+        MPI_Get_address(&collected[i].header, &displacements[2 * i]);
+        MPI_Get_address(collected[i].data, &displacements[2 * i + 1]);
+        lengths[2 * i] = sizeof(Container_Block_Header);
+        lengths[2 * i + 1] = collected[i].header.compressed_size;
+    }
+    MPI_Datatype blocks_type;
+    MPI_Type_create_hindexed(2 * count, lengths, displacements, MPI_BYTE,
+                             &blocks_type);
+    MPI_Type_commit(&blocks_type);
+    PMPI_File_write_at_all(writer->container, position, MPI_BOTTOM,
+                           count > 0 ? 1 : 0, blocks_type, MPI_STATUS_IGNORE);
+    MPI_Type_free(&blocks_type);
+    g_free(displacements);
+    g_free(lengths);
+
+    for (int i = 0; i < count; ++i) {
+        const Container_Block_Header *header = &collected[i].header;
+        add_entry(writer, header, position);
+        position += sizeof(*header) + header->compressed_size;
+        g_free(collected[i].data);
+    }
+    g_array_set_size(writer->collected, 0);
+    ++collective_writes;
+}
+
+// Rank 0 gathers the blocks of all ranks and writes the index after them
+static void write_index(Container_Writer *writer) {
+    int rank, ranks;
+    PMPI_Comm_rank(writer->comm, &rank);
+    PMPI_Comm_size(writer->comm, &ranks);
+    int count = writer->blocks->len;
+    int *counts = NULL;
+    int *displacements = NULL;
+    Container_Index index = {0};
+    if (rank == 0) {
+        counts = g_new(int, ranks);
+        displacements = g_new(int, ranks);
+    }
+    PMPI_Gather(&count, 1, MPI_INT, counts, 1, MPI_INT, 0, writer->comm);
+    if (rank == 0) {
+        for (int i = 0; i < ranks; ++i) {
+            displacements[i] = index.count;
+            index.count += counts[i];
+        }
+        index.blocks = g_new(Container_Index_Entry, index.count);
+    }
+    MPI_Datatype type = entry_type();
+    PMPI_Gatherv(writer->blocks->data, count, type, index.blocks, counts,
+                 displacements, type, 0, writer->comm);
+
+    // All blocks are written once rank 0 has their entries
+    if (rank == 0) {
+        guint64 end;
+        PMPI_Win_lock(MPI_LOCK_SHARED, 0, 0, writer->window);
+        PMPI_Get(&end, 1, MPI_UINT64_T, 0, 0, 1, MPI_UINT64_T, writer->window);
+        PMPI_Win_unlock(0, writer->window);
+        container_index_build(&index);
+        Container_Footer footer;
+        container_footer_init(&footer, index_position(end), index.count,
+                              index.size);
+        PMPI_File_write_at(writer->container, footer.index, index.blocks,
+                           index.count, type, MPI_STATUS_IGNORE);
+        PMPI_File_write_at(writer->container,
+                           footer.index +
+                               index.count * sizeof(Container_Index_Entry),
+                           &footer, sizeof(footer), MPI_BYTE,
+                           MPI_STATUS_IGNORE);
+        container_index_free(&index);
+        g_free(counts);
+        g_free(displacements);
+    }
+    MPI_Type_free(&type);
+}
+
+// Collective, before the original file is closed
+void container_close(MPI_File fh) {
+    if (!container_enabled())
+        return;
+    Container_Reader *reader = g_hash_table_lookup(readers, (void *)fh);
+    if (reader != NULL) {
+        g_hash_table_remove(readers, (void *)fh);
+        if (!reader->shared)
+            PMPI_File_close(&reader->container);
+        container_index_free(&reader->index);
+        g_free(reader);
+    }
+    Container_Writer *writer = lookup(fh);
+    if (writer == NULL)
+        return;
+    g_hash_table_remove(containers, (void *)fh);
+    write_index(writer);
+    PMPI_Win_free(&writer->window);
+    PMPI_Comm_free(&writer->comm);
+    PMPI_File_close(&writer->container);
+    g_array_free(writer->blocks, TRUE);
+    g_array_free(writer->collected, TRUE);
+    g_free(writer);
+}
+
+gboolean container_reads(MPI_File fh) {
+    return container_enabled() &&
+           g_hash_table_lookup(readers, (void *)fh) != NULL;
+}
+
+// First block with an end after start and first one starting at or after end
+void container_index_find(const Container_Index *index, guint64 start,
+                          guint64 end, guint64 *first, guint64 *last) {
+    guint64 low = 0, high = index->count;
+    while (low < high) {
+        guint64 middle = low + (high - low) / 2;
+        if (index->blocks[middle].max_end > start)
+            high = middle;
+        else
+            low = middle + 1;
+    }
+    *first = low;
+    high = index->count;
+    while (low < high) {
+        guint64 middle = low + (high - low) / 2;
+        if (index->blocks[middle].offset >= end)
+            high = middle;
+        else
+            low = middle + 1;
+    }
+    *last = low;
+}
+
+static gint compare_positions(gconstpointer a, gconstpointer b) {
+    guint64 data_a = ((const Block_Read *)a)->block->data;
+    guint64 data_b = ((const Block_Read *)b)->block->data;
+    return (data_a > data_b) - (data_a < data_b);
+}
+
+/*
+ * Reads the compressed data of the blocks, ordered by their position. Blocks
+ * that are only separated by a block header are read at once.
+ */
+static GList *read_extents(MPI_File container, Block_Read *block_reads,
+                           int count) {
+    GList *extents = NULL;
+    for (int i = 0; i < count;) {
+        guint64 start = block_reads[i].block->data;
+        guint64 end = start + block_reads[i].block->compressed_size;
+        int next = i + 1;
+        while (next < count &&
+               block_reads[next].block->data <=
+                   end + sizeof(Container_Block_Header) &&
+               block_reads[next].block->data +
+                       block_reads[next].block->compressed_size - start <=
+                   G_MAXINT) {
+            end = block_reads[next].block->data +
+                  block_reads[next].block->compressed_size;
+            ++next;
+        }
+        char *extent = g_malloc(end - start);
+        PMPI_File_read_at(container, start, extent, end - start, MPI_BYTE,
+                          MPI_STATUS_IGNORE);
+        read_compressed_bytes += end - start;
+        for (; i < next; ++i)
+            block_reads[i].compressed =
+                extent + (block_reads[i].block->data - start);
+        extents = g_list_prepend(extents, extent);
+    }
+    return extents;
+}
+
+// Blocks that lie within the read and aren't overlapped decompress into buf
+static gboolean decompress_block(Block_Read *block_read, guint64 start,
+                                 guint64 end, char *buf) {
+    const Container_Index_Entry *block = block_read->block;
+    block_read->in_place = !block->overlapped && block->offset >= start &&
+                           block->offset + block->raw_size <= end;
+    block_read->raw = block_read->in_place ? buf + (block->offset - start)
+                                           : g_malloc(block->raw_size);
+    if (block->algorithm == CONTAINER_STORED) {
+        memcpy(block_read->raw, block_read->compressed, block->raw_size);
+    } else if (block->algorithm < _COMPRESSOR_COUNT) {
+        CompressionAlgorithm *compressor = &g_array_index(
+            available_compressors, CompressionAlgorithm, block->algorithm);
+        if (compressor->decompress(block_read->compressed, block_read->raw,
+                                   block->compressed_size,
+                                   block->raw_size) != block->raw_size)
+            return FALSE;
+    } else {
+        return FALSE;
+    }
+    return XXH3_64bits(block_read->raw, block->raw_size) == block->checksum;
+}
+
+/*
+ * Read-write handles see the blocks this rank wrote since the open, those of
+ * other ranks once the file is reopened
+ */
+static void sync_reader(Container_Reader *reader, Container_Writer *writer) {
+    if (writer == NULL || writer->blocks->len == reader->synced)
+        return;
+    guint added = writer->blocks->len - reader->synced;
+    Container_Index *index = &reader->index;
+    index->blocks =
+        g_renew(Container_Index_Entry, index->blocks, index->count + added);
+    memcpy(index->blocks + index->count,
+           &g_array_index(writer->blocks, Container_Index_Entry,
+                          reader->synced),
+           added * sizeof(Container_Index_Entry));
+    index->count += added;
+    reader->synced = writer->blocks->len;
+    container_index_build(index);
+}
+
+// Reads size bytes at start, in bytes of the original file
+static int read_run(Container_Reader *reader, guint64 start, char *buf,
+                    size_t size, size_t *read_size) {
+    guint64 end = MIN(start + size, reader->index.size);
+    *read_size = end > start ? end - start : 0;
+    if (*read_size == 0)
+        return MPI_SUCCESS;
+    read_bytes += *read_size;
+
+    guint64 first, last;
+    container_index_find(&reader->index, start, end, &first, &last);
+    Block_Read *block_reads = g_new0(Block_Read, last - first);
+    int count = 0;
+    guint64 covered = start;
+    for (guint64 i = first; i < last; ++i) {
+        const Container_Index_Entry *block = &reader->index.blocks[i];
+        if (block->offset + block->raw_size <= start)
+            continue;
+        if (block->offset > covered)
+            memset((char *)buf + (covered - start), 0,
+                   block->offset - covered);
+        covered = MAX(covered, block->offset + block->raw_size);
+        block_reads[count++].block = block;
+    }
+    if (covered < end)
+        memset((char *)buf + (covered - start), 0, end - covered);
+    read_blocks += count;
+
+    // Later writes of the same bytes are copied last
+    qsort(block_reads, count, sizeof(Block_Read), compare_positions);
+    GList *extents = read_extents(reader->container, block_reads, count);
+
+    int workers = CLAMP(threads, 1, count);
+    int failed = 0;
+#pragma omp parallel for num_threads(workers) if (workers > 1)                \
+    schedule(dynamic, 1) reduction(+ : failed)
+    for (int i = 0; i < count; ++i)
+        failed += !decompress_block(&block_reads[i], start, end, buf);
+
+    for (int i = 0; i < count; ++i) {
+        const Container_Index_Entry *block = block_reads[i].block;
+        if (block_reads[i].in_place)
+            continue;
+        guint64 from = MAX(start, block->offset);
+        guint64 to = MIN(end, block->offset + block->raw_size);
+        memcpy((char *)buf + (from - start),
+               block_reads[i].raw + (from - block->offset), to - from);
+        g_free(block_reads[i].raw);
+    }
+    g_list_free_full(extents, g_free);
+    g_free(block_reads);
+    if (failed > 0) {
+        g_warning("%d corrupt blocks in the container, at offset %llu", failed,
+                  (unsigned long long)start);
+        return MPI_ERR_IO;
+    }
+    return MPI_SUCCESS;
+}
+
+/*
+ * Reads size bytes at offset, in etypes of the file view, of the original
+ * file, run by run for non-contiguous views. read_size is less at its end,
+ * bytes no block covers read as zeros.
+ */
+int container_read(MPI_File fh, MPI_Offset offset, void *buf, size_t size,
+                   size_t *read_size) {
+    Container_Reader *reader = g_hash_table_lookup(readers, (void *)fh);
+    sync_reader(reader, lookup(fh));
+    GArray *runs = container_view_runs(fh, offset, size);
+    int ret = MPI_SUCCESS;
+    *read_size = 0;
+    ++reads;
+    for (guint i = 0; i < runs->len && ret == MPI_SUCCESS; ++i) {
+        const Container_Run *run = &g_array_index(runs, Container_Run, i);
+        size_t run_size;
+        ret = read_run(reader, run->offset, (char *)buf + *read_size,
+                       run->size, &run_size);
+        *read_size += run_size;
+        if (run_size < run->size)
+            break;
+    }
+    g_array_unref(runs);
+    return ret;
+}
+
+void container_report() {
+    if (!container_enabled())
+        return;
+    add_counter("Container: blocks", blocks);
+    add_counter("Container: stored blocks", stored_blocks);
+    add_counter("Container: raw bytes", raw_bytes);
+    add_counter("Container: written bytes", written_bytes);
+    add_counter("Container: collective writes", collective_writes);
+    add_counter("Container: reads", reads);
+    add_counter("Container: read blocks", read_blocks);
+    add_counter("Container: read bytes", read_bytes);
+    add_counter("Container: read compressed bytes", read_compressed_bytes);
+}
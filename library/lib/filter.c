@@ -1,8 +1,10 @@
 #include <filter.h>
+#include <governor.h>
 #include <settings.h>
 
 gboolean filter_IO(size_t buf_size) {
     if (buf_size < opt_min_chunk_size)
         return FALSE;
-    return TRUE;
-}
\ No newline at end of file
+    // Every write passing the size check counts for the overhead governor
+    return governor_admit();
+}
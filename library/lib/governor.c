@@ -0,0 +1,169 @@
+#include <governor.h>
+#include <stdlib.h>
+#include <tracing.h>
+#include <util.h>
+
+// Beyond this interval, analysis is disabled
+#define GOVERNOR_MAX_SKIP 64
+// Writes a state has to be observed for, per skip interval, before relaxing
+#define GOVERNOR_WINDOW 8
+
+static const char *governor_state_names[] = {
+    [GOVERNOR_FULL] = "full",
+    [GOVERNOR_SAMPLE] = "sample",
+    [GOVERNOR_SKIP] = "skip",
+    [GOVERNOR_DISABLED] = "disabled",
+};
+
+static gfloat budget = 0;
+static long start = 0;
+static long analysis_time = 0;
+static long writes = 0;
+static int skip_interval = 1;
+// Since the last transition, to judge the current state only
+static long window_start = 0;
+static long window_analysis_time = 0;
+static long window_writes = 0;
+// Read by analysis workers, see governor_forces_sampling
+static gint state = GOVERNOR_FULL;
+
+void governor_init(gfloat max_overhead) {
+    budget = max_overhead;
+    start = timeInMicroseconds();
+    window_start = start;
+}
+
+static gfloat ratio(long time, long elapsed) {
+    return elapsed > 0 ? (gfloat)time / elapsed : 0;
+}
+
+static void transition(Governor_State next, int interval, gfloat current) {
+    g_debug("Governor: %s -> %s (interval %d), overhead %.2f%%",
+            governor_state_names[state], governor_state_names[next], interval,
+            current * 100);
+    g_atomic_int_set(&state, next);
+    skip_interval = interval;
+    add_governor_decision(next, interval, current, writes);
+
+    window_start = timeInMicroseconds();
+    window_analysis_time = 0;
+    window_writes = 0;
+}
+
+static void escalate(gfloat current) {
+    switch (state) {
+    case GOVERNOR_FULL:
+        transition(GOVERNOR_SAMPLE, 1, current);
+        break;
+    case GOVERNOR_SAMPLE:
+        transition(GOVERNOR_SKIP, 2, current);
+        break;
+    case GOVERNOR_SKIP:
+        if (skip_interval < GOVERNOR_MAX_SKIP)
+            transition(GOVERNOR_SKIP, skip_interval * 2, current);
+        else
+            transition(GOVERNOR_DISABLED, 0, current);
+        break;
+    default:
+        break;
+    }
+}
+
+static void relax(gfloat current) {
+    switch (state) {
+    case GOVERNOR_DISABLED:
+        transition(GOVERNOR_SKIP, GOVERNOR_MAX_SKIP, current);
+        break;
+    case GOVERNOR_SKIP:
+        if (skip_interval > 2)
+            transition(GOVERNOR_SKIP, skip_interval / 2, current);
+        else
+            transition(GOVERNOR_SAMPLE, 1, current);
+        break;
+    case GOVERNOR_SAMPLE:
+        transition(GOVERNOR_FULL, 1, current);
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+ * Decides whether the current write is analyzed. A state is relaxed once it
+ * was observed for a while and both the overall overhead and the overhead
+ * since the last transition are below half the budget. The gap to the budget
+ * keeps the state from flapping.
+ */
+gboolean governor_admit() {
+    ++writes;
+    ++window_writes;
+    if (budget <= 0)
+        return TRUE;
+
+    int interval =
+        state == GOVERNOR_DISABLED ? GOVERNOR_MAX_SKIP : skip_interval;
+    if (window_writes > GOVERNOR_WINDOW * interval) {
+        long now = timeInMicroseconds();
+        gfloat current = ratio(analysis_time, now - start);
+        if (current < budget / 2 &&
+            ratio(window_analysis_time, now - window_start) < budget / 2)
+            relax(current);
+    }
+
+    switch (state) {
+    case GOVERNOR_DISABLED:
+        add_counter("Governor: skipped", 1);
+        return FALSE;
+    case GOVERNOR_SKIP:
+        // The last write of every interval, so a window spans whole ones
+        if (window_writes % skip_interval != 0) {
+            add_counter("Governor: skipped", 1);
+            return FALSE;
+        }
+        // Admitted writes are sampled as well, fall through
+    case GOVERNOR_SAMPLE:
+        add_counter("Governor: sampled", 1);
+        // fall through
+    default:
+        return TRUE;
+    }
+}
+
+// Time the application thread spent on analysis or inferencing
+void governor_account(long duration) {
+    analysis_time += duration;
+    window_analysis_time += duration;
+    if (budget <= 0)
+        return;
+
+    // Escalate only while the current state is too expensive on its own
+    long now = timeInMicroseconds();
+    gfloat current = ratio(analysis_time, now - start);
+    if (current > budget &&
+        ratio(window_analysis_time, now - window_start) > budget)
+        escalate(current);
+}
+
+gboolean governor_forces_sampling() {
+    gint current = g_atomic_int_get(&state);
+    return current == GOVERNOR_SAMPLE || current == GOVERNOR_SKIP;
+}
+
+void governor_report() {
+    add_counter("Governor: analysis time [µs]", analysis_time);
+    add_counter("Governor: wall time [µs]", timeInMicroseconds() - start);
+}
+
+const char *governor_state_name(Governor_State state) {
+    return governor_state_names[state];
+}
+
+// Accepts "2%" as well as "2", both meaning two percent
+gfloat parse_overhead(const gchar *text) {
+    gchar *end;
+    gdouble percent = g_ascii_strtod(text, &end);
+    if (end == text || (*end != '\0' && g_strcmp0(end, "%") != 0) ||
+        percent <= 0 || percent >= 100)
+        return -1;
+    return percent / 100;
+}
@@ -0,0 +1,360 @@
+#include <analysis/compression.h>
+#include <inferencing/bandit.h>
+#include <inferencing/evaluation.h>
+#include <math.h>
+#include <meta.h>
+#include <settings.h>
+#include <stdio.h>
+#include <string.h>
+#include <tracing.h>
+
+/*
+ * LinUCB over all compressors and levels: every arm models the reward of its
+ * compressor as linear in a few byte statistics of the buffer and is chosen by
+ * the upper confidence bound of that estimate.
+ */
+
+#define FEATURES 6
+
+static const char state_magic[8] = "IOABND01";
+
+static const char *selector_names[] = {
+    [SELECTOR_MODEL] = "model",
+    [SELECTOR_BANDIT] = "bandit",
+};
+
+typedef struct {
+    CompressionAlgorithm_Level compressor;
+    // Inverse of A = I + sum of x x^T, updated by Sherman-Morrison
+    double a_inv[FEATURES][FEATURES];
+    // Sum of reward * x
+    double b[FEATURES];
+    long pulls;
+} Bandit_Arm;
+
+static GArray *arms = NULL;
+// The arms as loaded, what the ranks learn is added to them
+static Bandit_Arm *initial_arms = NULL;
+static double alpha = 0.2;
+static gchar *state_file = NULL;
+// Set by bandit_merge, a job that never merged doesn't save the state
+static int world_rank = -1;
+static long selections = 0;
+static long ideal_selections = 0;
+
+Selector name_to_selector(const char *name) {
+    for (int i = 0; i < _SELECTOR_COUNT; i++) {
+        if (strcmp(name, selector_names[i]) == 0)
+            return i;
+    }
+    return _SELECTOR_COUNT;
+}
+
+static void reset_arm(Bandit_Arm *arm) {
+    memset(arm->a_inv, 0, sizeof(arm->a_inv));
+    memset(arm->b, 0, sizeof(arm->b));
+    for (int i = 0; i < FEATURES; ++i)
+        arm->a_inv[i][i] = 1;
+    arm->pulls = 0;
+}
+
+static Bandit_Arm *find_arm(CompressionAlgorithm_Level compressor) {
+    for (int i = 0; i < arms->len; ++i) {
+        Bandit_Arm *arm = &g_array_index(arms, Bandit_Arm, i);
+        if (arm->compressor.algorithm == compressor.algorithm &&
+            arm->compressor.level == compressor.level)
+            return arm;
+    }
+    return NULL;
+}
+
+// Arms of compressors that are no longer available are ignored
+static void load_state(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+        return;
+    char magic[sizeof(state_magic)];
+    int features, count;
+    if (fread(magic, sizeof(magic), 1, f) != 1 ||
+        memcmp(magic, state_magic, sizeof(magic)) != 0 ||
+        fread(&features, sizeof(features), 1, f) != 1 ||
+        features != FEATURES || fread(&count, sizeof(count), 1, f) != 1) {
+        g_warning("Ignoring invalid bandit state: %s", path);
+        fclose(f);
+        return;
+    }
+    for (int i = 0; i < count; ++i) {
+        Bandit_Arm stored;
+        if (fread(&stored, sizeof(stored), 1, f) != 1)
+            break;
+        Bandit_Arm *arm = find_arm(stored.compressor);
+        if (arm != NULL)
+            *arm = stored;
+    }
+    fclose(f);
+}
+
+static void save_state(const char *path) {
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        g_warning("Can't write bandit state: %s", path);
+        return;
+    }
+    int features = FEATURES;
+    fwrite(state_magic, sizeof(state_magic), 1, f);
+    fwrite(&features, sizeof(features), 1, f);
+    fwrite(&arms->len, sizeof(int), 1, f);
+    fwrite(arms->data, sizeof(Bandit_Arm), arms->len, f);
+    fclose(f);
+}
+
+/*
+ * exploration scales the confidence bound. With a state_path the arms are
+ * loaded from it if it exists, merged over all ranks at MPI_Finalize and saved
+ * to it by rank 0 at exit.
+ */
+void bandit_init(double exploration, const char *state_path) {
+    alpha = exploration;
+    arms = g_array_new(FALSE, TRUE, sizeof(Bandit_Arm));
+    for (int i = 0; i < available_compressors->len; ++i) {
+        CompressionAlgorithm *compressor =
+            &g_array_index(available_compressors, CompressionAlgorithm, i);
+        for (int l = 0; l < compressor->levels_count; ++l) {
+            Bandit_Arm arm = {{compressor->compression_id,
+                               compressor->levels[l]}};
+            reset_arm(&arm);
+            g_array_append_val(arms, arm);
+        }
+    }
+    if (state_path != NULL) {
+        state_file = g_strdup(state_path);
+        load_state(state_path);
+        initial_arms =
+            g_memdup2(arms->data, arms->len * sizeof(Bandit_Arm));
+    }
+}
+
+gboolean bandit_enabled() { return arms != NULL; }
+
+static void extract_features(const void *buf, size_t size, size_t element_size,
+                             double *x) {
+    Byte_Statistics stats;
+    sample_statistics(buf, size, element_size, &stats);
+    x[0] = 1;
+    x[1] = stats.zeros;
+    x[2] = stats.entropy;
+    x[3] = stats.runs;
+    x[4] = stats.strided;
+    x[5] = size > 0 ? log2((double)size) / 40 : 0;
+}
+
+// Estimated reward of the arm and the upper bound chosen by
+static double upper_bound(const Bandit_Arm *arm, const double *x,
+                          double *expected) {
+    double mean = 0, variance = 0;
+    for (int i = 0; i < FEATURES; ++i) {
+        double theta = 0, a_inv_x = 0;
+        for (int j = 0; j < FEATURES; ++j) {
+            theta += arm->a_inv[i][j] * arm->b[j];
+            a_inv_x += arm->a_inv[i][j] * x[j];
+        }
+        mean += theta * x[i];
+        variance += x[i] * a_inv_x;
+    }
+    *expected = mean;
+    return mean + alpha * sqrt(MAX(variance, 0));
+}
+
+static Bandit_Arm *select_arm(const double *x, double *expected) {
+    Bandit_Arm *best = NULL;
+    double best_bound = -G_MAXDOUBLE;
+    for (int i = 0; i < arms->len; ++i) {
+        Bandit_Arm *arm = &g_array_index(arms, Bandit_Arm, i);
+        double arm_expected;
+        double bound = upper_bound(arm, x, &arm_expected);
+        if (bound > best_bound) {
+            best = arm;
+            best_bound = bound;
+            *expected = arm_expected;
+        }
+    }
+    return best;
+}
+
+static void update(Bandit_Arm *arm, const double *x, double reward) {
+    double a_inv_x[FEATURES];
+    double denominator = 1;
+    for (int i = 0; i < FEATURES; ++i) {
+        a_inv_x[i] = 0;
+        for (int j = 0; j < FEATURES; ++j)
+            a_inv_x[i] += arm->a_inv[i][j] * x[j];
+        denominator += x[i] * a_inv_x[i];
+    }
+    // A is symmetric, so x^T A^-1 is the transpose of A^-1 x
+    for (int i = 0; i < FEATURES; ++i) {
+        for (int j = 0; j < FEATURES; ++j)
+            arm->a_inv[i][j] -= a_inv_x[i] * a_inv_x[j] / denominator;
+        arm->b[i] += reward * x[i];
+    }
+    ++arm->pulls;
+}
+
+// Share of the best metric value measured for the buffer, 1 if ideal
+static double reward(double metric_value, double best_value) {
+    double ideal = MAX(metric_value, best_value);
+    return ideal > 0 ? metric_value / ideal : 0;
+}
+
+/*
+ * Chooses, measures and learns from the compressor of one write. Without an
+ * evaluation there is no reward, the bandit only learns from evaluated writes.
+ */
+void bandit_record(const void *buf, size_t buf_size, Input_Type type,
+                   const Cache_Key *key, gboolean evaluated,
+                   const Write_Target *target) {
+    double x[FEATURES];
+    double expected = 0;
+    // Nothing to compress or learn from
+    if (buf_size == 0)
+        return;
+    extract_features(buf, buf_size, input_type_size(type), x);
+    Bandit_Arm *arm = select_arm(x, &expected);
+    if (!evaluated) {
+        if (target != NULL)
+            container_write(target, buf, buf_size, arm->compressor, NULL, 0);
+        return;
+    }
+
+    long s = timeInMicroseconds();
+    void *output = NULL;
+    CompressionSample evaluation =
+        evaluate_output(arm->compressor, buf, buf_size,
+                        target != NULL ? &output : NULL);
+    CompressionSample best = best_compressor(
+        buf, buf_size, opt_metric_inferencing, &evaluation.compressor);
+    evaluation_account(timeInMicroseconds() - s);
+    if (target != NULL)
+        container_write(target, buf, buf_size, evaluation.compressor, output,
+                        evaluation.compressed_size);
+    update(arm, x, reward(evaluation.metric_value, best.metric_value));
+    // The search for the ideal compressor measured it anyway
+    Bandit_Arm *ideal = find_arm(best.compressor);
+    if (ideal != NULL && best.metric_value > evaluation.metric_value)
+        update(ideal, x, 1);
+
+    ++selections;
+    if (evaluation.metric_value >= best.metric_value)
+        ++ideal_selections;
+    Inference_Choice choice = {CLAMP(expected, 0, 1), 0, evaluation};
+    if (key != NULL)
+        result_cache_store_inference(key, evaluation, best, choice);
+    add_evaluation_operation(buf_size, evaluation, best, choice, FALSE);
+}
+
+// Gauss-Jordan elimination with partial pivoting, FALSE if m is singular
+static gboolean invert(double m[FEATURES][FEATURES],
+                       double inverse[FEATURES][FEATURES]) {
+    double a[FEATURES][2 * FEATURES] = {{0}};
+    for (int i = 0; i < FEATURES; ++i) {
+        memcpy(a[i], m[i], sizeof(m[i]));
+        a[i][FEATURES + i] = 1;
+    }
+    for (int c = 0; c < FEATURES; ++c) {
+        int pivot = c;
+        for (int r = c + 1; r < FEATURES; ++r) {
+            if (fabs(a[r][c]) > fabs(a[pivot][c]))
+                pivot = r;
+        }
+        if (fabs(a[pivot][c]) < 1e-300)
+            return FALSE;
+        for (int j = 0; j < 2 * FEATURES; ++j) {
+            double swap = a[c][j];
+            a[c][j] = a[pivot][j];
+            a[pivot][j] = swap;
+        }
+        double scale = a[c][c];
+        for (int j = 0; j < 2 * FEATURES; ++j)
+            a[c][j] /= scale;
+        for (int r = 0; r < FEATURES; ++r) {
+            double factor = a[r][c];
+            if (r == c || factor == 0)
+                continue;
+            for (int j = 0; j < 2 * FEATURES; ++j)
+                a[r][j] -= factor * a[c][j];
+        }
+    }
+    for (int i = 0; i < FEATURES; ++i)
+        memcpy(inverse[i], &a[i][FEATURES], sizeof(inverse[i]));
+    return TRUE;
+}
+
+/*
+ * Collective at MPI_Finalize if the state is saved. Every rank only learned
+ * from its own writes, rank 0 adds the changes of A, b and the pulls of all
+ * ranks to the loaded arms, so the saved state holds what all of them learned.
+ */
+void bandit_merge() {
+    if (!bandit_enabled() || state_file == NULL)
+        return;
+    const int values = FEATURES * FEATURES + FEATURES + 1;
+    PMPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+    double *learned = g_new0(double, arms->len * values);
+    double *merged =
+        world_rank == 0 ? g_new(double, arms->len * values) : NULL;
+    for (guint i = 0; i < arms->len; ++i) {
+        Bandit_Arm *arm = &g_array_index(arms, Bandit_Arm, i);
+        Bandit_Arm *initial = &initial_arms[i];
+        double *change = &learned[i * values];
+        double a[FEATURES][FEATURES], a_initial[FEATURES][FEATURES];
+        if (arm->pulls == initial->pulls || !invert(arm->a_inv, a) ||
+            !invert(initial->a_inv, a_initial))
+            continue;
+        for (int j = 0; j < FEATURES; ++j) {
+            for (int k = 0; k < FEATURES; ++k)
+                change[j * FEATURES + k] = a[j][k] - a_initial[j][k];
+            change[FEATURES * FEATURES + j] = arm->b[j] - initial->b[j];
+        }
+        change[values - 1] = arm->pulls - initial->pulls;
+    }
+    PMPI_Reduce(learned, merged, arms->len * values, MPI_DOUBLE, MPI_SUM, 0,
+                MPI_COMM_WORLD);
+
+    for (guint i = 0; world_rank == 0 && i < arms->len; ++i) {
+        Bandit_Arm *arm = &g_array_index(arms, Bandit_Arm, i);
+        Bandit_Arm *initial = &initial_arms[i];
+        const double *change = &merged[i * values];
+        double a[FEATURES][FEATURES];
+        if (change[values - 1] == 0 || !invert(initial->a_inv, a))
+            continue;
+        for (int j = 0; j < FEATURES; ++j) {
+            for (int k = 0; k < FEATURES; ++k)
+                a[j][k] += change[j * FEATURES + k];
+            arm->b[j] = initial->b[j] + change[FEATURES * FEATURES + j];
+        }
+        if (!invert(a, arm->a_inv))
+            continue;
+        arm->pulls = initial->pulls + (long)change[values - 1];
+    }
+    g_free(learned);
+    g_free(merged);
+}
+
+void bandit_report() {
+    if (!bandit_enabled())
+        return;
+    add_counter("Bandit: selections", selections);
+    add_counter("Bandit: ideal selections", ideal_selections);
+}
+
+void bandit_cleanup() {
+    if (!bandit_enabled())
+        return;
+    if (state_file != NULL && world_rank == 0)
+        save_state(state_file);
+    g_free(state_file);
+    state_file = NULL;
+    g_free(initial_arms);
+    initial_arms = NULL;
+    g_array_free(arms, TRUE);
+    arms = NULL;
+}
@@ -0,0 +1,198 @@
+#include <inferencing/batch.h>
+#include <inferencing/compression.h>
+#include <inferencing/evaluation.h>
+#include <settings.h>
+#include <string.h>
+#include <tracing.h>
+#include <util.h>
+
+typedef struct {
+    void *buf;
+    size_t buf_size;
+    Input_Type type;
+    Cache_Key key;
+    gboolean keyed;
+    Decision_Key region;
+    gboolean decided;
+    gboolean evaluated;
+    Write_Target target;
+    gboolean targeted;
+} Pending_Inference;
+
+static int batch_size = 1;
+static long max_wait_time = 0;
+// Writes waiting for a prediction, each with a copy of its buffer
+static GArray *pending = NULL;
+static long oldest = 0;
+// Arguments of predict_compressors, for up to batch_size writes
+static const void **batch_data = NULL;
+static size_t *batch_lengths = NULL;
+static Input_Type *batch_types = NULL;
+static Prediction *batch_predictions = NULL;
+
+// max_wait in ms, pending writes are flushed on the next write after it
+void inference_batch_init(int max_batch, int max_wait) {
+    batch_size = max_batch;
+    max_wait_time = max_wait * 1000L;
+    if (!inference_batching())
+        return;
+    pending = g_array_sized_new(FALSE, FALSE, sizeof(Pending_Inference),
+                                batch_size);
+    batch_data = g_new(const void *, batch_size);
+    batch_lengths = g_new(size_t, batch_size);
+    batch_types = g_new(Input_Type, batch_size);
+    batch_predictions = g_new(Prediction, batch_size);
+}
+
+gboolean inference_batching() { return batch_size > 1; }
+
+/*
+ * Below opt_fallback_threshold the prediction is not trusted, the best of the
+ * opt_fallback_top_k most likely compressors is measured instead. With an
+ * output, the compressed data of the chosen compressor is kept in it.
+ */
+static CompressionSample choose_compressor(const Prediction *prediction,
+                                           const void *buf, size_t buf_size,
+                                           Inference_Choice *choice,
+                                           void **output) {
+    CompressionSample chosen =
+        evaluate_output(prediction->compressor, buf, buf_size, output);
+    choice->confidence = prediction->confidence;
+    choice->searched = 0;
+    choice->predicted = chosen;
+    if (prediction->confidence >= opt_fallback_threshold)
+        return chosen;
+
+    int candidates = MIN(opt_fallback_top_k, prediction->candidate_count);
+    for (int c = 1; c < candidates; ++c) {
+        void *candidate_output = NULL;
+        CompressionSample sample =
+            evaluate_output(prediction->candidates[c], buf, buf_size,
+                            output != NULL ? &candidate_output : NULL);
+        if (sample.metric_value > chosen.metric_value) {
+            chosen = sample;
+            if (output != NULL) {
+                g_free(*output);
+                *output = candidate_output;
+            }
+        } else {
+            g_free(candidate_output);
+        }
+    }
+    choice->searched = candidates;
+    add_counter("Inference: fallback searches", 1);
+    if (chosen.compressor.algorithm != prediction->compressor.algorithm ||
+        chosen.compressor.level != prediction->compressor.level)
+        add_counter("Inference: fallback changed choice", 1);
+    return chosen;
+}
+
+/*
+ * Evaluates the prediction and finds the best compressor to compare with.
+ * Predictions that are not evaluated are only measured, along with their
+ * fallback candidates, if the output is written to a target.
+ */
+void record_inference(const Prediction *prediction, const void *buf,
+                      size_t buf_size, const Cache_Key *key,
+                      gboolean evaluated, const Write_Target *target) {
+    Inference_Choice choice;
+    void *output = NULL;
+    void **kept = target != NULL ? &output : NULL;
+    if (!evaluated) {
+        if (target != NULL) {
+            CompressionSample chosen =
+                choose_compressor(prediction, buf, buf_size, &choice, kept);
+            container_write(target, buf, buf_size, chosen.compressor, output,
+                            chosen.compressed_size);
+        }
+        return;
+    }
+
+    long s = timeInMicroseconds();
+    CompressionSample evaluation =
+        choose_compressor(prediction, buf, buf_size, &choice, kept);
+    CompressionSample best = best_compressor(
+        buf, buf_size, opt_metric_inferencing, &evaluation.compressor);
+    evaluation_account(timeInMicroseconds() - s);
+    if (target != NULL)
+        container_write(target, buf, buf_size, evaluation.compressor, output,
+                        evaluation.compressed_size);
+    if (key != NULL)
+        result_cache_store_inference(key, evaluation, best, choice);
+    add_evaluation_operation(buf_size, evaluation, best, choice, FALSE);
+}
+
+void inference_batch_flush() {
+    if (pending == NULL || pending->len == 0)
+        return;
+
+    // Submitting flushes at batch_size writes
+    int count = pending->len;
+    for (int i = 0; i < count; ++i) {
+        Pending_Inference *p = &g_array_index(pending, Pending_Inference, i);
+        batch_data[i] = p->buf;
+        batch_lengths[i] = p->buf_size;
+        batch_types[i] = p->type;
+    }
+    predict_compressors(batch_data, batch_lengths, batch_types, count,
+                        batch_predictions);
+
+    for (int i = 0; i < count; ++i) {
+        Pending_Inference *p = &g_array_index(pending, Pending_Inference, i);
+        if (p->decided)
+            decision_cache_store(&p->region, p->buf, p->type,
+                                 &batch_predictions[i]);
+        record_inference(&batch_predictions[i], p->buf, p->buf_size,
+                         p->keyed ? &p->key : NULL, p->evaluated,
+                         p->targeted ? &p->target : NULL);
+        if (p->targeted)
+            container_target_clear(&p->target);
+        g_free(p->buf);
+    }
+    g_array_set_size(pending, 0);
+}
+
+void inference_batch_submit(const void *buf, size_t buf_size,
+                            Input_Type type, const Cache_Key *key,
+                            const Decision_Key *region, gboolean evaluated,
+                            const Write_Target *target) {
+    long now = timeInMicroseconds();
+    if (pending->len == 0)
+        oldest = now;
+
+    Pending_Inference p = {g_malloc(buf_size), buf_size, type};
+    p.evaluated = evaluated;
+    memcpy(p.buf, buf, buf_size);
+    if (key != NULL) {
+        p.key = *key;
+        p.keyed = TRUE;
+    }
+    if (region != NULL) {
+        p.region = *region;
+        p.decided = TRUE;
+    }
+    if (target != NULL) {
+        container_target_copy(&p.target, target);
+        p.targeted = TRUE;
+    }
+    g_array_append_val(pending, p);
+
+    if (pending->len >= batch_size || now - oldest >= max_wait_time)
+        inference_batch_flush();
+}
+
+void inference_batch_cleanup() {
+    if (pending == NULL)
+        return;
+    inference_batch_flush();
+    g_array_free(pending, TRUE);
+    pending = NULL;
+    g_free(batch_data);
+    g_free(batch_lengths);
+    g_free(batch_types);
+    g_free(batch_predictions);
+    batch_data = NULL;
+    batch_lengths = NULL;
+    batch_types = NULL;
+    batch_predictions = NULL;
+}
@@ -1,19 +1,33 @@
-#include <assert.h>
+#include <analysis/cache.h>
 #include <inferencing/compression.h>
+#include <inferencing/decision.h>
+#include <inferencing/mlp.h>
+#include <glib/gstdio.h>
 #include <math.h>
+#include <mpi.h>
 #include <settings.h>
+#include <tracing.h>
+#include <unistd.h>
 #include <util.h>
 
 const OrtApi *onnx_api = NULL;
-OrtSession *onnx_session = NULL;
 OrtEnv *onnx_env = NULL;
 OrtSessionOptions *onnx_session_options = NULL;
+// Of every session, reloaded ones included
+static int session_threads = 1;
+
+static const char *inference_backend_names[] = {
+    [INFERENCE_BACKEND_ONNX] = "onnx",
+    [INFERENCE_BACKEND_NATIVE] = "native",
+};
+
+static const char *inference_vote_names[] = {
+    [INFERENCE_VOTE_MEAN] = "mean",
+    [INFERENCE_VOTE_MAJORITY] = "majority",
+};
+static Inference_Vote vote_type = INFERENCE_VOTE_MEAN;
 
-const CompressionAlgorithm_Level *labels;
-int input_size;
-int total_elements;
 const size_t ELEMENT_SIZE = sizeof(float);
-size_t total_size;
 
 #define ORT_ABORT_ON_ERROR(expr)                                               \
     do {                                                                       \
@@ -26,78 +40,544 @@ size_t total_size;
         }                                                                      \
     } while (0);
 
-CompressionAlgorithm_Level *parse_labels(char *path) {
+/*
+ * The labels follow the metric and the input size, one compressor:level per
+ * non-empty row. Returns NULL if the file can't be read or has a malformed or
+ * unknown label, so reloads keep the previous model.
+ */
+CompressionAlgorithm_Level *parse_labels(const char *path, int *count) {
     gsize length;
     char *content;
     if (!g_file_get_contents(path, &content, &length, NULL)) {
         g_printerr("Can't open settings file: %s\n", path);
-        exit(1);
+        return NULL;
     }
 
     gchar **settings_raw = g_strsplit(content, "\n", 0);
-    gchar **ptr;
-
-    // Count valid label rows (ignore empty rows, skip first two entries)
-    gint valid_labels = 0;
+    g_free(content);
+    GArray *labels =
+        g_array_new(FALSE, FALSE, sizeof(CompressionAlgorithm_Level));
+    gboolean valid = TRUE;
     gint row_id = 0;
-    for (ptr = settings_raw; *ptr; ptr++) {
-        if (!g_strcmp0(*ptr, "") == 0 && row_id > 1)
-            ++valid_labels;
-        ++row_id;
-    }
-
-    CompressionAlgorithm_Level *labels =
-        malloc(valid_labels * sizeof(CompressionAlgorithm_Level));
-
-    row_id = 0;
-    gint label_id = -1;
-    for (ptr = settings_raw; *ptr; ptr++) {
-        if (!g_strcmp0(*ptr, "") == 0 && row_id > 1) {
-            ++label_id;
-            gchar **label_level = g_strsplit(*ptr, ":", 0);
-            // g_debug("Compressor: %s - Level: %d", label_level[0],
-            //        atoi(label_level[1]));
-            labels[label_id].algorithm = name_to_compressor(label_level[0]);
-            labels[label_id].level = atoi(label_level[1]);
-            // g_print("name_to_compressor(%s): %d\n", label_level[0],
-            //         name_to_compressor(label_level[0]));
-            g_strfreev(label_level);
+    for (gchar **ptr = settings_raw; valid && *ptr; ptr++, ++row_id) {
+        if (g_strcmp0(*ptr, "") == 0 || row_id < 2)
+            continue;
+        gchar **label_level = g_strsplit(*ptr, ":", 0);
+        CompressionAlgorithm_Level label;
+        valid = label_level[0] != NULL && label_level[1] != NULL;
+        if (valid) {
+            label.algorithm = name_to_compressor(label_level[0]);
+            label.level = atoi(label_level[1]);
+            valid = label.algorithm != _COMPRESSOR_COUNT;
         }
-        ++row_id;
+        if (valid)
+            g_array_append_val(labels, label);
+        else
+            g_printerr("Invalid label in %s: %s\n", path, *ptr);
+        g_strfreev(label_level);
     }
     g_strfreev(settings_raw);
-    return labels;
+    if (!valid || labels->len == 0) {
+        if (valid)
+            g_printerr("Settings file %s has no labels\n", path);
+        g_array_free(labels, TRUE);
+        return NULL;
+    }
+    *count = labels->len;
+    return (CompressionAlgorithm_Level *)g_array_free(labels, FALSE);
 }
 
-Metric_Type parse_metric(char *path) {
+// Returns _METRIC_COUNT if the file can't be read or the metric is unknown
+Metric_Type parse_metric(const char *path) {
     gsize length;
     char *content;
     if (!g_file_get_contents(path, &content, &length, NULL)) {
         g_printerr("Can't open settings file: %s\n", path);
-        exit(1);
+        return _METRIC_COUNT;
     }
 
     gchar **settings_raw = g_strsplit(content, "\n", 2);
-    Metric_Type metric = name_to_metric(settings_raw[0]);
+    g_free(content);
+    Metric_Type metric = settings_raw[0] != NULL
+                             ? name_to_metric(settings_raw[0])
+                             : _METRIC_COUNT;
     g_strfreev(settings_raw);
     return metric;
 }
 
-int model_input_size(char *path) {
+// Returns 0 if the file can't be read or has no positive input size
+int model_input_size(const char *path) {
     gsize length;
     char *content;
     if (!g_file_get_contents(path, &content, &length, NULL)) {
         g_printerr("Can't open settings file: %s\n", path);
-        exit(1);
+        return 0;
     }
 
     gchar **settings_raw = g_strsplit(content, "\n", 3);
-    int input_size = atoi(settings_raw[1]);
+    g_free(content);
+    int input_size = 0;
+    if (settings_raw[0] != NULL && settings_raw[1] != NULL)
+        input_size = MAX(0, atoi(settings_raw[1]));
+    if (input_size == 0)
+        g_printerr("Settings file %s has no input size\n", path);
     g_strfreev(settings_raw);
     return input_size;
 }
 
-void init_ml(char *model_path, char *settings_path) {
+/*
+ * Everything a prediction needs, created with its model. The input tensor
+ * wraps an aligned buffer of batch_capacity model inputs the sanitization
+ * writes into. Tensors are only recreated when the shape changes, i.e. for a
+ * batch of another size or a single buffer smaller than the model input.
+ */
+typedef struct {
+    OrtMemoryInfo *memory_info;
+    OrtIoBinding *binding;
+    int batch_capacity;
+    float *input;
+    OrtValue *input_tensor;
+    size_t input_rows;
+    size_t input_elements;
+    float *output;
+    OrtValue *output_tensor;
+    size_t output_rows;
+    // Model output shape, the first dimension is the batch
+    int64_t *output_shape;
+    size_t output_dim_count;
+    size_t classes;
+    // Class probabilities of every row of the last batch
+    float *probabilities;
+    // Windows of the buffers being predicted, grown to the most seen
+    int window_capacity;
+    const void **window_data;
+    size_t *window_elements;
+    Input_Type *window_types;
+    int *window_owner;
+    // Summed probabilities and votes of every buffer, grown like the windows
+    int buffer_capacity;
+    float *sums;
+    float *votes;
+    // Of the classes of the buffer being ranked
+    float *scores;
+} Inference_Context;
+
+/*
+ * A model with the settings exported along with it. The application thread
+ * predicts with the active one, reloaded models are built on the watcher thread
+ * and handed over, see take_reloaded_model.
+ */
+typedef struct {
+    const CompressionAlgorithm_Level *labels;
+    Metric_Type metric;
+    int total_elements;
+    size_t total_size;
+    // Set instead of the ONNX Runtime session by the native backend
+    MLP *native;
+    OrtSession *session;
+    gboolean profiled;
+    Inference_Context context;
+} Model;
+
+static Model *model = NULL;
+
+// Reported at the end instead of on the inference path
+static long predictions_made = 0;
+static long predicted_windows = 0;
+static long batches = 0;
+static long long prediction_time = 0;
+
+static const char *input_name = "input_1";
+static const char *output_name = "output_1";
+
+// Models exported with a fixed batch dimension predict one buffer at a time
+static gboolean model_supports_batches(OrtSession *session) {
+    OrtTypeInfo *type_info;
+    const OrtTensorTypeAndShapeInfo *tensor_info;
+    size_t dim_count;
+    int64_t batch_dim = 1;
+    ORT_ABORT_ON_ERROR(
+        onnx_api->SessionGetInputTypeInfo(session, 0, &type_info));
+    ORT_ABORT_ON_ERROR(
+        onnx_api->CastTypeInfoToTensorInfo(type_info, &tensor_info));
+    ORT_ABORT_ON_ERROR(onnx_api->GetDimensionsCount(tensor_info, &dim_count));
+    if (dim_count > 0)
+        ORT_ABORT_ON_ERROR(onnx_api->GetDimensions(tensor_info, &batch_dim, 1));
+    onnx_api->ReleaseTypeInfo(type_info);
+    return batch_dim < 1;
+}
+
+// Dynamic dimensions of the model output other than the batch are taken to be 1
+static void read_output_shape(Model *m) {
+    Inference_Context *context = &m->context;
+    OrtTypeInfo *type_info;
+    const OrtTensorTypeAndShapeInfo *tensor_info;
+    ORT_ABORT_ON_ERROR(
+        onnx_api->SessionGetOutputTypeInfo(m->session, 0, &type_info));
+    ORT_ABORT_ON_ERROR(
+        onnx_api->CastTypeInfoToTensorInfo(type_info, &tensor_info));
+    ORT_ABORT_ON_ERROR(onnx_api->GetDimensionsCount(
+        tensor_info, &context->output_dim_count));
+    context->output_shape = g_new(int64_t, context->output_dim_count);
+    ORT_ABORT_ON_ERROR(onnx_api->GetDimensions(
+        tensor_info, context->output_shape, context->output_dim_count));
+    onnx_api->ReleaseTypeInfo(type_info);
+
+    context->classes = 1;
+    for (size_t i = 1; i < context->output_dim_count; ++i) {
+        if (context->output_shape[i] < 1)
+            context->output_shape[i] = 1;
+        context->classes *= context->output_shape[i];
+    }
+}
+
+static void bind_output(Inference_Context *context, size_t rows) {
+    if (context->output_tensor != NULL && context->output_rows == rows)
+        return;
+    if (context->output_tensor != NULL)
+        onnx_api->ReleaseValue(context->output_tensor);
+
+    context->output_shape[0] = rows;
+    ORT_ABORT_ON_ERROR(onnx_api->CreateTensorWithDataAsOrtValue(
+        context->memory_info, context->output,
+        rows * context->classes * sizeof(float), context->output_shape,
+        context->output_dim_count, ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT,
+        &context->output_tensor));
+    ORT_ABORT_ON_ERROR(onnx_api->BindOutput(context->binding, output_name,
+                                            context->output_tensor));
+    context->output_rows = rows;
+}
+
+static void bind_input(Inference_Context *context, size_t rows,
+                       size_t elements) {
+    if (context->input_tensor != NULL && context->input_rows == rows &&
+        context->input_elements == elements)
+        return;
+    if (context->input_tensor != NULL)
+        onnx_api->ReleaseValue(context->input_tensor);
+
+    int64_t input_shape[] = {rows, 1, elements};
+    size_t input_shape_len = sizeof(input_shape) / sizeof(input_shape[0]);
+    ORT_ABORT_ON_ERROR(onnx_api->CreateTensorWithDataAsOrtValue(
+        context->memory_info, context->input, rows * elements * ELEMENT_SIZE,
+        input_shape, input_shape_len, ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT,
+        &context->input_tensor));
+    ORT_ABORT_ON_ERROR(onnx_api->BindInput(context->binding, input_name,
+                                           context->input_tensor));
+    context->input_rows = rows;
+    context->input_elements = elements;
+}
+
+// Every queued write may be predicted from several windows
+static int max_batch_rows() {
+    return MAX(opt_inference_batch, 1) * MAX(opt_inference_windows, 1);
+}
+
+static void init_context(Model *m) {
+    Inference_Context *context = &m->context;
+    context->batch_capacity = 1;
+    if (max_batch_rows() > 1) {
+        if (m->native != NULL || model_supports_batches(m->session))
+            context->batch_capacity = max_batch_rows();
+        else
+            g_warning("The model has a fixed batch size, export it with a "
+                      "dynamic batch axis to batch predictions");
+    }
+
+    if (posix_memalign((void **)&context->input, 64,
+                       context->batch_capacity * m->total_size) != 0) {
+        g_printerr("Can't allocate the model input buffer\n");
+        abort();
+    }
+    if (m->native != NULL) {
+        context->classes = mlp_outputs(m->native);
+    } else {
+        ORT_ABORT_ON_ERROR(onnx_api->CreateCpuMemoryInfo(
+            OrtArenaAllocator, OrtMemTypeDefault, &context->memory_info));
+        ORT_ABORT_ON_ERROR(
+            onnx_api->CreateIoBinding(m->session, &context->binding));
+        read_output_shape(m);
+    }
+    context->output =
+        g_new0(float, context->batch_capacity * context->classes);
+    context->probabilities =
+        g_new0(float, context->batch_capacity * context->classes);
+    context->window_capacity = max_batch_rows();
+    context->window_data = g_new(const void *, context->window_capacity);
+    context->window_elements = g_new(size_t, context->window_capacity);
+    context->window_types = g_new(Input_Type, context->window_capacity);
+    context->window_owner = g_new(int, context->window_capacity);
+    context->buffer_capacity = MAX(opt_inference_batch, 1);
+    context->sums = g_new(float, context->buffer_capacity * context->classes);
+    context->votes = g_new(float, context->buffer_capacity * context->classes);
+    context->scores = g_new(float, context->classes);
+    if (m->native == NULL) {
+        bind_input(context, 1, m->total_elements);
+        bind_output(context, 1);
+    }
+}
+
+static void cleanup_context(Model *m) {
+    Inference_Context *context = &m->context;
+    if (m->native == NULL) {
+        onnx_api->ReleaseIoBinding(context->binding);
+        onnx_api->ReleaseValue(context->input_tensor);
+        onnx_api->ReleaseValue(context->output_tensor);
+        onnx_api->ReleaseMemoryInfo(context->memory_info);
+    }
+    free(context->input);
+    g_free(context->output);
+    g_free(context->output_shape);
+    g_free(context->probabilities);
+    g_free(context->window_data);
+    g_free(context->window_elements);
+    g_free(context->window_types);
+    g_free(context->window_owner);
+    g_free(context->sums);
+    g_free(context->votes);
+    g_free(context->scores);
+}
+
+// Only calls with more buffers or windows than ever before allocate
+static void reserve_windows(Inference_Context *context, int buffers,
+                            int windows) {
+    if (windows > context->window_capacity) {
+        context->window_capacity = windows;
+        context->window_data =
+            g_renew(const void *, context->window_data, windows);
+        context->window_elements =
+            g_renew(size_t, context->window_elements, windows);
+        context->window_types =
+            g_renew(Input_Type, context->window_types, windows);
+        context->window_owner = g_renew(int, context->window_owner, windows);
+    }
+    if (buffers > context->buffer_capacity) {
+        context->buffer_capacity = buffers;
+        context->sums =
+            g_renew(float, context->sums, buffers * context->classes);
+        context->votes =
+            g_renew(float, context->votes, buffers * context->classes);
+    }
+}
+
+static const char *ort_execution_names[] = {[ORT_SEQUENTIAL] = "sequential",
+                                            [ORT_PARALLEL] = "parallel"};
+
+static const struct {
+    const char *name;
+    GraphOptimizationLevel level;
+} ort_optimization_levels[] = {
+    {"disable", ORT_DISABLE_ALL},
+    {"basic", ORT_ENABLE_BASIC},
+    {"extended", ORT_ENABLE_EXTENDED},
+    {"all", ORT_ENABLE_ALL},
+};
+
+Inference_Vote name_to_inference_vote(const char *name) {
+    for (int i = 0; i < _INFERENCE_VOTE_COUNT; i++) {
+        if (strcmp(name, inference_vote_names[i]) == 0)
+            return i;
+    }
+    return _INFERENCE_VOTE_COUNT;
+}
+
+Inference_Backend name_to_inference_backend(const char *name) {
+    for (int i = 0; i < _INFERENCE_BACKEND_COUNT; i++) {
+        if (strcmp(name, inference_backend_names[i]) == 0)
+            return i;
+    }
+    return _INFERENCE_BACKEND_COUNT;
+}
+
+int name_to_ort_execution(const char *name) {
+    for (int i = 0; i < G_N_ELEMENTS(ort_execution_names); i++) {
+        if (strcmp(name, ort_execution_names[i]) == 0)
+            return i;
+    }
+    return -1;
+}
+
+int name_to_ort_optimization(const char *name) {
+    for (int i = 0; i < G_N_ELEMENTS(ort_optimization_levels); i++) {
+        if (strcmp(name, ort_optimization_levels[i].name) == 0)
+            return ort_optimization_levels[i].level;
+    }
+    return -1;
+}
+
+/*
+ * Without a thread count, ranks split the cores of their node. If the launcher
+ * already bound the rank to fewer cores, those are used.
+ */
+static int intra_op_threads(MPI_Comm node) {
+    if (opt_ort_intra_threads > 0)
+        return opt_ort_intra_threads;
+    int ranks;
+    PMPI_Comm_size(node, &ranks);
+    int available = g_get_num_processors();
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    if (available >= online)
+        available = online / ranks;
+    return MAX(1, available);
+}
+
+static void create_env(int intra_threads) {
+    if (!opt_ort_global_threads) {
+        ORT_ABORT_ON_ERROR(
+            onnx_api->CreateEnv(ORT_LOGGING_LEVEL_WARNING, "test", &onnx_env));
+        return;
+    }
+
+    OrtThreadingOptions *threading;
+    ORT_ABORT_ON_ERROR(onnx_api->CreateThreadingOptions(&threading));
+    ORT_ABORT_ON_ERROR(
+        onnx_api->SetGlobalIntraOpNumThreads(threading, intra_threads));
+    if (opt_ort_inter_threads > 0)
+        ORT_ABORT_ON_ERROR(onnx_api->SetGlobalInterOpNumThreads(
+            threading, opt_ort_inter_threads));
+    // Idle threads would busy-wait on cores the other ranks of the node need
+    ORT_ABORT_ON_ERROR(onnx_api->SetGlobalSpinControl(threading, 0));
+    ORT_ABORT_ON_ERROR(onnx_api->CreateEnvWithGlobalThreadPools(
+        ORT_LOGGING_LEVEL_WARNING, "test", threading, &onnx_env));
+    onnx_api->ReleaseThreadingOptions(threading);
+}
+
+static void configure_threads(OrtSessionOptions *options) {
+    if (opt_ort_global_threads) {
+        ORT_ABORT_ON_ERROR(onnx_api->DisablePerSessionThreads(options));
+    } else {
+        ORT_ABORT_ON_ERROR(
+            onnx_api->SetIntraOpNumThreads(options, session_threads));
+        if (opt_ort_inter_threads > 0)
+            ORT_ABORT_ON_ERROR(
+                onnx_api->SetInterOpNumThreads(options, opt_ort_inter_threads));
+    }
+    ORT_ABORT_ON_ERROR(onnx_api->SetSessionExecutionMode(
+        options, name_to_ort_execution(opt_ort_execution)));
+    ORT_ABORT_ON_ERROR(onnx_api->SetSessionGraphOptimizationLevel(
+        options, name_to_ort_optimization(opt_ort_optimization)));
+}
+
+/*
+ * Collective. Without the optimized model, rank 0 saves it to a temporary
+ * file and renames that into place, the other ranks wait for it, so none
+ * loads a partial file. All ranks then load it as it is.
+ */
+static void save_optimized_model(const char *model_path, int rank) {
+    int exists = 0;
+    if (rank == 0)
+        exists = g_file_test(opt_ort_optimized_model, G_FILE_TEST_IS_REGULAR);
+    PMPI_Bcast(&exists, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (!exists && rank == 0) {
+        gchar *temporary = g_strdup_printf("%s.%d.tmp",
+                                           opt_ort_optimized_model, getpid());
+        OrtSessionOptions *options;
+        OrtSession *session;
+        ORT_ABORT_ON_ERROR(onnx_api->CreateSessionOptions(&options));
+        configure_threads(options);
+        ORT_ABORT_ON_ERROR(
+            onnx_api->SetOptimizedModelFilePath(options, temporary));
+        ORT_ABORT_ON_ERROR(
+            onnx_api->CreateSession(onnx_env, model_path, options, &session));
+        onnx_api->ReleaseSession(session);
+        onnx_api->ReleaseSessionOptions(options);
+        if (g_rename(temporary, opt_ort_optimized_model) != 0) {
+            g_printerr("Can't save the optimized model: %s\n",
+                       opt_ort_optimized_model);
+            PMPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        }
+        g_free(temporary);
+    }
+    PMPI_Barrier(MPI_COMM_WORLD);
+}
+
+// Returns the model file to create the session from
+static const char *configure_session(const char *model_path) {
+    int rank;
+    PMPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    configure_threads(onnx_session_options);
+
+    // The first run saves the optimized model, later runs only load it
+    if (opt_ort_optimized_model != NULL) {
+        save_optimized_model(model_path, rank);
+        ORT_ABORT_ON_ERROR(onnx_api->SetSessionGraphOptimizationLevel(
+            onnx_session_options, ORT_DISABLE_ALL));
+        model_path = opt_ort_optimized_model;
+    }
+
+    if (opt_ort_profile != NULL) {
+        gchar *prefix = g_strdup_printf("%s-%d", opt_ort_profile, rank);
+        ORT_ABORT_ON_ERROR(
+            onnx_api->EnableProfiling(onnx_session_options, prefix));
+        g_free(prefix);
+    }
+    return model_path;
+}
+
+/*
+ * The first rank of the node reads the model into a shared window, the others
+ * create their sessions from it without touching the file system. The window
+ * is freed once every rank of the node created its session.
+ */
+static OrtSession *create_shared_session(const char *model_path,
+                                         MPI_Comm node) {
+    int node_rank;
+    PMPI_Comm_rank(node, &node_rank);
+
+    MPI_Aint size = 0;
+    GStatBuf model_stat;
+    if (node_rank == 0) {
+        if (g_stat(model_path, &model_stat) != 0) {
+            g_printerr("Can't open model file: %s\n", model_path);
+            PMPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        }
+        size = model_stat.st_size;
+    }
+    PMPI_Bcast(&size, 1, MPI_AINT, 0, node);
+
+    void *model;
+    MPI_Win window;
+    PMPI_Win_allocate_shared(node_rank == 0 ? size : 0, 1, MPI_INFO_NULL, node,
+                             &model, &window);
+    if (node_rank == 0) {
+        FILE *file = fopen(model_path, "rb");
+        if (file == NULL || fread(model, 1, size, file) != size) {
+            g_printerr("Can't read model file: %s\n", model_path);
+            PMPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        }
+        fclose(file);
+    } else {
+        MPI_Aint shared_size;
+        int disp_unit;
+        PMPI_Win_shared_query(window, 0, &shared_size, &disp_unit, &model);
+    }
+    PMPI_Win_fence(0, window);
+
+    OrtSession *session;
+    ORT_ABORT_ON_ERROR(onnx_api->CreateSessionFromArray(
+        onnx_env, model, size, onnx_session_options, &session));
+    PMPI_Win_free(&window);
+    return session;
+}
+
+// For the native backend, --model-path names the .weights file of the MLP
+static MLP *load_native(const char *model_path, int inputs) {
+    MLP *native = mlp_load(model_path, opt_native_int8, max_batch_rows());
+    if (native == NULL) {
+        g_printerr("Can't load MLP weights: %s\n", model_path);
+        return NULL;
+    }
+    if (mlp_inputs(native) != inputs) {
+        g_printerr("MLP weights expect %d inputs, the settings %d\n",
+                   mlp_inputs(native), inputs);
+        mlp_free(native);
+        return NULL;
+    }
+    return native;
+}
+
+static OrtSession *init_onnx(const char *model_path) {
     onnx_api = OrtGetApiBase()->GetApi(ORT_API_VERSION);
     if (!onnx_api) {
         g_printerr("Failed to init ONNX Runtime engine.\n");
@@ -107,98 +587,428 @@ void init_ml(char *model_path, char *settings_path) {
                 OrtGetApiBase()->GetVersionString());
     }
 
-    ORT_ABORT_ON_ERROR(
-        onnx_api->CreateEnv(ORT_LOGGING_LEVEL_WARNING, "test", &onnx_env));
+    // Ranks of this node
+    MPI_Comm node;
+    PMPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0,
+                         MPI_INFO_NULL, &node);
+    session_threads = intra_op_threads(node);
+    g_debug("ONNX Runtime intra-op threads: %d", session_threads);
+    add_counter("Inference: intra-op threads", session_threads);
+
+    create_env(session_threads);
     ORT_ABORT_ON_ERROR(onnx_api->CreateSessionOptions(&onnx_session_options));
-    ORT_ABORT_ON_ERROR(onnx_api->CreateSession(
-        onnx_env, model_path, onnx_session_options, &onnx_session));
+    model_path = configure_session(model_path);
+    OrtSession *session;
+    if (opt_ort_shared_model)
+        session = create_shared_session(model_path, node);
+    else
+        ORT_ABORT_ON_ERROR(onnx_api->CreateSession(
+            onnx_env, model_path, onnx_session_options, &session));
+    PMPI_Comm_free(&node);
+    return session;
+}
 
-    labels = parse_labels(settings_path);
-    opt_metric_inferencing = parse_metric(settings_path);
-    input_size = model_input_size(settings_path);
+/*
+ * Sessions of reloaded models are created by every rank from the file, without
+ * the optimized model and profiling of the first one. Errors keep the previous
+ * model.
+ */
+static OrtSession *reload_session(const char *model_path) {
+    OrtSessionOptions *options;
+    OrtSession *session = NULL;
+    ORT_ABORT_ON_ERROR(onnx_api->CreateSessionOptions(&options));
+    configure_threads(options);
+    OrtStatus *status =
+        onnx_api->CreateSession(onnx_env, model_path, options, &session);
+    if (status != NULL) {
+        g_printerr("Can't load model %s: %s\n", model_path,
+                   onnx_api->GetErrorMessage(status));
+        onnx_api->ReleaseStatus(status);
+        session = NULL;
+    }
+    onnx_api->ReleaseSessionOptions(options);
+    return session;
+}
 
-    total_elements = 1 * input_size;
-    total_size = total_elements * ELEMENT_SIZE;
+static void free_model(Model *m) {
+    cleanup_context(m);
+    if (m->native != NULL)
+        mlp_free(m->native);
+    if (m->session != NULL && m->profiled) {
+        OrtAllocator *allocator;
+        char *profile;
+        ORT_ABORT_ON_ERROR(
+            onnx_api->GetAllocatorWithDefaultOptions(&allocator));
+        ORT_ABORT_ON_ERROR(
+            onnx_api->SessionEndProfiling(m->session, allocator, &profile));
+        g_debug("ONNX Runtime profile: %s", profile);
+        ORT_ABORT_ON_ERROR(onnx_api->AllocatorFree(allocator, profile));
+    }
+    if (m->session != NULL)
+        onnx_api->ReleaseSession(m->session);
+    g_free((void *)m->labels);
+    g_free(m);
 }
 
-void cleanup_ml() {
-    onnx_api->ReleaseSessionOptions(onnx_session_options);
-    onnx_api->ReleaseSession(onnx_session);
-    onnx_api->ReleaseEnv(onnx_env);
-    free((void *)labels);
+// Returns NULL if the model can't be loaded
+static Model *load_model(const char *model_path, const char *settings_path,
+                         gboolean reload) {
+    Model *m = g_new0(Model, 1);
+    int label_count = 0;
+    m->labels = parse_labels(settings_path, &label_count);
+    m->metric = parse_metric(settings_path);
+    m->total_elements = model_input_size(settings_path);
+    m->total_size = m->total_elements * ELEMENT_SIZE;
+    if (m->labels == NULL || m->metric == _METRIC_COUNT ||
+        m->total_elements == 0) {
+        g_free((void *)m->labels);
+        g_free(m);
+        return NULL;
+    }
+    if (name_to_inference_backend(opt_inference_backend) ==
+        INFERENCE_BACKEND_NATIVE) {
+        m->native = load_native(model_path, m->total_elements);
+    } else if (reload) {
+        m->session = reload_session(model_path);
+    } else {
+        m->session = init_onnx(model_path);
+        m->profiled = opt_ort_profile != NULL;
+    }
+    if (m->native == NULL && m->session == NULL) {
+        g_free((void *)m->labels);
+        g_free(m);
+        return NULL;
+    }
+    init_context(m);
+    // Predictions index the labels by class
+    if (m->context.classes != label_count) {
+        g_printerr("%s predicts %zu classes, %s has %d labels\n", model_path,
+                   m->context.classes, settings_path, label_count);
+        free_model(m);
+        return NULL;
+    }
+    return m;
 }
 
-CompressionAlgorithm_Level predict_compressor(const void *data, size_t length) {
-    size_t model_input_ele_count;
-    // g_debug("Length: %ld", length);
-    if (length > total_size)
-        length = total_size;
+/*
+ * With opt_model_reload the watcher thread looks at the model and settings
+ * files every that many seconds. Once changed files kept their size and
+ * modification time for one period, they are loaded into pending. The
+ * application thread takes it before its next prediction, only if the lock
+ * is free, and leaves the replaced model in retired for the watcher to free.
+ */
+typedef struct {
+    guint64 inode;
+    gint64 mtime;
+    gint64 size;
+} File_Version;
 
-    model_input_ele_count = length / ELEMENT_SIZE;
-    // g_debug("model_input_ele_count: %ld\n", model_input_ele_count);
+static GThread *watcher = NULL;
+static GMutex reload_lock;
+static GCond reload_cond;
+static gboolean watching = FALSE;
+static Model *pending = NULL;
+static Model *retired = NULL;
+static gchar *watched_paths[2];
 
-    float *parsed = g_malloc(length);
-    memcpy(parsed, data, length);
-#pragma omp parallel for
-    for (int i = 0; i < model_input_ele_count; i++) {
-        if (isnan(parsed[i]))
-            parsed[i] = 0.0;
+static gboolean read_versions(File_Version *versions) {
+    for (int i = 0; i < G_N_ELEMENTS(watched_paths); ++i) {
+        GStatBuf file_stat;
+        if (g_stat(watched_paths[i], &file_stat) != 0)
+            return FALSE;
+        versions[i].inode = file_stat.st_ino;
+        versions[i].mtime =
+            file_stat.st_mtim.tv_sec * G_GINT64_CONSTANT(1000000000) +
+            file_stat.st_mtim.tv_nsec;
+        versions[i].size = file_stat.st_size;
     }
+    return TRUE;
+}
 
-    OrtMemoryInfo *memory_info;
-    ORT_ABORT_ON_ERROR(onnx_api->CreateCpuMemoryInfo(
-        OrtArenaAllocator, OrtMemTypeDefault, &memory_info));
-    int64_t input_shape[] = {1, 1, model_input_ele_count};
-    size_t input_shape_len = sizeof(input_shape) / sizeof(input_shape[0]);
+static gboolean same_versions(const File_Version *a, const File_Version *b) {
+    return memcmp(a, b, sizeof(File_Version) * G_N_ELEMENTS(watched_paths)) ==
+           0;
+}
 
-    OrtValue *input_tensor = NULL;
-    ORT_ABORT_ON_ERROR(onnx_api->CreateTensorWithDataAsOrtValue(
-        memory_info, parsed, length, input_shape, input_shape_len,
-        ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT, &input_tensor));
-
-    assert(input_tensor != NULL);
-    int is_tensor;
-    ORT_ABORT_ON_ERROR(onnx_api->IsTensor(input_tensor, &is_tensor));
-    assert(is_tensor);
-
-    onnx_api->ReleaseMemoryInfo(memory_info);
-    const char *input_names[] = {"input_1"};
-    const char *output_names[] = {"output_1"};
-    OrtValue *output_tensor = NULL;
-    ORT_ABORT_ON_ERROR(onnx_api->Run(onnx_session, NULL, input_names,
-                                     (const OrtValue *const *)&input_tensor, 1,
-                                     output_names, 1, &output_tensor));
-    assert(output_tensor != NULL);
-    ORT_ABORT_ON_ERROR(onnx_api->IsTensor(output_tensor, &is_tensor));
-    assert(is_tensor);
-
-    // Get result
-    struct OrtTensorTypeAndShapeInfo *shape_info;
-    ORT_ABORT_ON_ERROR(
-        onnx_api->GetTensorTypeAndShape(output_tensor, &shape_info));
-    size_t class_dim_count;
-    ORT_ABORT_ON_ERROR(
-        onnx_api->GetTensorShapeElementCount(shape_info, &class_dim_count));
+static void reload_model() {
+    Model *next = load_model(watched_paths[0], watched_paths[1], TRUE);
+    if (next == NULL) {
+        g_warning("Keeping the previous model, %s can't be loaded",
+                  watched_paths[0]);
+        return;
+    }
+    g_mutex_lock(&reload_lock);
+    // Replaced before the application thread took it
+    Model *skipped = pending;
+    g_atomic_pointer_set(&pending, next);
+    g_mutex_unlock(&reload_lock);
+    if (skipped != NULL)
+        free_model(skipped);
+}
 
-    // ['GZIP', 'LZ4', 'ZSTD']
-    float *f;
-    ORT_ABORT_ON_ERROR(
-        onnx_api->GetTensorMutableData(output_tensor, (void **)&f));
+static gpointer watch_model(gpointer data) {
+    File_Version loaded[2] = {0}, seen[2], current[2];
+    read_versions(loaded);
+    memcpy(seen, loaded, sizeof(seen));
+
+    g_mutex_lock(&reload_lock);
+    while (watching) {
+        gint64 end =
+            g_get_monotonic_time() + opt_model_reload * G_TIME_SPAN_SECOND;
+        while (watching && g_cond_wait_until(&reload_cond, &reload_lock, end))
+            ;
+        if (!watching)
+            break;
+        Model *replaced = retired;
+        retired = NULL;
+        g_mutex_unlock(&reload_lock);
 
-    float class_probabilities[class_dim_count];
-    softmax(f, class_dim_count, class_probabilities);
-    /*
-    g_debug("Softmax Probabilities");
-    for (int i = 0; i < class_dim_count; ++i) {
-        g_debug("[%d]: %.6f (%.6f)\n", i, class_probabilities[i], f[i]);
+        if (replaced != NULL)
+            free_model(replaced);
+        // Files that are still being copied change between two looks
+        if (read_versions(current)) {
+            if (!same_versions(current, loaded) &&
+                same_versions(current, seen)) {
+                reload_model();
+                memcpy(loaded, current, sizeof(loaded));
+            }
+            memcpy(seen, current, sizeof(seen));
+        }
+        g_mutex_lock(&reload_lock);
     }
-    */
-    int winning_index = max_value_index(class_probabilities, class_dim_count);
-    // g_debug("Winner Index: %d", winning_index);
+    g_mutex_unlock(&reload_lock);
+    return NULL;
+}
 
-    onnx_api->ReleaseValue(output_tensor);
-    onnx_api->ReleaseValue(input_tensor);
-    g_free(parsed);
+/*
+ * Never waits for the watcher, a model it is still loading is taken next time.
+ * Cached evaluations and decisions were made by the previous model, possibly
+ * for another metric, and are dropped with it.
+ */
+void take_reloaded_model() {
+    if (g_atomic_pointer_get(&pending) == NULL ||
+        !g_mutex_trylock(&reload_lock))
+        return;
+    if (pending != NULL && retired == NULL) {
+        retired = model;
+        model = pending;
+        g_atomic_pointer_set(&pending, NULL);
+        opt_metric_inferencing = model->metric;
+        result_cache_drop(CACHE_INFERENCE);
+        decision_cache_clear();
+        add_counter("Inference: model reloads", 1);
+    }
+    g_mutex_unlock(&reload_lock);
+}
+
+void init_ml(const char *model_path, const char *settings_path) {
+    vote_type = name_to_inference_vote(opt_inference_vote);
+    model = load_model(model_path, settings_path, FALSE);
+    if (model == NULL)
+        exit(1);
+    opt_metric_inferencing = model->metric;
+    if (model->native != NULL)
+        g_debug("Native inference with %s kernels%s", mlp_kernel_name(),
+                opt_native_int8 ? ", int8 weights" : "");
+
+    if (opt_model_reload > 0) {
+        watched_paths[0] = g_strdup(model_path);
+        watched_paths[1] = g_strdup(settings_path);
+        watching = TRUE;
+        watcher = g_thread_new("model-reload", watch_model, NULL);
+    }
+}
+
+void cleanup_ml() {
+    if (model == NULL)
+        return;
+    if (watcher != NULL) {
+        g_mutex_lock(&reload_lock);
+        watching = FALSE;
+        g_cond_signal(&reload_cond);
+        g_mutex_unlock(&reload_lock);
+        g_thread_join(watcher);
+        watcher = NULL;
+        for (int i = 0; i < G_N_ELEMENTS(watched_paths); ++i)
+            g_free(watched_paths[i]);
+        if (pending != NULL)
+            free_model(pending);
+        if (retired != NULL)
+            free_model(retired);
+        pending = NULL;
+        retired = NULL;
+    }
+    free_model(model);
+    model = NULL;
+    if (onnx_env != NULL) {
+        onnx_api->ReleaseSessionOptions(onnx_session_options);
+        onnx_api->ReleaseEnv(onnx_env);
+        onnx_session_options = NULL;
+        onnx_env = NULL;
+    }
+}
+
+/*
+ * A single buffer is passed to ONNX Runtime with its own length, the model pads
+ * it. Rows of a batch, and all rows of the native backend, are padded here.
+ * Leaves the class probabilities of each row in context.probabilities.
+ */
+static void run_batch(const void **data, const size_t *elements,
+                      const Input_Type *types, int rows) {
+    Inference_Context *context = &model->context;
+    size_t total_elements = model->total_elements;
+    if (rows == 1 && model->native == NULL) {
+        size_t row_elements = MIN(elements[0], total_elements);
+        convert_input(types[0], data[0], row_elements, context->input);
+        bind_input(context, 1, row_elements);
+    } else {
+        for (int r = 0; r < rows; ++r) {
+            size_t row_elements = MIN(elements[r], total_elements);
+            float *row = context->input + r * total_elements;
+            convert_input(types[r], data[r], row_elements, row);
+            memset(row + row_elements, 0,
+                   (total_elements - row_elements) * ELEMENT_SIZE);
+        }
+        if (model->native == NULL)
+            bind_input(context, rows, total_elements);
+    }
+    if (model->native != NULL) {
+        mlp_forward(model->native, context->input, rows, context->output);
+    } else {
+        bind_output(context, rows);
+        ORT_ABORT_ON_ERROR(
+            onnx_api->RunWithBinding(model->session, NULL, context->binding));
+    }
+
+    for (int r = 0; r < rows; ++r)
+        softmax(context->output + r * context->classes, context->classes,
+                context->probabilities + r * context->classes);
+}
+
+/*
+ * Buffers with more elements than the model input are predicted from up to
+ * opt_inference_windows windows spread evenly from their start to their end,
+ * so that e.g. a zero halo at the head does not decide alone.
+ */
+static int window_count(size_t elements) {
+    size_t total_elements = model->total_elements;
+    if (elements <= total_elements)
+        return 1;
+    size_t windows = (elements + total_elements - 1) / total_elements;
+    return MIN(MAX(opt_inference_windows, 1), windows);
+}
+
+// First element of the window
+static size_t window_offset(size_t elements, int window, int windows) {
+    if (windows == 1)
+        return 0;
+    return (elements - model->total_elements) / (windows - 1) * window;
+}
+
+// Adds the probabilities of one window to the sums and votes of its buffer
+static void vote(const float *probabilities, float *sums, float *votes) {
+    size_t classes = model->context.classes;
+    votes[max_value_index((float *)probabilities, classes)] += 1;
+    for (size_t c = 0; c < classes; ++c)
+        sums[c] += probabilities[c];
+}
+
+// Ranks the classes by their votes or mean probability
+static Prediction rank(const float *sums, const float *votes, int windows) {
+    Prediction prediction;
+    size_t classes = model->context.classes;
+    float *scores = model->context.scores;
+    for (size_t c = 0; c < classes; ++c) {
+        scores[c] = sums[c];
+        // The mean probability only breaks ties
+        if (vote_type == INFERENCE_VOTE_MAJORITY)
+            scores[c] += votes[c] * (windows + 1);
+    }
+    prediction.candidate_count = MIN(classes, MAX_CANDIDATES);
+    for (int k = 0; k < prediction.candidate_count; ++k) {
+        size_t best = 0;
+        for (size_t c = 1; c < classes; ++c) {
+            if (scores[c] > scores[best])
+                best = c;
+        }
+        if (k == 0)
+            prediction.confidence = sums[best] / windows;
+        prediction.candidates[k] = model->labels[best];
+        scores[best] = -G_MAXFLOAT;
+    }
+    prediction.compressor = prediction.candidates[0];
+    return prediction;
+}
+
+void predict_compressors(const void **data, const size_t *lengths,
+                         const Input_Type *types, int count,
+                         Prediction *predictions) {
+    long long s = timeInNanoseconds();
+    take_reloaded_model();
+    Inference_Context *context = &model->context;
+    int total_windows = 0;
+    for (int i = 0; i < count; ++i)
+        total_windows += window_count(lengths[i] / input_type_size(types[i]));
+
+    // Windows of all buffers, batched regardless of the buffer they belong to
+    reserve_windows(context, count, total_windows);
+    const void **window_data = context->window_data;
+    size_t *window_elements = context->window_elements;
+    Input_Type *window_types = context->window_types;
+    int *owner = context->window_owner;
+    int w = 0;
+    for (int i = 0; i < count; ++i) {
+        size_t type_size = input_type_size(types[i]);
+        size_t elements = lengths[i] / type_size;
+        int windows = window_count(elements);
+        for (int j = 0; j < windows; ++j, ++w) {
+            size_t offset = window_offset(elements, j, windows);
+            window_data[w] = (const char *)data[i] + offset * type_size;
+            window_elements[w] = elements - offset;
+            window_types[w] = types[i];
+            owner[w] = i;
+        }
+    }
+
+    float *sums = context->sums;
+    float *votes = context->votes;
+    memset(sums, 0, count * context->classes * sizeof(float));
+    memset(votes, 0, count * context->classes * sizeof(float));
+    for (int start = 0; start < total_windows;
+         start += context->batch_capacity) {
+        int rows = MIN(context->batch_capacity, total_windows - start);
+        run_batch(window_data + start, window_elements + start,
+                  window_types + start, rows);
+        for (int r = 0; r < rows; ++r) {
+            size_t buffer = owner[start + r] * context->classes;
+            vote(context->probabilities + r * context->classes, sums + buffer,
+                 votes + buffer);
+        }
+        ++batches;
+    }
+    for (int i = 0; i < count; ++i)
+        predictions[i] = rank(sums + i * context->classes,
+                              votes + i * context->classes,
+                              window_count(lengths[i] /
+                                           input_type_size(types[i])));
+
+    predictions_made += count;
+    predicted_windows += total_windows;
+    prediction_time += timeInNanoseconds() - s;
+}
+
+void inference_report() {
+    if (predictions_made == 0)
+        return;
+    add_counter("Inference: predictions", predictions_made);
+    add_counter("Inference: windows", predicted_windows);
+    add_counter("Inference: batches", batches);
+    add_counter("Inference: prediction time [ns]", prediction_time);
+}
 
-    return labels[winning_index];
+Prediction predict_compressor(const void *data, size_t length,
+                              Input_Type type) {
+    Prediction prediction;
+    predict_compressors(&data, &length, &type, 1, &prediction);
+    return prediction;
 }
@@ -0,0 +1,176 @@
+#include <ctype.h>
+#include <inferencing/decision.h>
+#include <math.h>
+#include <string.h>
+#include <tracing.h>
+
+typedef struct {
+    Decision_Key key;
+    Prediction prediction;
+    // Of the buffer the prediction was made for
+    Byte_Statistics statistics;
+    int reuses;
+    // Link of the decision in the LRU queue
+    GList link;
+} Decision;
+
+static int reuse_limit = 0;
+static double drift_limit = 0;
+static GHashTable *decisions = NULL;
+// Most recently used first, the oldest is evicted at DECISION_CAPACITY
+static GQueue lru = G_QUEUE_INIT;
+// Normalized filename of every opened IO_Object
+static GHashTable *files = NULL;
+static long reuses, drifts, expirations, evictions;
+
+static guint key_hash(gconstpointer key) {
+    const Decision_Key *k = key;
+    guint64 h = (guint64)k->offset * 0x9E3779B97F4A7C15ULL ^ k->size;
+    return g_direct_hash(k->file) ^ (guint)(h ^ (h >> 32));
+}
+
+static gboolean key_equal(gconstpointer a, gconstpointer b) {
+    const Decision_Key *k_a = a;
+    const Decision_Key *k_b = b;
+    return k_a->file == k_b->file && k_a->offset == k_b->offset &&
+           k_a->size == k_b->size && k_a->datatype == k_b->datatype;
+}
+
+/*
+ * A decision is reused max_reuse times before the model predicts the region
+ * again, or earlier if the byte statistics drifted by more than max_drift.
+ */
+void decision_cache_init(int max_reuse, double max_drift) {
+    reuse_limit = max_reuse;
+    drift_limit = max_drift;
+    if (decision_cache_enabled()) {
+        decisions = g_hash_table_new_full(key_hash, key_equal, NULL, g_free);
+        files = g_hash_table_new(g_direct_hash, g_direct_equal);
+    }
+}
+
+gboolean decision_cache_enabled() { return reuse_limit > 0; }
+
+/*
+ * Output steps and ranks are numbers at the end of the parts of a file name,
+ * e.g. plt00010 or out_0010_3.h5, which are not compared. Directories,
+ * extensions and digits within a part, e.g. of var3d, are.
+ */
+static const gchar *normalize_filename(const char *filename) {
+    gchar *normalized = g_strdup(filename);
+    gchar *name = strrchr(normalized, '/');
+    name = name != NULL ? name + 1 : normalized;
+    gchar *end = strrchr(name, '.');
+    gboolean extension = FALSE;
+    for (gchar *c = end; c != NULL && *c != '\0'; ++c)
+        extension = extension || isalpha((unsigned char)*c);
+    if (!extension)
+        end = name + strlen(name);
+
+    for (gchar *c = name; c < end;) {
+        gchar *digits = c;
+        while (c < end && isdigit((unsigned char)*c))
+            ++c;
+        if (c > digits && (c == end || !isalnum((unsigned char)*c)))
+            memset(digits, '#', c - digits);
+        if (c == digits)
+            ++c;
+    }
+    const gchar *interned = g_intern_string(normalized);
+    g_free(normalized);
+    return interned;
+}
+
+Decision_Key decision_cache_key(MPI_File fh, MPI_Offset offset, size_t size,
+                                MPI_Datatype datatype) {
+    Decision_Key key = {"", offset, size, datatype};
+    IO_Object *object = g_hash_table_lookup(trackingDB_fh, fh);
+    if (object == NULL)
+        return key;
+    key.file = g_hash_table_lookup(files, object);
+    if (key.file == NULL) {
+        key.file = normalize_filename(object->filename);
+        g_hash_table_insert(files, object, (gpointer)key.file);
+    }
+    return key;
+}
+
+static gboolean drifted(const Byte_Statistics *a, const Byte_Statistics *b) {
+    return fabs(a->zeros - b->zeros) > drift_limit ||
+           fabs(a->entropy - b->entropy) > drift_limit ||
+           fabs(a->runs - b->runs) > drift_limit ||
+           fabs(a->strided - b->strided) > drift_limit;
+}
+
+// Returns FALSE if the region has to be predicted and stored again
+gboolean decision_cache_reuse(const Decision_Key *key, const void *buf,
+                              Input_Type type, Prediction *prediction) {
+    Decision *decision = g_hash_table_lookup(decisions, key);
+    if (decision == NULL)
+        return FALSE;
+    g_queue_unlink(&lru, &decision->link);
+    g_queue_push_head_link(&lru, &decision->link);
+    if (decision->reuses >= reuse_limit) {
+        ++expirations;
+        return FALSE;
+    }
+    Byte_Statistics statistics;
+    sample_statistics(buf, key->size, input_type_size(type), &statistics);
+    if (drifted(&statistics, &decision->statistics)) {
+        ++drifts;
+        return FALSE;
+    }
+    ++decision->reuses;
+    ++reuses;
+    *prediction = decision->prediction;
+    return TRUE;
+}
+
+void decision_cache_store(const Decision_Key *key, const void *buf,
+                          Input_Type type, const Prediction *prediction) {
+    Decision *decision = g_hash_table_lookup(decisions, key);
+    if (decision == NULL) {
+        if (g_hash_table_size(decisions) >= DECISION_CAPACITY) {
+            GList *oldest = g_queue_pop_tail_link(&lru);
+            g_hash_table_remove(decisions, &((Decision *)oldest->data)->key);
+            ++evictions;
+        }
+        decision = g_new0(Decision, 1);
+        decision->key = *key;
+        decision->link.data = decision;
+        g_queue_push_head_link(&lru, &decision->link);
+        g_hash_table_insert(decisions, &decision->key, decision);
+    }
+    decision->prediction = *prediction;
+    sample_statistics(buf, key->size, input_type_size(type),
+                      &decision->statistics);
+    decision->reuses = 0;
+}
+
+// Forgets all decisions, e.g. of a model that was replaced
+void decision_cache_clear() {
+    if (!decision_cache_enabled())
+        return;
+    g_hash_table_remove_all(decisions);
+    g_queue_init(&lru);
+}
+
+void decision_cache_report() {
+    if (!decision_cache_enabled())
+        return;
+    add_counter("Decision cache: reuses", reuses);
+    add_counter("Decision cache: drifts", drifts);
+    add_counter("Decision cache: expirations", expirations);
+    add_counter("Decision cache: evictions", evictions);
+}
+
+void decision_cache_cleanup() {
+    if (!decision_cache_enabled())
+        return;
+    g_hash_table_destroy(decisions);
+    g_queue_init(&lru);
+    g_hash_table_destroy(files);
+    decisions = NULL;
+    files = NULL;
+    reuse_limit = 0;
+}
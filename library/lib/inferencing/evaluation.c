@@ -0,0 +1,89 @@
+#include <inferencing/evaluation.h>
+#include <tracing.h>
+#include <util.h>
+
+/*
+ * Decides which predictions are compared to the best compressor. Every rate-th
+ * one is. With a budget, predictions are instead admitted at an even rate:
+ * the share of them whose comparisons fit into budget of the runtime at the
+ * mean duration of a comparison so far, at most 1 / rate. Spreading them
+ * keeps writes after an idle phase from using up the budget saved meanwhile.
+ * The others only pay for the prediction.
+ */
+
+static int every = 1;
+static gfloat budget = 0;
+static long start = 0;
+static long evaluation_time = 0;
+static long considered = 0;
+static long admitted = 0;
+// Admissions the rate owes so far, one is taken per admitted prediction
+static double credit = 1;
+// Predictions since the latest admission, including the admitted one
+static long since_admission = 0;
+// 1 / predictions the latest admission stands for
+static gfloat admitted_rate = 1;
+
+void evaluation_init(int rate, gfloat max_share) {
+    every = rate;
+    budget = max_share;
+    start = timeInMicroseconds();
+    credit = 1;
+    since_admission = 0;
+    admitted_rate = 1.0f / every;
+}
+
+static gfloat budget_rate(long elapsed) {
+    gfloat limit = 1.0f / every;
+    // The first comparison tells what one costs
+    if (admitted == 0 || evaluation_time <= 0 || elapsed <= 0)
+        return limit;
+    double allowed = budget * elapsed;
+    double affordable = allowed / ((double)evaluation_time / admitted);
+    // Slows down while comparisons took longer than the budget allows
+    double rate = affordable / considered * MIN(1, allowed / evaluation_time);
+    return MIN(limit, rate);
+}
+
+gboolean evaluation_admit() {
+    if (budget <= 0) {
+        gboolean admit = considered++ % every == 0;
+        if (admit)
+            ++admitted;
+        return admit;
+    }
+
+    ++considered;
+    long elapsed = timeInMicroseconds() - start;
+    gfloat rate = budget_rate(elapsed);
+    gboolean admit = credit >= 1;
+    ++since_admission;
+    if (admit) {
+        credit -= 1;
+        admitted_rate = 1.0f / since_admission;
+        since_admission = 0;
+        ++admitted;
+    }
+    credit += rate;
+    return admit;
+}
+
+void evaluation_account(long duration) { evaluation_time += duration; }
+
+/*
+ * Effective rate of the latest admission: it stands for itself and the
+ * predictions skipped since the one before, 1 / rate in all
+ */
+gfloat evaluation_rate() {
+    if (budget <= 0)
+        return 1.0f / every;
+    return admitted_rate;
+}
+
+void evaluation_report() {
+    if (considered == 0)
+        return;
+    add_counter("Evaluation: evaluated writes", admitted);
+    add_counter("Evaluation: skipped writes", considered - admitted);
+    add_counter("Evaluation: time [µs]", evaluation_time);
+}
@@ -0,0 +1,159 @@
+#include <glib.h>
+#include <inferencing/input.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#define STATISTICS_BLOCKS 16
+#define STATISTICS_BLOCK_SIZE 256
+
+static const size_t input_type_sizes[] = {
+    [INPUT_FLOAT] = sizeof(float),    [INPUT_DOUBLE] = sizeof(double),
+    [INPUT_INT32] = sizeof(int32_t),  [INPUT_INT64] = sizeof(int64_t),
+    [INPUT_UINT8] = sizeof(uint8_t),
+};
+
+static const char *input_type_names[] = {
+    [INPUT_FLOAT] = "float", [INPUT_DOUBLE] = "double",
+    [INPUT_INT32] = "int32", [INPUT_INT64] = "int64",
+    [INPUT_UINT8] = "uint8",
+};
+
+static Input_Type named_input_type(MPI_Datatype datatype) {
+    if (datatype == MPI_DOUBLE)
+        return INPUT_DOUBLE;
+    if (datatype == MPI_INT || datatype == MPI_INT32_T)
+        return INPUT_INT32;
+    if (datatype == MPI_LONG)
+        return sizeof(long) == sizeof(int64_t) ? INPUT_INT64 : INPUT_INT32;
+    if (datatype == MPI_LONG_LONG || datatype == MPI_INT64_T)
+        return INPUT_INT64;
+    if (datatype == MPI_UNSIGNED_CHAR || datatype == MPI_UINT8_T)
+        return INPUT_UINT8;
+    // MPI_FLOAT, and untyped MPI_BYTE buffers are read as floats like before
+    return INPUT_FLOAT;
+}
+
+static int combiner_of(MPI_Datatype datatype) {
+    int num_integers, num_addresses, num_datatypes, combiner;
+    MPI_Type_get_envelope(datatype, &num_integers, &num_addresses,
+                          &num_datatypes, &combiner);
+    return combiner;
+}
+
+/*
+ * Contiguous derived datatypes and duplicates are resolved to the predefined
+ * datatype they are built from, other layouts fall back to floats.
+ */
+Input_Type datatype_to_input_type(MPI_Datatype datatype) {
+    int num_integers, num_addresses, num_datatypes, combiner;
+    MPI_Type_get_envelope(datatype, &num_integers, &num_addresses,
+                          &num_datatypes, &combiner);
+    if (combiner == MPI_COMBINER_NAMED)
+        return named_input_type(datatype);
+    if (combiner != MPI_COMBINER_CONTIGUOUS && combiner != MPI_COMBINER_DUP)
+        return INPUT_FLOAT;
+
+    int integers[MAX(num_integers, 1)];
+    MPI_Aint addresses[MAX(num_addresses, 1)];
+    MPI_Datatype datatypes[MAX(num_datatypes, 1)];
+    MPI_Type_get_contents(datatype, num_integers, num_addresses,
+                          num_datatypes, integers, addresses, datatypes);
+    Input_Type type = datatype_to_input_type(datatypes[0]);
+    // Derived datatypes returned by MPI_Type_get_contents are new handles
+    if (combiner_of(datatypes[0]) != MPI_COMBINER_NAMED)
+        MPI_Type_free(&datatypes[0]);
+    return type;
+}
+
+size_t input_type_size(Input_Type type) { return input_type_sizes[type]; }
+
+const char *input_type_name(Input_Type type) { return input_type_names[type]; }
+
+// Converted values that are no finite float (NaN, Inf, out of range) become 0
+static inline float finite_or_zero(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    // All exponent bits set: infinite or not a number
+    if ((bits & 0x7f800000) == 0x7f800000)
+        bits = 0;
+    memcpy(&value, &bits, sizeof(bits));
+    return value;
+}
+
+/*
+ * Elements are loaded with memcpy, as windows of a buffer are only aligned to
+ * their element size.
+ */
+#define CONVERT(type, data, elements, out)                                     \
+    do {                                                                       \
+        const char *in = (data);                                               \
+        _Pragma("omp simd") for (size_t i = 0; i < (elements); ++i) {          \
+            type value;                                                        \
+            memcpy(&value, in + i * sizeof(type), sizeof(type));               \
+            (out)[i] = finite_or_zero((float)value);                           \
+        }                                                                      \
+    } while (0)
+
+// Writes the elements of the buffer straight into the model input
+void convert_input(Input_Type type, const void *data, size_t elements,
+                   float *out) {
+    switch (type) {
+    case INPUT_DOUBLE:
+        CONVERT(double, data, elements, out);
+        break;
+    case INPUT_INT32:
+        CONVERT(int32_t, data, elements, out);
+        break;
+    case INPUT_INT64:
+        CONVERT(int64_t, data, elements, out);
+        break;
+    case INPUT_UINT8:
+        CONVERT(uint8_t, data, elements, out);
+        break;
+    default:
+        CONVERT(float, data, elements, out);
+        break;
+    }
+}
+
+/*
+ * Reads at most STATISTICS_BLOCKS * STATISTICS_BLOCK_SIZE bytes. Empty buffers
+ * have all statistics 0.
+ */
+void sample_statistics(const void *data, size_t size, size_t element_size,
+                       Byte_Statistics *stats) {
+    const unsigned char *bytes = data;
+    guint histogram[256] = {0};
+    size_t sampled = 0, zeros = 0, runs = 0, strided = 0;
+    size_t block = MIN(STATISTICS_BLOCK_SIZE, size);
+    int blocks = size > block ? STATISTICS_BLOCKS : 1;
+    for (int b = 0; b < blocks; ++b) {
+        size_t start = blocks == 1 ? 0 : (size - block) / (blocks - 1) * b;
+        for (size_t i = start; i < start + block; ++i) {
+            ++histogram[bytes[i]];
+            zeros += bytes[i] == 0;
+            if (i > start)
+                runs += bytes[i] == bytes[i - 1];
+            if (i >= start + element_size)
+                strided += bytes[i] == bytes[i - element_size];
+        }
+        sampled += block;
+    }
+    if (sampled == 0) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+
+    double entropy = 0;
+    for (int v = 0; v < 256; ++v) {
+        if (histogram[v] == 0)
+            continue;
+        double p = (double)histogram[v] / sampled;
+        entropy -= p * log2(p);
+    }
+    stats->zeros = (double)zeros / sampled;
+    stats->entropy = entropy / 8;
+    stats->runs = (double)runs / sampled;
+    stats->strided = (double)strided / sampled;
+}
@@ -0,0 +1,388 @@
+#include <inferencing/mlp.h>
+#include <math.h>
+#include <string.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+/*
+ * Weights file written by export_weights in training.ipynb, little endian:
+ * "IOAMLP01", uint32 layer count, then per layer uint32 inputs, uint32 outputs,
+ * float weights[outputs][inputs] and float bias[outputs].
+ */
+#define MLP_MAGIC "IOAMLP01"
+#define MLP_MAGIC_SIZE 8
+// eps of F.normalize
+#define MLP_NORM_EPS 1e-12f
+
+typedef struct {
+    const char *name;
+    float (*dot)(const float *w, const float *x, int n);
+    float (*dot_q8)(const gint8 *w, const float *x, int n);
+    // Four weight rows against four rows of x, both n elements apart
+    void (*tile)(const float *w, const float *x, int n, float out[4][4]);
+    void (*tile_q8)(const gint8 *w, const float *x, int n, float out[4][4]);
+} MLP_Kernels;
+
+static MLP_Kernels kernels;
+
+static float dot_generic(const float *w, const float *x, int n) {
+    float sum = 0;
+#pragma omp simd reduction(+ : sum)
+    for (int i = 0; i < n; ++i)
+        sum += w[i] * x[i];
+    return sum;
+}
+
+static float dot_q8_generic(const gint8 *w, const float *x, int n) {
+    float sum = 0;
+#pragma omp simd reduction(+ : sum)
+    for (int i = 0; i < n; ++i)
+        sum += w[i] * x[i];
+    return sum;
+}
+
+static void tile_generic(const float *w, const float *x, int n,
+                         float out[4][4]) {
+    for (int r = 0; r < 4; ++r) {
+        for (int o = 0; o < 4; ++o)
+            out[r][o] = dot_generic(w + o * n, x + r * n, n);
+    }
+}
+
+static void tile_q8_generic(const gint8 *w, const float *x, int n,
+                            float out[4][4]) {
+    for (int r = 0; r < 4; ++r) {
+        for (int o = 0; o < 4; ++o)
+            out[r][o] = dot_q8_generic(w + o * n, x + r * n, n);
+    }
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2,fma"))) static float hsum_avx2(__m256 v) {
+    __m128 sum =
+        _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    sum = _mm_hadd_ps(sum, sum);
+    sum = _mm_hadd_ps(sum, sum);
+    return _mm_cvtss_f32(sum);
+}
+
+__attribute__((target("avx2,fma"))) static float
+dot_avx2(const float *w, const float *x, int n) {
+    __m256 acc[4] = {_mm256_setzero_ps(), _mm256_setzero_ps(),
+                     _mm256_setzero_ps(), _mm256_setzero_ps()};
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        for (int k = 0; k < 4; ++k)
+            acc[k] = _mm256_fmadd_ps(_mm256_loadu_ps(w + i + 8 * k),
+                                     _mm256_loadu_ps(x + i + 8 * k), acc[k]);
+    }
+    for (; i + 8 <= n; i += 8)
+        acc[0] = _mm256_fmadd_ps(_mm256_loadu_ps(w + i), _mm256_loadu_ps(x + i),
+                                 acc[0]);
+    float sum = hsum_avx2(_mm256_add_ps(_mm256_add_ps(acc[0], acc[1]),
+                                        _mm256_add_ps(acc[2], acc[3])));
+    for (; i < n; ++i)
+        sum += w[i] * x[i];
+    return sum;
+}
+
+__attribute__((target("avx2,fma"))) static float
+dot_q8_avx2(const gint8 *w, const float *x, int n) {
+    __m256 acc[2] = {_mm256_setzero_ps(), _mm256_setzero_ps()};
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i q = _mm_loadu_si128((const __m128i *)(w + i));
+        __m256 w0 = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(q));
+        __m256 w1 =
+            _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_srli_si128(q, 8)));
+        acc[0] = _mm256_fmadd_ps(w0, _mm256_loadu_ps(x + i), acc[0]);
+        acc[1] = _mm256_fmadd_ps(w1, _mm256_loadu_ps(x + i + 8), acc[1]);
+    }
+    float sum = hsum_avx2(_mm256_add_ps(acc[0], acc[1]));
+    for (; i < n; ++i)
+        sum += w[i] * x[i];
+    return sum;
+}
+
+#define TILE_BODY(VEC, WIDTH, SETZERO, LOAD_W, LOAD_X, FMADD, HSUM)        \
+    VEC acc[4][4];                                                             \
+    for (int r = 0; r < 4; ++r) {                                              \
+        for (int o = 0; o < 4; ++o)                                            \
+            acc[r][o] = SETZERO();                                             \
+    }                                                                          \
+    int i = 0;                                                                 \
+    for (; i + WIDTH <= n; i += WIDTH) {                                       \
+        VEC wi[4];                                                             \
+        for (int o = 0; o < 4; ++o)                                            \
+            wi[o] = LOAD_W(w + o * n + i);                                     \
+        for (int r = 0; r < 4; ++r) {                                          \
+            VEC xi = LOAD_X(x + r * n + i);                                    \
+            for (int o = 0; o < 4; ++o)                                        \
+                acc[r][o] = FMADD(wi[o], xi, acc[r][o]);                       \
+        }                                                                      \
+    }                                                                          \
+    for (int r = 0; r < 4; ++r) {                                              \
+        for (int o = 0; o < 4; ++o) {                                          \
+            out[r][o] = HSUM(acc[r][o]);                                       \
+            for (int j = i; j < n; ++j)                                        \
+                out[r][o] += w[o * n + j] * x[r * n + j];                      \
+        }                                                                      \
+    }
+
+#define LOAD_Q8_AVX2(p)                                                        \
+    _mm256_cvtepi32_ps(                                                        \
+        _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *)(p))))
+#define LOAD_Q8_AVX512(p)                                                      \
+    _mm512_cvtepi32_ps(                                                        \
+        _mm512_cvtepi8_epi32(_mm_loadu_si128((const __m128i *)(p))))
+
+__attribute__((target("avx2,fma"))) static void
+tile_avx2(const float *w, const float *x, int n, float out[4][4]) {
+    TILE_BODY(__m256, 8, _mm256_setzero_ps, _mm256_loadu_ps, _mm256_loadu_ps,
+              _mm256_fmadd_ps, hsum_avx2)
+}
+
+__attribute__((target("avx2,fma"))) static void
+tile_q8_avx2(const gint8 *w, const float *x, int n, float out[4][4]) {
+    TILE_BODY(__m256, 8, _mm256_setzero_ps, LOAD_Q8_AVX2, _mm256_loadu_ps,
+              _mm256_fmadd_ps, hsum_avx2)
+}
+
+__attribute__((target("avx512f"))) static float
+dot_avx512(const float *w, const float *x, int n) {
+    __m512 acc[4] = {_mm512_setzero_ps(), _mm512_setzero_ps(),
+                     _mm512_setzero_ps(), _mm512_setzero_ps()};
+    int i = 0;
+    for (; i + 64 <= n; i += 64) {
+        for (int k = 0; k < 4; ++k)
+            acc[k] = _mm512_fmadd_ps(_mm512_loadu_ps(w + i + 16 * k),
+                                     _mm512_loadu_ps(x + i + 16 * k), acc[k]);
+    }
+    for (; i + 16 <= n; i += 16)
+        acc[0] = _mm512_fmadd_ps(_mm512_loadu_ps(w + i), _mm512_loadu_ps(x + i),
+                                 acc[0]);
+    float sum = _mm512_reduce_add_ps(_mm512_add_ps(
+        _mm512_add_ps(acc[0], acc[1]), _mm512_add_ps(acc[2], acc[3])));
+    for (; i < n; ++i)
+        sum += w[i] * x[i];
+    return sum;
+}
+
+__attribute__((target("avx512f"))) static float
+dot_q8_avx512(const gint8 *w, const float *x, int n) {
+    __m512 acc[2] = {_mm512_setzero_ps(), _mm512_setzero_ps()};
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        for (int k = 0; k < 2; ++k) {
+            __m128i q = _mm_loadu_si128((const __m128i *)(w + i + 16 * k));
+            __m512 wk = _mm512_cvtepi32_ps(_mm512_cvtepi8_epi32(q));
+            acc[k] =
+                _mm512_fmadd_ps(wk, _mm512_loadu_ps(x + i + 16 * k), acc[k]);
+        }
+    }
+    float sum = _mm512_reduce_add_ps(_mm512_add_ps(acc[0], acc[1]));
+    for (; i < n; ++i)
+        sum += w[i] * x[i];
+    return sum;
+}
+__attribute__((target("avx512f"))) static void
+tile_avx512(const float *w, const float *x, int n, float out[4][4]) {
+    TILE_BODY(__m512, 16, _mm512_setzero_ps, _mm512_loadu_ps, _mm512_loadu_ps,
+              _mm512_fmadd_ps, _mm512_reduce_add_ps)
+}
+
+__attribute__((target("avx512f"))) static void
+tile_q8_avx512(const gint8 *w, const float *x, int n, float out[4][4]) {
+    TILE_BODY(__m512, 16, _mm512_setzero_ps, LOAD_Q8_AVX512, _mm512_loadu_ps,
+              _mm512_fmadd_ps, _mm512_reduce_add_ps)
+}
+#endif
+
+static void select_kernels() {
+    kernels = (MLP_Kernels){"generic", dot_generic, dot_q8_generic,
+                            tile_generic, tile_q8_generic};
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        kernels = (MLP_Kernels){"avx512", dot_avx512, dot_q8_avx512,
+                                tile_avx512, tile_q8_avx512};
+    else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        kernels = (MLP_Kernels){"avx2", dot_avx2, dot_q8_avx2, tile_avx2,
+                                tile_q8_avx2};
+#endif
+}
+
+static void quantize_layer(MLP_Layer *layer) {
+    size_t count = (size_t)layer->inputs * layer->outputs;
+    layer->quantized = g_new(gint8, count);
+    layer->scales = g_new(float, layer->outputs);
+    for (int o = 0; o < layer->outputs; ++o) {
+        const float *row = layer->weights + (size_t)o * layer->inputs;
+        gint8 *quantized = layer->quantized + (size_t)o * layer->inputs;
+        float max = 0;
+        for (int i = 0; i < layer->inputs; ++i)
+            max = MAX(max, fabsf(row[i]));
+        layer->scales[o] = max / 127;
+        for (int i = 0; i < layer->inputs; ++i)
+            quantized[i] = max > 0 ? lrintf(row[i] / layer->scales[o]) : 0;
+    }
+    g_free(layer->weights);
+    layer->weights = NULL;
+}
+
+static gboolean read_bytes(const gchar **pos, const gchar *end, void *out,
+                           size_t size) {
+    if (end - *pos < size)
+        return FALSE;
+    memcpy(out, *pos, size);
+    *pos += size;
+    return TRUE;
+}
+
+// Returns NULL if the file can't be read or isn't a weights file
+MLP *mlp_load(const char *path, gboolean quantize, int max_rows) {
+    gchar *content;
+    gsize length;
+    if (!g_file_get_contents(path, &content, &length, NULL))
+        return NULL;
+
+    const gchar *pos = content;
+    const gchar *end = content + length;
+    guint32 layer_count = 0;
+    if (length < MLP_MAGIC_SIZE ||
+        memcmp(content, MLP_MAGIC, MLP_MAGIC_SIZE) != 0) {
+        g_free(content);
+        return NULL;
+    }
+    pos += MLP_MAGIC_SIZE;
+    if (!read_bytes(&pos, end, &layer_count, sizeof(layer_count)) ||
+        layer_count == 0) {
+        g_free(content);
+        return NULL;
+    }
+
+    MLP *mlp = g_new0(MLP, 1);
+    mlp->layers = g_new0(MLP_Layer, layer_count);
+    mlp->max_rows = MAX(1, max_rows);
+    gboolean valid = TRUE;
+    for (int l = 0; valid && l < layer_count; ++l) {
+        MLP_Layer *layer = &mlp->layers[l];
+        guint32 shape[2];
+        valid = read_bytes(&pos, end, shape, sizeof(shape)) && shape[0] > 0 &&
+                shape[1] > 0 &&
+                (l == 0 || shape[0] == mlp->layers[l - 1].outputs);
+        if (!valid)
+            break;
+        layer->inputs = shape[0];
+        layer->outputs = shape[1];
+        ++mlp->layer_count;
+        size_t weights_size = sizeof(float) * layer->inputs * layer->outputs;
+        layer->weights = g_malloc(weights_size);
+        layer->bias = g_new(float, layer->outputs);
+        valid = read_bytes(&pos, end, layer->weights, weights_size) &&
+                read_bytes(&pos, end, layer->bias,
+                           sizeof(float) * layer->outputs);
+        mlp->width = MAX(mlp->width, MAX(layer->inputs, layer->outputs));
+    }
+    g_free(content);
+    if (!valid || pos != end) {
+        mlp_free(mlp);
+        return NULL;
+    }
+
+    if (quantize) {
+        for (int l = 0; l < mlp->layer_count; ++l)
+            quantize_layer(&mlp->layers[l]);
+    }
+    for (int a = 0; a < 2; ++a)
+        mlp->activations[a] = g_new(float, (size_t)mlp->max_rows * mlp->width);
+    if (kernels.name == NULL)
+        select_kernels();
+    return mlp;
+}
+
+static float dot_row(const MLP_Layer *layer, int o, const float *x) {
+    size_t offset = (size_t)o * layer->inputs;
+    if (layer->weights != NULL)
+        return kernels.dot(layer->weights + offset, x, layer->inputs);
+    return layer->scales[o] *
+           kernels.dot_q8(layer->quantized + offset, x, layer->inputs);
+}
+
+/*
+ * Tiles of four weight rows stay in cache while all rows of the batch pass,
+ * so a batch reads the weights once and every input load feeds four outputs.
+ */
+static void linear(const MLP_Layer *layer, const float *in, int rows,
+                   float *out, gboolean relu) {
+    int n = layer->inputs;
+    float sums[4][4];
+    for (int o = 0; o < layer->outputs; o += 4) {
+        int outputs = MIN(4, layer->outputs - o);
+        size_t offset = (size_t)o * n;
+        for (int r = 0; r < rows; r += 4) {
+            int block = MIN(4, rows - r);
+            const float *x = in + (size_t)r * n;
+            if (outputs == 4 && block == 4 && layer->weights != NULL) {
+                kernels.tile(layer->weights + offset, x, n, sums);
+            } else if (outputs == 4 && block == 4) {
+                kernels.tile_q8(layer->quantized + offset, x, n, sums);
+                for (int k = 0; k < 4; ++k) {
+                    for (int j = 0; j < 4; ++j)
+                        sums[k][j] *= layer->scales[o + j];
+                }
+            } else {
+                for (int k = 0; k < block; ++k) {
+                    for (int j = 0; j < outputs; ++j)
+                        sums[k][j] = dot_row(layer, o + j, x + k * n);
+                }
+            }
+
+            for (int k = 0; k < block; ++k) {
+                for (int j = 0; j < outputs; ++j) {
+                    float sum = sums[k][j] + layer->bias[o + j];
+                    out[(size_t)(r + k) * layer->outputs + o + j] =
+                        relu ? MAX(sum, 0) : sum;
+                }
+            }
+        }
+    }
+}
+
+// Rows of input have mlp_inputs elements, logits mlp_outputs
+void mlp_forward(MLP *mlp, const float *input, int rows, float *logits) {
+    size_t elements = (size_t)rows * mlp_inputs(mlp);
+    float *x = mlp->activations[0];
+#pragma omp simd
+    for (size_t i = 0; i < elements; ++i)
+        x[i] = input[i] / MAX(fabsf(input[i]), MLP_NORM_EPS);
+
+    for (int l = 0; l < mlp->layer_count; ++l) {
+        gboolean last = l == mlp->layer_count - 1;
+        float *y = last ? logits : mlp->activations[(l + 1) % 2];
+        linear(&mlp->layers[l], x, rows, y, !last);
+        x = y;
+    }
+}
+
+int mlp_inputs(const MLP *mlp) { return mlp->layers[0].inputs; }
+
+int mlp_outputs(const MLP *mlp) {
+    return mlp->layers[mlp->layer_count - 1].outputs;
+}
+
+const char *mlp_kernel_name() { return kernels.name; }
+
+void mlp_free(MLP *mlp) {
+    for (int l = 0; l < mlp->layer_count; ++l) {
+        g_free(mlp->layers[l].weights);
+        g_free(mlp->layers[l].quantized);
+        g_free(mlp->layers[l].scales);
+        g_free(mlp->layers[l].bias);
+    }
+    g_free(mlp->layers);
+    g_free(mlp->activations[0]);
+    g_free(mlp->activations[1]);
+    g_free(mlp);
+}
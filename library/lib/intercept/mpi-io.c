@@ -1,12 +1,241 @@
 #define _GNU_SOURCE
+#include <aggregation.h>
+#include <analysis/async.h>
+#include <analysis/cache.h>
+#include <container.h>
 #include <dlfcn.h>
 #include <filter.h>
 #include <glib/gstdio.h>
+#include <governor.h>
+#include <inferencing/bandit.h>
+#include <inferencing/batch.h>
 #include <inferencing/compression.h>
+#include <inferencing/decision.h>
+#include <inferencing/evaluation.h>
 #include <intercept/mpi-io.h>
 int (*__real_PMPI_Init)(int *argc, char ***argv) = NULL;
+int (*__real_PMPI_Init_thread)(int *argc, char ***argv, int required,
+                               int *provided) = NULL;
 int (*__real_PMPI_Finalize)(void) = NULL;
 
+static void analyze_IO(MPI_File fh, const char *operation, const void *buf,
+                       int count, MPI_Datatype datatype, MPI_Offset offset,
+                       size_t buffer_size) {
+    long s = timeInMicroseconds();
+    if (async_analysis_running()) {
+        async_analysis_submit(fh, operation, buf, buffer_size, datatype,
+                              offset, count);
+    } else {
+        GList *runs = test_algorithms(fh, buf, buffer_size, datatype);
+        add_compression_runs(fh, operation, runs, datatype, offset, count,
+                             buffer_size);
+    }
+    governor_account(timeInMicroseconds() - s);
+}
+
+// The model's decision for a file region is reused in later output steps
+static void predict_IO(MPI_File fh, MPI_Offset offset, const void *buf,
+                       size_t buffer_size, MPI_Datatype datatype,
+                       const Cache_Key *cache_key, gboolean evaluated,
+                       const Write_Target *target) {
+    Input_Type type = datatype_to_input_type(datatype);
+    Decision_Key key;
+    Decision_Key *region = NULL;
+    Prediction prediction;
+    if (decision_cache_enabled()) {
+        key = decision_cache_key(fh, offset, buffer_size, datatype);
+        region = &key;
+        if (decision_cache_reuse(region, buf, type, &prediction)) {
+            record_inference(&prediction, buf, buffer_size, cache_key,
+                             evaluated, target);
+            return;
+        }
+    }
+
+    if (inference_batching()) {
+        inference_batch_submit(buf, buffer_size, type, cache_key, region,
+                               evaluated, target);
+    } else {
+        prediction = predict_compressor(buf, buffer_size, type);
+        if (region != NULL)
+            decision_cache_store(region, buf, type, &prediction);
+        record_inference(&prediction, buf, buffer_size, cache_key, evaluated,
+                         target);
+    }
+}
+
+static void infer_IO(MPI_File fh, MPI_Offset offset, const void *buf,
+                     size_t buffer_size, MPI_Datatype datatype) {
+    long s = timeInMicroseconds();
+    CompressionSample evaluation, best;
+    Inference_Choice choice;
+    Cache_Key key;
+    Cache_Key *cache_key = NULL;
+    // Before the caches are looked up, a new model drops their entries
+    take_reloaded_model();
+    // Only evaluations are cached
+    gboolean evaluated = evaluation_admit();
+    if (evaluated && result_cache_enabled()) {
+        key = result_cache_key(CACHE_INFERENCE, buf, buffer_size, datatype);
+        cache_key = &key;
+    }
+    Write_Target write_target;
+    Write_Target *target = NULL;
+    if (container_target(fh, offset, buffer_size, &write_target))
+        target = &write_target;
+
+    if (cache_key != NULL && result_cache_lookup_inference(
+                                 cache_key, &evaluation, &best, &choice)) {
+        add_evaluation_operation(buffer_size, evaluation, best, choice, TRUE);
+        if (target != NULL)
+            container_write(target, buf, buffer_size, evaluation.compressor,
+                            NULL, 0);
+    } else if (bandit_enabled()) {
+        bandit_record(buf, buffer_size, datatype_to_input_type(datatype),
+                      cache_key, evaluated, target);
+    } else {
+        predict_IO(fh, offset, buf, buffer_size, datatype, cache_key,
+                   evaluated, target);
+    }
+    if (target != NULL)
+        container_target_clear(target);
+    governor_account(timeInMicroseconds() - s);
+}
+
+/*
+ * The file pointer is only looked up if the trace, the analysis, the decision
+ * cache or the container use the offset of the write.
+ */
+static MPI_Offset write_position(MPI_File fh, gboolean analyze) {
+    MPI_Offset offset = 0;
+    if (opt_tracing || container_writes(fh) ||
+        (analyze && (opt_test_compression || decision_cache_enabled())))
+        MPI_File_get_position(fh, &offset);
+    return offset;
+}
+
+// Moves the individual file pointer over data the container wrote or read
+static void move_position(MPI_File fh, size_t buffer_size) {
+    MPI_Offset disp;
+    MPI_Datatype etype, filetype;
+    char datarep[MPI_MAX_DATAREP_STRING];
+    int etype_size;
+    MPI_File_get_view(fh, &disp, &etype, &filetype, datarep);
+    MPI_Type_size(etype, &etype_size);
+    free_view_type(etype);
+    free_view_type(filetype);
+    PMPI_File_seek(fh, buffer_size / etype_size, MPI_SEEK_CUR);
+}
+
+static void set_transferred(MPI_Status *status, size_t size) {
+    if (status != MPI_STATUS_IGNORE)
+        MPI_Status_set_elements_x(status, MPI_BYTE, size);
+}
+
+static int query_completed(void *extra_state, MPI_Status *status) {
+    set_transferred(status, *(size_t *)extra_state);
+    MPI_Status_set_cancelled(status, 0);
+    status->MPI_SOURCE = MPI_UNDEFINED;
+    status->MPI_TAG = MPI_UNDEFINED;
+    return MPI_SUCCESS;
+}
+
+static int free_completed(void *extra_state) {
+    g_free(extra_state);
+    return MPI_SUCCESS;
+}
+
+static int cancel_completed(void *extra_state, int complete) {
+    return MPI_SUCCESS;
+}
+
+// Nonblocking calls served by the container are done once they return
+static void complete_request(size_t size, MPI_Request *request) {
+    size_t *transferred = g_new(size_t, 1);
+    *transferred = size;
+    MPI_Grequest_start(query_completed, free_completed, cancel_completed,
+                       transferred, request);
+    MPI_Grequest_complete(*request);
+}
+
+// Writes replaced by the container report what they would have written
+static int skip_write(MPI_File fh, gboolean individual, size_t buffer_size,
+                      MPI_Status *status) {
+    if (individual)
+        move_position(fh, buffer_size);
+    set_transferred(status, buffer_size);
+    return MPI_SUCCESS;
+}
+
+static int skip_iwrite(MPI_File fh, gboolean individual, size_t buffer_size,
+                       MPI_Request *request) {
+    if (individual)
+        move_position(fh, buffer_size);
+    complete_request(buffer_size, request);
+    return MPI_SUCCESS;
+}
+
+/*
+ * Collective, the container writes the blocks of all ranks at once. Queued
+ * writes of this rank are part of it.
+ */
+static void write_collected(MPI_File fh) {
+    inference_batch_flush();
+    container_collective_end(fh);
+}
+
+// Collective, the aggregators compress the data of their ranks
+static void aggregate_IO(MPI_File fh, MPI_Offset offset, const void *buf,
+                         size_t buffer_size, MPI_Datatype datatype) {
+    long s = timeInMicroseconds();
+    aggregation_write(fh, offset, buf, buffer_size, datatype);
+    write_collected(fh);
+    governor_account(timeInMicroseconds() - s);
+}
+
+/*
+ * Data of non-contiguous memory datatypes is packed if it is analyzed or
+ * stored, so both see it as it lands in the file. packed is freed by the
+ * caller.
+ */
+static const void *pack_IO(MPI_File fh, const void *buf, int count,
+                           MPI_Datatype datatype, size_t buffer_size,
+                           gboolean analyze, void **packed) {
+    *packed = NULL;
+    if ((!analyze && !container_writes(fh)) || contiguous_type(datatype))
+        return buf;
+    int position = 0;
+    *packed = g_malloc(buffer_size);
+    MPI_Pack(buf, count, datatype, *packed, buffer_size, &position,
+             MPI_COMM_SELF);
+    return *packed;
+}
+
+/*
+ * Reads of files with a container, individual ones at the file pointer.
+ * Non-contiguous memory datatypes are unpacked from a copy.
+ */
+static int read_IO(MPI_File fh, MPI_Offset offset, gboolean individual,
+                   void *buf, int count, MPI_Datatype datatype,
+                   size_t *read_size) {
+    size_t buffer_size = count_to_size(count, datatype);
+    gboolean contiguous = contiguous_type(datatype);
+    void *data = contiguous ? buf : g_malloc(buffer_size);
+    if (individual)
+        MPI_File_get_position(fh, &offset);
+    int ret = container_read(fh, offset, data, buffer_size, read_size);
+    if (!contiguous) {
+        int type_size, position = 0;
+        MPI_Type_size(datatype, &type_size);
+        MPI_Unpack(data, *read_size, &position, buf, *read_size / type_size,
+                   datatype, MPI_COMM_SELF);
+        g_free(data);
+    }
+    if (individual)
+        move_position(fh, *read_size);
+    return ret;
+}
+
 size_t count_to_size(int count, MPI_Datatype datatype) {
     // TODO: Long?
     int type_size;
@@ -14,6 +243,23 @@ size_t count_to_size(int count, MPI_Datatype datatype) {
     return count * type_size;
 }
 
+// The inference session is tuned to the ranks of the node, so needs MPI
+static void init_inferencing() {
+    if (!opt_inferencing)
+        return;
+    if (name_to_selector(opt_selector) == SELECTOR_BANDIT) {
+        if (opt_setting_path != NULL)
+            opt_metric_inferencing = parse_metric(opt_setting_path);
+        if (opt_metric_inferencing == _METRIC_COUNT)
+            exit(1);
+        bandit_init(opt_bandit_exploration, opt_bandit_state);
+        return;
+    }
+    init_ml(opt_model_path, opt_setting_path);
+    inference_batch_init(opt_inference_batch, opt_inference_wait);
+    decision_cache_init(opt_decision_reuse, opt_decision_drift);
+}
+
 int MPI_Init(int *argc, char ***argv) {
     int ret;
     ret = PMPI_Init(argc, argv);
@@ -24,6 +270,21 @@ int PMPI_Init(int *argc, char ***argv) {
     int ret;
     __real_PMPI_Init = dlsym(RTLD_NEXT, "PMPI_Init");
     ret = __real_PMPI_Init(argc, argv);
+    init_inferencing();
+    return ret;
+}
+
+int MPI_Init_thread(int *argc, char ***argv, int required, int *provided) {
+    int ret;
+    ret = PMPI_Init_thread(argc, argv, required, provided);
+    return ret;
+}
+
+int PMPI_Init_thread(int *argc, char ***argv, int required, int *provided) {
+    int ret;
+    __real_PMPI_Init_thread = dlsym(RTLD_NEXT, "PMPI_Init_thread");
+    ret = __real_PMPI_Init_thread(argc, argv, required, provided);
+    init_inferencing();
     return ret;
 }
 
@@ -31,6 +292,17 @@ int MPI_Finalize() {
     int ret;
     if (!tracing_stopped() &&
         (opt_test_compression || opt_tracing || opt_inferencing)) {
+        async_analysis_drain();
+        inference_batch_flush();
+        bandit_merge();
+        bandit_report();
+        inference_report();
+        decision_cache_report();
+        evaluation_report();
+        container_report();
+        aggregation_report();
+        governor_report();
+        result_cache_report();
         stop_tracing = TRUE;
         write_dataset();
     }
@@ -42,6 +314,17 @@ int PMPI_Finalize() {
     int ret;
     if (!tracing_stopped() &&
         (opt_test_compression || opt_tracing || opt_inferencing)) {
+        async_analysis_drain();
+        inference_batch_flush();
+        bandit_merge();
+        bandit_report();
+        inference_report();
+        decision_cache_report();
+        evaluation_report();
+        container_report();
+        aggregation_report();
+        governor_report();
+        result_cache_report();
         stop_tracing = TRUE;
         write_dataset();
     }
@@ -72,20 +355,35 @@ int MPI_Comm_rank(MPI_Comm comm, int *rank) {
 int MPI_File_open(MPI_Comm comm, const char *filename, int amode, MPI_Info info,
                   MPI_File *fh) {
     int ret;
+    gboolean created = !tracing_stopped() &&
+                       container_creates(comm, filename, amode);
     ret = PMPI_File_open(comm, filename, amode, info, fh);
     if (tracing_stopped()) {
         return ret;
     }
-    if (!g_hash_table_contains(trackingDB_fh, fh)) {
-        IO_Object *object = g_new(IO_Object, 1);
-        object->fh = (void *)*fh;
-        object->filename = filename;
-        g_debug("filename: %s | handler: %p", filename, object->fh);
-        g_hash_table_insert(trackingDB_fh, object->fh, object);
+    // A closed handle may be reused, recorded operations keep the old object
+    IO_Object *object = g_new(IO_Object, 1);
+    object->fh = (void *)*fh;
+    object->filename = g_strdup(filename);
+    g_debug("filename: %s | handler: %p", filename, object->fh);
+    g_hash_table_insert(trackingDB_fh, object->fh, object);
+    if (ret == MPI_SUCCESS) {
+        container_open(comm, filename, amode, info, *fh, created);
+        aggregation_open(comm, *fh);
     }
     return ret;
 }
 
+int MPI_File_close(MPI_File *fh) {
+    if (!tracing_stopped() && container_enabled()) {
+        // Queued writes may still go to the container
+        inference_batch_flush();
+        aggregation_close(*fh);
+        container_close(*fh);
+    }
+    return PMPI_File_close(fh);
+}
+
 int MPI_File_write(MPI_File fh, const void *buf, int count,
                    MPI_Datatype datatype, MPI_Status *status) {
 
@@ -93,25 +391,23 @@ int MPI_File_write(MPI_File fh, const void *buf, int count,
         return PMPI_File_write(fh, buf, count, datatype, status);
 
     size_t buffer_size = count_to_size(count, datatype);
-
-    if (opt_inferencing && filter_IO(buffer_size)) {
-        CompressionAlgorithm_Level prediction =
-            predict_compressor(buf, buffer_size);
-        CompressionSample evaluation = evaluate(prediction, buf, buffer_size);
-        CompressionSample best = best_compressor(
-            buf, buffer_size, opt_metric_inferencing, &evaluation.compressor);
-        add_evaluation_operation(buffer_size, evaluation, best);
-
+    gboolean analyze =
+        (opt_inferencing || opt_test_compression) && filter_IO(buffer_size);
+    void *packed = NULL;
+    const void *data =
+        pack_IO(fh, buf, count, datatype, buffer_size, analyze, &packed);
+
+    MPI_Offset offset = write_position(fh, analyze);
+    gboolean replaced = container_replaces(fh);
+    if (opt_inferencing && analyze) {
+        infer_IO(fh, offset, data, buffer_size, datatype);
     } else {
-        MPI_Offset offset;
-        MPI_File_get_position(fh, &offset);
-        if (opt_test_compression && filter_IO(buffer_size)) {
-            GList *runs = test_algorithms(fh, buf, buffer_size, datatype);
-            add_compression_runs(fh, __func__, runs, datatype, offset, count,
-                                 buffer_size);
-        }
+        container_store(fh, offset, data, buffer_size);
+        if (opt_test_compression && analyze)
+            analyze_IO(fh, __func__, data, count, datatype, offset,
+                       buffer_size);
 
-        if (opt_tracing) {
+        if (opt_tracing && !replaced) {
             long s;
             long e;
             int ret;
@@ -121,9 +417,13 @@ int MPI_File_write(MPI_File fh, const void *buf, int count,
             e = timeInMicroseconds() - s;
             add_IO_operation(fh, __func__, datatype, offset, count, buffer_size,
                              e);
+            g_free(packed);
             return ret;
         }
     }
+    g_free(packed);
+    if (replaced)
+        return skip_write(fh, TRUE, buffer_size, status);
     return PMPI_File_write(fh, buf, count, datatype, status);
 }
 
@@ -134,24 +434,30 @@ int MPI_File_write_all(MPI_File fh, const void *buf, int count,
         return PMPI_File_write_all(fh, buf, count, datatype, status);
 
     size_t buffer_size = count_to_size(count, datatype);
-
-    if (opt_inferencing && filter_IO(buffer_size)) {
-        CompressionAlgorithm_Level prediction =
-            predict_compressor(buf, buffer_size);
-        CompressionSample evaluation = evaluate(prediction, buf, buffer_size);
-        CompressionSample best = best_compressor(
-            buf, buffer_size, opt_metric_inferencing, &evaluation.compressor);
-        add_evaluation_operation(buffer_size, evaluation, best);
+    gboolean analyze =
+        (opt_inferencing || opt_test_compression) && filter_IO(buffer_size);
+    void *packed = NULL;
+    const void *data =
+        pack_IO(fh, buf, count, datatype, buffer_size, analyze, &packed);
+
+    MPI_Offset offset = write_position(fh, analyze);
+    gboolean replaced = container_replaces(fh);
+    gboolean collective = container_collective_begin(fh);
+    if (aggregation_active(fh)) {
+        aggregate_IO(fh, offset, data, buffer_size, datatype);
+    } else if (opt_inferencing && analyze) {
+        infer_IO(fh, offset, data, buffer_size, datatype);
+        if (collective)
+            write_collected(fh);
     } else {
-        MPI_Offset offset;
-        MPI_File_get_position(fh, &offset);
-        if (opt_test_compression && filter_IO(buffer_size)) {
-            GList *runs = test_algorithms(fh, buf, buffer_size, datatype);
-            add_compression_runs(fh, __func__, runs, datatype, offset, count,
-                                 buffer_size);
-        }
-
-        if (opt_tracing) {
+        container_store(fh, offset, data, buffer_size);
+        if (collective)
+            write_collected(fh);
+        if (opt_test_compression && analyze)
+            analyze_IO(fh, __func__, data, count, datatype, offset,
+                       buffer_size);
+
+        if (opt_tracing && !replaced) {
             long s;
             long e;
             int ret;
@@ -161,9 +467,13 @@ int MPI_File_write_all(MPI_File fh, const void *buf, int count,
             e = timeInMicroseconds() - s;
             add_IO_operation(fh, __func__, datatype, offset, count, buffer_size,
                              e);
+            g_free(packed);
             return ret;
         }
     }
+    g_free(packed);
+    if (replaced)
+        return skip_write(fh, TRUE, buffer_size, status);
     return PMPI_File_write_all(fh, buf, count, datatype, status);
 }
 
@@ -174,22 +484,22 @@ int MPI_File_write_at(MPI_File fh, MPI_Offset offset, const void *buf,
         return PMPI_File_write_at(fh, offset, buf, count, datatype, status);
 
     size_t buffer_size = count_to_size(count, datatype);
-
-    if (opt_inferencing && filter_IO(buffer_size)) {
-        CompressionAlgorithm_Level prediction =
-            predict_compressor(buf, buffer_size);
-        CompressionSample evaluation = evaluate(prediction, buf, buffer_size);
-        CompressionSample best = best_compressor(
-            buf, buffer_size, opt_metric_inferencing, &evaluation.compressor);
-        add_evaluation_operation(buffer_size, evaluation, best);
+    gboolean analyze =
+        (opt_inferencing || opt_test_compression) && filter_IO(buffer_size);
+    void *packed = NULL;
+    const void *data =
+        pack_IO(fh, buf, count, datatype, buffer_size, analyze, &packed);
+
+    gboolean replaced = container_replaces(fh);
+    if (opt_inferencing && analyze) {
+        infer_IO(fh, offset, data, buffer_size, datatype);
     } else {
-        if (opt_test_compression && filter_IO(buffer_size)) {
-            GList *runs = test_algorithms(fh, buf, buffer_size, datatype);
-            add_compression_runs(fh, __func__, runs, datatype, offset, count,
-                                 buffer_size);
-        }
+        container_store(fh, offset, data, buffer_size);
+        if (opt_test_compression && analyze)
+            analyze_IO(fh, __func__, data, count, datatype, offset,
+                       buffer_size);
 
-        if (opt_tracing) {
+        if (opt_tracing && !replaced) {
             long s;
             long e;
             int ret;
@@ -199,9 +509,13 @@ int MPI_File_write_at(MPI_File fh, MPI_Offset offset, const void *buf,
             e = timeInMicroseconds() - s;
             add_IO_operation(fh, __func__, datatype, offset, count, buffer_size,
                              e);
+            g_free(packed);
             return ret;
         }
     }
+    g_free(packed);
+    if (replaced)
+        return skip_write(fh, FALSE, buffer_size, status);
     return PMPI_File_write_at(fh, offset, buf, count, datatype, status);
 }
 
@@ -213,22 +527,29 @@ int MPI_File_write_at_all(MPI_File fh, MPI_Offset offset, const void *buf,
         return PMPI_File_write_at_all(fh, offset, buf, count, datatype, status);
 
     size_t buffer_size = count_to_size(count, datatype);
-
-    if (opt_inferencing && filter_IO(buffer_size)) {
-        CompressionAlgorithm_Level prediction =
-            predict_compressor(buf, buffer_size);
-        CompressionSample evaluation = evaluate(prediction, buf, buffer_size);
-        CompressionSample best = best_compressor(
-            buf, buffer_size, opt_metric_inferencing, &evaluation.compressor);
-        add_evaluation_operation(buffer_size, evaluation, best);
+    gboolean analyze =
+        (opt_inferencing || opt_test_compression) && filter_IO(buffer_size);
+    void *packed = NULL;
+    const void *data =
+        pack_IO(fh, buf, count, datatype, buffer_size, analyze, &packed);
+
+    gboolean replaced = container_replaces(fh);
+    gboolean collective = container_collective_begin(fh);
+    if (aggregation_active(fh)) {
+        aggregate_IO(fh, offset, data, buffer_size, datatype);
+    } else if (opt_inferencing && analyze) {
+        infer_IO(fh, offset, data, buffer_size, datatype);
+        if (collective)
+            write_collected(fh);
     } else {
-        if (opt_test_compression && filter_IO(buffer_size)) {
-            GList *runs = test_algorithms(fh, buf, buffer_size, datatype);
-            add_compression_runs(fh, __func__, runs, datatype, offset, count,
-                                 buffer_size);
-        }
-
-        if (opt_tracing) {
+        container_store(fh, offset, data, buffer_size);
+        if (collective)
+            write_collected(fh);
+        if (opt_test_compression && analyze)
+            analyze_IO(fh, __func__, data, count, datatype, offset,
+                       buffer_size);
+
+        if (opt_tracing && !replaced) {
             long s;
             long e;
             int ret;
@@ -239,9 +560,13 @@ int MPI_File_write_at_all(MPI_File fh, MPI_Offset offset, const void *buf,
             e = timeInMicroseconds() - s;
             add_IO_operation(fh, __func__, datatype, offset, count, buffer_size,
                              e);
+            g_free(packed);
             return ret;
         }
     }
+    g_free(packed);
+    if (replaced)
+        return skip_write(fh, FALSE, buffer_size, status);
     return PMPI_File_write_at_all(fh, offset, buf, count, datatype, status);
 }
 
@@ -252,24 +577,23 @@ int MPI_File_iwrite(MPI_File fh, const void *buf, int count,
         return PMPI_File_iwrite(fh, buf, count, datatype, request);
 
     size_t buffer_size = count_to_size(count, datatype);
-
-    if (opt_inferencing && filter_IO(buffer_size)) {
-        CompressionAlgorithm_Level prediction =
-            predict_compressor(buf, buffer_size);
-        CompressionSample evaluation = evaluate(prediction, buf, buffer_size);
-        CompressionSample best = best_compressor(
-            buf, buffer_size, opt_metric_inferencing, &evaluation.compressor);
-        add_evaluation_operation(buffer_size, evaluation, best);
+    gboolean analyze =
+        (opt_inferencing || opt_test_compression) && filter_IO(buffer_size);
+    void *packed = NULL;
+    const void *data =
+        pack_IO(fh, buf, count, datatype, buffer_size, analyze, &packed);
+
+    MPI_Offset offset = write_position(fh, analyze);
+    gboolean replaced = container_replaces(fh);
+    if (opt_inferencing && analyze) {
+        infer_IO(fh, offset, data, buffer_size, datatype);
     } else {
-        MPI_Offset offset;
-        MPI_File_get_position(fh, &offset);
-        if (opt_test_compression && filter_IO(buffer_size)) {
-            GList *runs = test_algorithms(fh, buf, buffer_size, datatype);
-            add_compression_runs(fh, __func__, runs, datatype, offset, count,
-                                 buffer_size);
-        }
+        container_store(fh, offset, data, buffer_size);
+        if (opt_test_compression && analyze)
+            analyze_IO(fh, __func__, data, count, datatype, offset,
+                       buffer_size);
 
-        if (opt_tracing) {
+        if (opt_tracing && !replaced) {
             long s;
             long e;
             int ret;
@@ -279,9 +603,13 @@ int MPI_File_iwrite(MPI_File fh, const void *buf, int count,
             e = timeInMicroseconds() - s;
             add_IO_operation(fh, __func__, datatype, offset, count, buffer_size,
                              e);
+            g_free(packed);
             return ret;
         }
     }
+    g_free(packed);
+    if (replaced)
+        return skip_iwrite(fh, TRUE, buffer_size, request);
     return PMPI_File_iwrite(fh, buf, count, datatype, request);
 }
 
@@ -292,24 +620,23 @@ int MPI_File_iwrite_all(MPI_File fh, const void *buf, int count,
         return PMPI_File_iwrite_all(fh, buf, count, datatype, request);
 
     size_t buffer_size = count_to_size(count, datatype);
-
-    if (opt_inferencing && filter_IO(buffer_size)) {
-        CompressionAlgorithm_Level prediction =
-            predict_compressor(buf, buffer_size);
-        CompressionSample evaluation = evaluate(prediction, buf, buffer_size);
-        CompressionSample best = best_compressor(
-            buf, buffer_size, opt_metric_inferencing, &evaluation.compressor);
-        add_evaluation_operation(buffer_size, evaluation, best);
+    gboolean analyze =
+        (opt_inferencing || opt_test_compression) && filter_IO(buffer_size);
+    void *packed = NULL;
+    const void *data =
+        pack_IO(fh, buf, count, datatype, buffer_size, analyze, &packed);
+
+    MPI_Offset offset = write_position(fh, analyze);
+    gboolean replaced = container_replaces(fh);
+    if (opt_inferencing && analyze) {
+        infer_IO(fh, offset, data, buffer_size, datatype);
     } else {
-        MPI_Offset offset;
-        MPI_File_get_position(fh, &offset);
-        if (opt_test_compression && filter_IO(buffer_size)) {
-            GList *runs = test_algorithms(fh, buf, buffer_size, datatype);
-            add_compression_runs(fh, __func__, runs, datatype, offset, count,
-                                 buffer_size);
-        }
+        container_store(fh, offset, data, buffer_size);
+        if (opt_test_compression && analyze)
+            analyze_IO(fh, __func__, data, count, datatype, offset,
+                       buffer_size);
 
-        if (opt_tracing) {
+        if (opt_tracing && !replaced) {
             long s;
             long e;
             int ret;
@@ -319,9 +646,13 @@ int MPI_File_iwrite_all(MPI_File fh, const void *buf, int count,
             e = timeInMicroseconds() - s;
             add_IO_operation(fh, __func__, datatype, offset, count, buffer_size,
                              e);
+            g_free(packed);
             return ret;
         }
     }
+    g_free(packed);
+    if (replaced)
+        return skip_iwrite(fh, TRUE, buffer_size, request);
     return PMPI_File_iwrite_all(fh, buf, count, datatype, request);
 }
 
@@ -332,22 +663,22 @@ int MPI_File_iwrite_at(MPI_File fh, MPI_Offset offset, const void *buf,
         return PMPI_File_iwrite_at(fh, offset, buf, count, datatype, request);
 
     size_t buffer_size = count_to_size(count, datatype);
-
-    if (opt_inferencing && filter_IO(buffer_size)) {
-        CompressionAlgorithm_Level prediction =
-            predict_compressor(buf, buffer_size);
-        CompressionSample evaluation = evaluate(prediction, buf, buffer_size);
-        CompressionSample best = best_compressor(
-            buf, buffer_size, opt_metric_inferencing, &evaluation.compressor);
-        add_evaluation_operation(buffer_size, evaluation, best);
+    gboolean analyze =
+        (opt_inferencing || opt_test_compression) && filter_IO(buffer_size);
+    void *packed = NULL;
+    const void *data =
+        pack_IO(fh, buf, count, datatype, buffer_size, analyze, &packed);
+
+    gboolean replaced = container_replaces(fh);
+    if (opt_inferencing && analyze) {
+        infer_IO(fh, offset, data, buffer_size, datatype);
     } else {
-        if (opt_test_compression && filter_IO(buffer_size)) {
-            GList *runs = test_algorithms(fh, buf, buffer_size, datatype);
-            add_compression_runs(fh, __func__, runs, datatype, offset, count,
-                                 buffer_size);
-        }
+        container_store(fh, offset, data, buffer_size);
+        if (opt_test_compression && analyze)
+            analyze_IO(fh, __func__, data, count, datatype, offset,
+                       buffer_size);
 
-        if (opt_tracing) {
+        if (opt_tracing && !replaced) {
             long s;
             long e;
             int ret;
@@ -358,9 +689,13 @@ int MPI_File_iwrite_at(MPI_File fh, MPI_Offset offset, const void *buf,
             e = timeInMicroseconds() - s;
             add_IO_operation(fh, __func__, datatype, offset, count, buffer_size,
                              e);
+            g_free(packed);
             return ret;
         }
     }
+    g_free(packed);
+    if (replaced)
+        return skip_iwrite(fh, FALSE, buffer_size, request);
     return PMPI_File_iwrite_at(fh, offset, buf, count, datatype, request);
 }
 
@@ -372,22 +707,22 @@ int MPI_File_iwrite_at_all(MPI_File fh, MPI_Offset offset, const void *buf,
                                        request);
 
     size_t buffer_size = count_to_size(count, datatype);
-
-    if (opt_inferencing && filter_IO(buffer_size)) {
-        CompressionAlgorithm_Level prediction =
-            predict_compressor(buf, buffer_size);
-        CompressionSample evaluation = evaluate(prediction, buf, buffer_size);
-        CompressionSample best = best_compressor(
-            buf, buffer_size, opt_metric_inferencing, &evaluation.compressor);
-        add_evaluation_operation(buffer_size, evaluation, best);
+    gboolean analyze =
+        (opt_inferencing || opt_test_compression) && filter_IO(buffer_size);
+    void *packed = NULL;
+    const void *data =
+        pack_IO(fh, buf, count, datatype, buffer_size, analyze, &packed);
+
+    gboolean replaced = container_replaces(fh);
+    if (opt_inferencing && analyze) {
+        infer_IO(fh, offset, data, buffer_size, datatype);
     } else {
-        if (opt_test_compression && filter_IO(buffer_size)) {
-            GList *runs = test_algorithms(fh, buf, buffer_size, datatype);
-            add_compression_runs(fh, __func__, runs, datatype, offset, count,
-                                 buffer_size);
-        }
+        container_store(fh, offset, data, buffer_size);
+        if (opt_test_compression && analyze)
+            analyze_IO(fh, __func__, data, count, datatype, offset,
+                       buffer_size);
 
-        if (opt_tracing) {
+        if (opt_tracing && !replaced) {
             long s;
             long e;
             int ret;
@@ -398,8 +733,94 @@ int MPI_File_iwrite_at_all(MPI_File fh, MPI_Offset offset, const void *buf,
             e = timeInMicroseconds() - s;
             add_IO_operation(fh, __func__, datatype, offset, count, buffer_size,
                              e);
+            g_free(packed);
             return ret;
         }
     }
+    g_free(packed);
+    if (replaced)
+        return skip_iwrite(fh, FALSE, buffer_size, request);
     return PMPI_File_iwrite_at_all(fh, offset, buf, count, datatype, request);
 }
+
+int MPI_File_read(MPI_File fh, void *buf, int count, MPI_Datatype datatype,
+                  MPI_Status *status) {
+    if (tracing_stopped() || !container_reads(fh))
+        return PMPI_File_read(fh, buf, count, datatype, status);
+    size_t read_size;
+    int ret = read_IO(fh, 0, TRUE, buf, count, datatype, &read_size);
+    set_transferred(status, read_size);
+    return ret;
+}
+
+int MPI_File_read_all(MPI_File fh, void *buf, int count, MPI_Datatype datatype,
+                      MPI_Status *status) {
+    if (tracing_stopped() || !container_reads(fh))
+        return PMPI_File_read_all(fh, buf, count, datatype, status);
+    size_t read_size;
+    int ret = read_IO(fh, 0, TRUE, buf, count, datatype, &read_size);
+    set_transferred(status, read_size);
+    return ret;
+}
+
+int MPI_File_read_at(MPI_File fh, MPI_Offset offset, void *buf, int count,
+                     MPI_Datatype datatype, MPI_Status *status) {
+    if (tracing_stopped() || !container_reads(fh))
+        return PMPI_File_read_at(fh, offset, buf, count, datatype, status);
+    size_t read_size;
+    int ret = read_IO(fh, offset, FALSE, buf, count, datatype, &read_size);
+    set_transferred(status, read_size);
+    return ret;
+}
+
+int MPI_File_read_at_all(MPI_File fh, MPI_Offset offset, void *buf, int count,
+                         MPI_Datatype datatype, MPI_Status *status) {
+    if (tracing_stopped() || !container_reads(fh))
+        return PMPI_File_read_at_all(fh, offset, buf, count, datatype, status);
+    size_t read_size;
+    int ret = read_IO(fh, offset, FALSE, buf, count, datatype, &read_size);
+    set_transferred(status, read_size);
+    return ret;
+}
+
+int MPI_File_iread(MPI_File fh, void *buf, int count, MPI_Datatype datatype,
+                   MPI_Request *request) {
+    if (tracing_stopped() || !container_reads(fh))
+        return PMPI_File_iread(fh, buf, count, datatype, request);
+    size_t read_size;
+    int ret = read_IO(fh, 0, TRUE, buf, count, datatype, &read_size);
+    complete_request(read_size, request);
+    return ret;
+}
+
+int MPI_File_iread_all(MPI_File fh, void *buf, int count,
+                       MPI_Datatype datatype, MPI_Request *request) {
+    if (tracing_stopped() || !container_reads(fh))
+        return PMPI_File_iread_all(fh, buf, count, datatype, request);
+    size_t read_size;
+    int ret = read_IO(fh, 0, TRUE, buf, count, datatype, &read_size);
+    complete_request(read_size, request);
+    return ret;
+}
+
+int MPI_File_iread_at(MPI_File fh, MPI_Offset offset, void *buf, int count,
+                      MPI_Datatype datatype, MPIO_Request *request) {
+    if (tracing_stopped() || !container_reads(fh))
+        return PMPI_File_iread_at(fh, offset, buf, count, datatype, request);
+    size_t read_size;
+    int ret = read_IO(fh, offset, FALSE, buf, count, datatype, &read_size);
+    complete_request(read_size, request);
+    return ret;
+}
+
+int MPI_File_iread_at_all(MPI_File fh, MPI_Offset offset, void *buf,
+                          int count, MPI_Datatype datatype,
+                          MPIO_Request *request) {
+    if (tracing_stopped() || !container_reads(fh))
+        return PMPI_File_iread_at_all(fh, offset, buf, count, datatype,
+                                      request);
+    size_t read_size;
+    int ret = read_IO(fh, offset, FALSE, buf, count, datatype, &read_size);
+    complete_request(read_size, request);
+    return ret;
+}
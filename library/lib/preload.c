@@ -1,11 +1,20 @@
 #define _GNU_SOURCE
 #define G_LOG_DOMAIN ((gchar *)"IOA")
 
+#include <aggregation.h>
+#include <analysis/async.h>
+#include <analysis/cache.h>
 #include <compression.h>
+#include <container.h>
 #include <dlfcn.h>
 #include <glib.h>
 #include <glib/gstdio.h>
+#include <governor.h>
+#include <inferencing/bandit.h>
+#include <inferencing/batch.h>
 #include <inferencing/compression.h>
+#include <inferencing/decision.h>
+#include <inferencing/evaluation.h>
 #include <meta.h>
 #include <settings.h>
 #include <stdio.h>
@@ -63,6 +72,24 @@ void init() {
          "Min size of chunks to analyze in bytes", "9"},
         {"repeat", 'r', 0, G_OPTION_ARG_INT, &opt_repeat_measurements,
          "Number of times to repeat measurements", "3"},
+        {"analysis-threads", 'j', 0, G_OPTION_ARG_INT, &opt_analysis_threads,
+         "Cores used to test compressors in parallel", "1"},
+        {"sample-blocks", 'k', 0, G_OPTION_ARG_INT, &opt_sample_blocks,
+         "Estimate large buffers from N blocks (0: whole buffer)", "0"},
+        {"sample-block-size", 'K', 0, G_OPTION_ARG_INT, &opt_sample_block_size,
+         "Size of sampled blocks in bytes", "1048576"},
+        {"sample-min-size", 'M', 0, G_OPTION_ARG_INT, &opt_sample_min_size,
+         "Min size of buffers to sample in bytes", "33554432"},
+        {"async-workers", 'w', 0, G_OPTION_ARG_INT, &opt_async_workers,
+         "Test compressors on background threads (0: synchronous)", "0"},
+        {"async-buffer", 'b', 0, G_OPTION_ARG_INT, &opt_async_buffer,
+         "Max. MiB of queued buffers for background analysis", "256"},
+        {"async-policy", 'a', 0, G_OPTION_ARG_STRING, &opt_async_policy,
+         "Policy for a full analysis queue (block, drop)", "block"},
+        {"result-cache", 0, 0, G_OPTION_ARG_INT, &opt_result_cache,
+         "Reuse results of the last N distinct buffers (0: off)", "0"},
+        {"max-overhead", 'O', 0, G_OPTION_ARG_STRING, &opt_max_overhead,
+         "Throttle analysis to stay below this share of the runtime", "2%"},
         {"meta-path", 'p', 0, G_OPTION_ARG_STRING, &opt_meta_data_path,
          "Path for metadata storage", "/tmp/meta.h5"},
         {"tracing", 't', 0, G_OPTION_ARG_NONE, &opt_tracing,
@@ -79,8 +106,90 @@ void init() {
          "Path to exported ONNX settings"},
         {"inferencing", 'i', 0, G_OPTION_ARG_NONE, &opt_inferencing,
          "Run inferencing"},
+        {"selector", 0, 0, G_OPTION_ARG_STRING, &opt_selector,
+         "Choose compressors by (model, bandit: learned during the run)",
+         "model"},
+        {"bandit-exploration", 0, 0, G_OPTION_ARG_DOUBLE,
+         &opt_bandit_exploration,
+         "Weight of the uncertainty when the bandit chooses", "0.2"},
+        {"bandit-state", 0, 0, G_OPTION_ARG_STRING, &opt_bandit_state,
+         "Load the bandit from, and save it at exit to, a file"},
+        {"model-reload", 0, 0, G_OPTION_ARG_INT, &opt_model_reload,
+         "Look for a changed model and settings file every N s (0: never)",
+         "0"},
+        {"inference-backend", 0, 0, G_OPTION_ARG_STRING,
+         &opt_inference_backend,
+         "Run the model with (onnx, native: exported MLP weights)", "onnx"},
+        {"native-int8", 0, 0, G_OPTION_ARG_NONE, &opt_native_int8,
+         "Quantize the weights of the native backend to int8"},
+        {"inference-batch", 0, 0, G_OPTION_ARG_INT, &opt_inference_batch,
+         "Predict up to N queued writes at once (1: no batching)", "1"},
+        {"inference-wait", 0, 0, G_OPTION_ARG_INT, &opt_inference_wait,
+         "Max. ms a queued write waits for its batch", "10"},
+        {"inference-windows", 0, 0, G_OPTION_ARG_INT, &opt_inference_windows,
+         "Predict large writes from up to N windows across the buffer", "1"},
+        {"inference-vote", 0, 0, G_OPTION_ARG_STRING, &opt_inference_vote,
+         "Combine the windows by (mean: probabilities, majority)", "mean"},
+        {"fallback-threshold", 0, 0, G_OPTION_ARG_DOUBLE,
+         &opt_fallback_threshold,
+         "Measure the top-k compressors below this probability (0: never)",
+         "0"},
+        {"fallback-top-k", 0, 0, G_OPTION_ARG_INT, &opt_fallback_top_k,
+         "Compressors measured for predictions below the threshold", "2"},
+        {"evaluation-rate", 0, 0, G_OPTION_ARG_INT, &opt_evaluation_rate,
+         "Compare 1 in N predictions to the best compressor", "1"},
+        {"evaluation-budget", 0, 0, G_OPTION_ARG_STRING,
+         &opt_evaluation_budget,
+         "Skip comparisons beyond this share of the runtime, e.g. 1%"},
+        {"decision-reuse", 0, 0, G_OPTION_ARG_INT, &opt_decision_reuse,
+         "Reuse the prediction of a file region N times (0: off)", "0"},
+        {"decision-drift", 0, 0, G_OPTION_ARG_DOUBLE, &opt_decision_drift,
+         "Predict a region again if its byte statistics change by more",
+         "0.05"},
+        {"container", 0, 0, G_OPTION_ARG_STRING, &opt_container,
+         "Write compressed data (off, beside: next to the file, replace)",
+         "off"},
+        {"container-block-size", 0, 0, G_OPTION_ARG_INT,
+         &opt_container_block_size,
+         "Split writes into container blocks of N KiB (0: one per write)",
+         "0"},
+        {"aggregators", 0, 0, G_OPTION_ARG_INT, &opt_aggregators,
+         "Ranks per node compressing collective container writes (0: off)",
+         "0"},
+        {"aggregator-threads", 0, 0, G_OPTION_ARG_INT,
+         &opt_aggregator_threads, "Threads compressing on each aggregator",
+         "1"},
+        {"read-threads", 0, 0, G_OPTION_ARG_INT, &opt_read_threads,
+         "Threads decompressing the blocks of a read from a container", "1"},
+        {"ort-intra-threads", 0, 0, G_OPTION_ARG_INT, &opt_ort_intra_threads,
+         "Threads per inference (0: split the node's cores among ranks)",
+         "0"},
+        {"ort-inter-threads", 0, 0, G_OPTION_ARG_INT, &opt_ort_inter_threads,
+         "Threads running graph nodes in parallel mode (0: ORT default)", "0"},
+        {"ort-execution", 0, 0, G_OPTION_ARG_STRING, &opt_ort_execution,
+         "Execution mode of the model (sequential, parallel)", "sequential"},
+        {"ort-optimization", 0, 0, G_OPTION_ARG_STRING, &opt_ort_optimization,
+         "Graph optimization level (disable, basic, extended, all)", "all"},
+        {"ort-optimized-model", 0, 0, G_OPTION_ARG_STRING,
+         &opt_ort_optimized_model,
+         "Load the optimized model from this file, or save it there"},
+        {"ort-shared-model", 0, 0, G_OPTION_ARG_NONE, &opt_ort_shared_model,
+         "Read the model once per node into shared memory"},
+        {"ort-global-threads", 0, 0, G_OPTION_ARG_NONE,
+         &opt_ort_global_threads,
+         "Share one thread pool between sessions, without spinning"},
+        {"ort-profile", 0, 0, G_OPTION_ARG_STRING, &opt_ort_profile,
+         "Write ONNX Runtime profiles per rank with this prefix"},
+        {"pruned-search", 0, 0, G_OPTION_ARG_NONE, &opt_pruned_search,
+         "Search the best compressor by successive halving"},
+        {"search-deadline", 0, 0, G_OPTION_ARG_INT, &opt_search_deadline,
+         "Return the best compressor found after ms (0: no deadline)", "0"},
+        {"search-audit", 0, 0, G_OPTION_ARG_INT, &opt_search_audit,
+         "Compare every Nth pruned search to a full one (0: never)", "0"},
         {"decompression", 'd', 0, G_OPTION_ARG_NONE, &opt_decompression,
          "Measure decompression"},
+        {"cache-cold", 0, 0, G_OPTION_ARG_NONE, &opt_cache_cold,
+         "Evict caches before every measurement"},
         {"verbose", 'v', 0, G_OPTION_ARG_NONE, &opt_verbose, "Verbose", NULL},
         {NULL}};
 
@@ -123,13 +232,144 @@ void init() {
         show_help(context);
     }
 
-    if (opt_inferencing &&
+    Selector selector = name_to_selector(opt_selector);
+    if (selector == _SELECTOR_COUNT) {
+        g_print("--selector has to be either model or bandit\n");
+        show_help(context);
+    }
+
+    if (opt_inferencing && selector == SELECTOR_MODEL &&
         (opt_model_path == NULL || opt_setting_path == NULL)) {
         g_print("If inferencing is required, provide a model and a label path "
                 "(--model-path, --settings-path)\n");
         show_help(context);
     }
 
+    if (name_to_inference_backend(opt_inference_backend) ==
+        _INFERENCE_BACKEND_COUNT) {
+        g_print("--inference-backend has to be either onnx or native\n");
+        show_help(context);
+    }
+
+    if (name_to_ort_execution(opt_ort_execution) < 0) {
+        g_print("--ort-execution has to be either sequential or parallel\n");
+        show_help(context);
+    }
+
+    if (name_to_ort_optimization(opt_ort_optimization) < 0) {
+        g_print("--ort-optimization has to be disable, basic, extended or "
+                "all\n");
+        show_help(context);
+    }
+
+    if (opt_model_reload < 0) {
+        g_print("--model-reload can't be negative\n");
+        show_help(context);
+    }
+
+    if (opt_inference_batch < 1) {
+        g_print("--inference-batch has to be at least 1\n");
+        show_help(context);
+    }
+
+    if (opt_inference_windows < 1) {
+        g_print("--inference-windows has to be at least 1\n");
+        show_help(context);
+    }
+
+    if (opt_fallback_top_k < 1 || opt_fallback_top_k > MAX_CANDIDATES) {
+        g_print("--fallback-top-k has to be between 1 and %d\n",
+                MAX_CANDIDATES);
+        show_help(context);
+    }
+
+    if (opt_evaluation_rate < 1) {
+        g_print("--evaluation-rate has to be at least 1\n");
+        show_help(context);
+    }
+
+    gfloat evaluation_budget = 0;
+    if (opt_evaluation_budget != NULL) {
+        evaluation_budget = parse_overhead(opt_evaluation_budget);
+        if (evaluation_budget < 0) {
+            g_print("--evaluation-budget has to be a percentage, e.g. 1%%\n");
+            show_help(context);
+        }
+    }
+
+    if (opt_decision_reuse < 0 || opt_decision_drift < 0) {
+        g_print("--decision-reuse and --decision-drift can't be negative\n");
+        show_help(context);
+    }
+
+    Container_Mode container_mode = name_to_container_mode(opt_container);
+    if (container_mode == _CONTAINER_MODE_COUNT) {
+        g_print("--container has to be off, beside or replace\n");
+        show_help(context);
+    }
+
+    if (opt_container_block_size < 0) {
+        g_print("--container-block-size can't be negative\n");
+        show_help(context);
+    }
+
+    if (opt_aggregators < 0 || opt_aggregator_threads < 1) {
+        g_print("--aggregators can't be negative, --aggregator-threads has "
+                "to be at least 1\n");
+        show_help(context);
+    }
+
+    if (opt_aggregators > 0 && selector != SELECTOR_MODEL) {
+        g_print("--aggregators requires --selector=model\n");
+        show_help(context);
+    }
+
+    if (opt_read_threads < 1) {
+        g_print("--read-threads has to be at least 1\n");
+        show_help(context);
+    }
+
+    if (name_to_inference_vote(opt_inference_vote) == _INFERENCE_VOTE_COUNT) {
+        g_print("--inference-vote has to be either mean or majority\n");
+        show_help(context);
+    }
+
+    if ((opt_sample_blocks > 0 || opt_max_overhead != NULL) &&
+        opt_sample_block_size <= 0) {
+        g_print("--sample-block-size has to be positive\n");
+        show_help(context);
+    }
+
+    Async_Policy async_policy = name_to_async_policy(opt_async_policy);
+    if (async_policy == _ASYNC_POLICY_COUNT) {
+        g_print("--async-policy has to be either block or drop\n");
+        show_help(context);
+    }
+
+    gfloat max_overhead = 0;
+    if (opt_max_overhead != NULL) {
+        max_overhead = parse_overhead(opt_max_overhead);
+        if (max_overhead < 0) {
+            g_print("--max-overhead has to be a percentage, e.g. 2%%\n");
+            show_help(context);
+        }
+    }
+
+#ifndef _OPENMP
+    if (opt_analysis_threads > 1) {
+        g_print("--analysis-threads requires OpenMP support, using 1\n");
+        opt_analysis_threads = 1;
+    }
+    if (opt_read_threads > 1) {
+        g_print("--read-threads requires OpenMP support, using 1\n");
+        opt_read_threads = 1;
+    }
+    if (opt_aggregator_threads > 1) {
+        g_print("--aggregator-threads requires OpenMP support, using 1\n");
+        opt_aggregator_threads = 1;
+    }
+#endif
+
     if (opt_tracing || opt_test_compression || opt_inferencing)
         _opt_action_required = TRUE;
 
@@ -139,17 +379,34 @@ void init() {
     trackingDB_fh = g_hash_table_new(g_direct_hash, g_direct_equal);
     trackingDB_io = g_array_new(FALSE, FALSE, sizeof(IO_Operation));
     evaluation_ops = g_array_new(FALSE, FALSE, sizeof(Evaluation_Operation));
+    trace_counters = g_array_new(FALSE, FALSE, sizeof(Trace_Counter));
+    trace_counter_index = g_hash_table_new(g_str_hash, g_str_equal);
+    governor_decisions = g_array_new(FALSE, FALSE, sizeof(Governor_Decision));
+    governor_init(max_overhead);
+    evaluation_init(opt_evaluation_rate, evaluation_budget);
+    result_cache_init(opt_result_cache);
+    container_init(container_mode, opt_container_block_size, opt_read_threads);
+    aggregation_init(opt_aggregators, opt_container_block_size,
+                     opt_aggregator_threads);
     init_compressors();
 
-    if (opt_inferencing)
-        init_ml(opt_model_path, opt_setting_path);
+    if (opt_test_compression && opt_async_workers > 0)
+        async_analysis_init(opt_async_workers,
+                            (size_t)opt_async_buffer * 1024 * 1024,
+                            async_policy);
 }
 
 static void fin() __attribute__((destructor));
 void fin() {
     g_hash_table_destroy(trackingDB_fh);
     g_array_free(trackingDB_io, TRUE);
-    if (opt_inferencing)
+    if (opt_inferencing) {
+        inference_batch_cleanup();
+        decision_cache_cleanup();
         cleanup_ml();
+        bandit_cleanup();
+    }
+    release_compression_contexts();
+    result_cache_cleanup();
     g_debug("...done");
 }
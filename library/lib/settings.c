@@ -6,12 +6,54 @@ gboolean opt_tracing = FALSE;
 gboolean opt_test_compression = FALSE;
 gboolean opt_inferencing = FALSE;
 gboolean opt_decompression = FALSE;
+gboolean opt_pruned_search = FALSE;
+gboolean opt_cache_cold = FALSE;
+gboolean opt_ort_shared_model = FALSE;
+gboolean opt_ort_global_threads = FALSE;
+gboolean opt_native_int8 = FALSE;
 gboolean _opt_action_required = FALSE;
 
 gint opt_min_chunk_size = 0;
 gint opt_repeat_measurements = 1;
+gint opt_analysis_threads = 1;
+gint opt_read_threads = 1;
+gint opt_container_block_size = 0;
+gint opt_aggregators = 0;
+gint opt_aggregator_threads = 1;
+gint opt_sample_blocks = 0;
+gint opt_sample_block_size = 1048576;
+gint opt_sample_min_size = 33554432;
+gint opt_async_workers = 0;
+gint opt_async_buffer = 256;
+gint opt_search_deadline = 0;
+gint opt_search_audit = 0;
+gint opt_result_cache = 0;
+gint opt_inference_batch = 1;
+gint opt_inference_wait = 10;
+gint opt_inference_windows = 1;
+gchar const *opt_inference_vote = "mean";
+gdouble opt_fallback_threshold = 0;
+gint opt_fallback_top_k = 2;
+gint opt_decision_reuse = 0;
+gint opt_model_reload = 0;
+gint opt_evaluation_rate = 1;
+gchar const *opt_evaluation_budget = NULL;
+gdouble opt_decision_drift = 0.05;
+gint opt_ort_intra_threads = 0;
+gint opt_ort_inter_threads = 0;
+gchar const *opt_async_policy = "block";
+gchar const *opt_max_overhead = NULL;
 gchar const *opt_meta_data_path = NULL;
 gchar const *opt_chunk_path = NULL;
 gchar const *opt_model_path = NULL;
 gchar const *opt_setting_path = NULL;
+gchar const *opt_selector = "model";
+gdouble opt_bandit_exploration = 0.2;
+gchar const *opt_bandit_state = NULL;
+gchar const *opt_container = "off";
+gchar const *opt_inference_backend = "onnx";
+gchar const *opt_ort_execution = "sequential";
+gchar const *opt_ort_optimization = "all";
+gchar const *opt_ort_optimized_model = NULL;
+gchar const *opt_ort_profile = NULL;
 Metric_Type opt_metric_inferencing;
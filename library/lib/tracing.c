@@ -1,9 +1,13 @@
+#include <inferencing/evaluation.h>
 #include <mpi.h>
 #include <tracing.h>
 
 GHashTable *trackingDB_fh;
 GArray *trackingDB_io;
 GArray *evaluation_ops;
+GArray *trace_counters;
+GHashTable *trace_counter_index;
+GArray *governor_decisions;
 gboolean stop_tracing = FALSE;
 
 gboolean tracing_stopped() { return stop_tracing; }
@@ -29,9 +33,16 @@ void add_compression_run(void *handler, const char *type, CompressionRun run,
     } else {
         strcpy(operation.compression.datatype, datatype_name);
     }
+    operation.compression.input_type = datatype_to_input_type(datatype);
     operation.compression.algorithm = run.algorithmID;
     operation.compression.metric = run.metric;
     operation.compression.metric_value = run.metric_value;
+    operation.compression.overhead = run.overhead;
+    operation.compression.sample_size = run.sample_size;
+    operation.compression.confidence = run.confidence;
+    operation.compression.timing = run.timing;
+    operation.compression.batch = run.batch;
+    operation.compression.cached = run.cached;
     operation.compression.level = run.level;
     operation.compression.count = count;
     operation.compression.size = buf_size;
@@ -79,21 +90,28 @@ void add_IO_operation(void *handler, const char *type, MPI_Datatype datatype,
     g_array_append_val(trackingDB_io, operation);
 }
 
-void add_evaluation_operation(size_t buf_size, CompressionSample predicted,
-                              CompressionSample tested) {
+void add_evaluation_operation(size_t buf_size, CompressionSample chosen,
+                              CompressionSample tested, Inference_Choice choice,
+                              gboolean cached) {
     Evaluation_Operation operation;
     operation.size = buf_size;
+    operation.choice = choice;
+    operation.cached = cached;
+    operation.sampling_rate = evaluation_rate();
     operation.mpi_rank = MPI_RANK;
     operation.time = time(NULL);
 
-    operation.metric = predicted.metric;
-    operation.compressor_predicted = predicted.compressor;
-    operation.predicted_metric_value = predicted.metric_value;
-    operation.predicted_compressed_size = predicted.compressed_size;
+    operation.metric = chosen.metric;
+    operation.compressor_predicted = choice.predicted.compressor;
+    operation.predicted_metric_value = choice.predicted.metric_value;
+    operation.predicted_compressed_size = choice.predicted.compressed_size;
+    operation.compressor_chosen = chosen.compressor;
+    operation.chosen_metric_value = chosen.metric_value;
+    operation.chosen_compressed_size = chosen.compressed_size;
 
     // Only store additional compressor if it performed better than the
-    // predicted one
-    if (tested.metric_value > predicted.metric_value) {
+    // chosen one
+    if (tested.metric_value > chosen.metric_value) {
         operation.compressor_tested = tested.compressor;
         operation.tested_metric_value = tested.metric_value;
         operation.tested_compressed_size = tested.compressed_size;
@@ -104,6 +122,168 @@ void add_evaluation_operation(size_t buf_size, CompressionSample predicted,
     g_array_append_val(evaluation_ops, operation);
 }
 
+void add_governor_decision(Governor_State state, int skip_interval,
+                           gfloat overhead, long write) {
+    Governor_Decision decision;
+    decision.time = time(NULL);
+    decision.write = write;
+    decision.state = state;
+    decision.skip_interval = skip_interval;
+    decision.overhead = overhead;
+    g_array_append_val(governor_decisions, decision);
+}
+
+// Counters keep their order in the array, the index maps names to positions
+void add_counter(const char *name, long value) {
+    gpointer position = g_hash_table_lookup(trace_counter_index, name);
+    if (position != NULL) {
+        Trace_Counter *counter = &g_array_index(
+            trace_counters, Trace_Counter, GPOINTER_TO_UINT(position) - 1);
+        counter->value += value;
+        return;
+    }
+    Trace_Counter new_counter;
+    g_strlcpy(new_counter.name, name, sizeof(new_counter.name));
+    new_counter.value = value;
+    g_array_append_val(trace_counters, new_counter);
+    g_hash_table_insert(trace_counter_index, (gpointer)g_intern_string(name),
+                        GUINT_TO_POINTER(trace_counters->len));
+}
+
+static void write_counters(hid_t file) {
+    hid_t memtype, name_type, space, dset, slabmemspace, plist_id;
+    hsize_t dims[1] = {0};
+    int count = trace_counters->len;
+
+    typedef struct counter_t {
+        int mpi_rank;
+        gchar name[100];
+        long value;
+    } counter_t;
+
+    int *offsets = (int *)calloc(MPI_SIZE, sizeof(int));
+    PMPI_Allgather(&count, 1, MPI_INT, offsets, 1, MPI_INT, MPI_COMM_WORLD);
+    hsize_t count_counters[1] = {count};
+    hsize_t offset_counters[1] = {0};
+    for (int r = 0; r < MPI_SIZE; ++r) {
+        dims[0] += offsets[r];
+        if (r < MPI_RANK)
+            offset_counters[0] += offsets[r];
+    }
+    free(offsets);
+
+    name_type = H5Tcopy(H5T_C_S1);
+    H5Tset_size(name_type, 100);
+    memtype = H5Tcreate(H5T_COMPOUND, sizeof(counter_t));
+    H5Tinsert(memtype, "MPI Rank", HOFFSET(counter_t, mpi_rank),
+              H5T_NATIVE_INT);
+    H5Tinsert(memtype, "Name", HOFFSET(counter_t, name), name_type);
+    H5Tinsert(memtype, "Value", HOFFSET(counter_t, value), H5T_NATIVE_LONG);
+
+    space = H5Screate_simple(1, dims, NULL);
+    dset = H5Dcreate(file, "Counters", memtype, space, H5P_DEFAULT,
+                     H5P_DEFAULT, H5P_DEFAULT);
+    H5Sclose(space);
+
+    counter_t *data = malloc(sizeof(counter_t) * count);
+    for (int i = 0; i < count; ++i) {
+        Trace_Counter *counter =
+            &g_array_index(trace_counters, Trace_Counter, i);
+        data[i].mpi_rank = MPI_RANK;
+        g_stpcpy(data[i].name, counter->name);
+        data[i].value = counter->value;
+    }
+
+    space = H5Dget_space(dset);
+    H5Sselect_hyperslab(space, H5S_SELECT_SET, offset_counters, NULL,
+                        count_counters, NULL);
+    plist_id = H5Pcreate(H5P_DATASET_XFER);
+    H5Pset_dxpl_mpio(plist_id, H5FD_MPIO_INDEPENDENT);
+    slabmemspace = H5Screate_simple(1, count_counters, NULL);
+    H5Dwrite(dset, memtype, slabmemspace, space, plist_id, data);
+
+    H5Sclose(space);
+    H5Pclose(plist_id);
+    H5Dclose(dset);
+    H5Sclose(slabmemspace);
+    H5Tclose(memtype);
+    H5Tclose(name_type);
+    free(data);
+}
+
+static void write_governor_decisions(hid_t file) {
+    hid_t memtype, state_type, space, dset, slabmemspace, plist_id;
+    hsize_t dims[1] = {0};
+    int count = governor_decisions->len;
+
+    typedef struct governor_t {
+        int mpi_rank;
+        time_t time;
+        long write;
+        gchar state[100];
+        int skip_interval;
+        gfloat overhead;
+    } governor_t;
+
+    int *offsets = (int *)calloc(MPI_SIZE, sizeof(int));
+    PMPI_Allgather(&count, 1, MPI_INT, offsets, 1, MPI_INT, MPI_COMM_WORLD);
+    hsize_t count_decisions[1] = {count};
+    hsize_t offset_decisions[1] = {0};
+    for (int r = 0; r < MPI_SIZE; ++r) {
+        dims[0] += offsets[r];
+        if (r < MPI_RANK)
+            offset_decisions[0] += offsets[r];
+    }
+    free(offsets);
+
+    state_type = H5Tcopy(H5T_C_S1);
+    H5Tset_size(state_type, 100);
+    memtype = H5Tcreate(H5T_COMPOUND, sizeof(governor_t));
+    H5Tinsert(memtype, "MPI Rank", HOFFSET(governor_t, mpi_rank),
+              H5T_NATIVE_INT);
+    H5Tinsert(memtype, "Timestamp", HOFFSET(governor_t, time),
+              H5T_NATIVE_LONG);
+    H5Tinsert(memtype, "Write", HOFFSET(governor_t, write), H5T_NATIVE_LONG);
+    H5Tinsert(memtype, "State", HOFFSET(governor_t, state), state_type);
+    H5Tinsert(memtype, "Skip Interval", HOFFSET(governor_t, skip_interval),
+              H5T_NATIVE_INT);
+    H5Tinsert(memtype, "Overhead [%]", HOFFSET(governor_t, overhead),
+              H5T_NATIVE_FLOAT);
+
+    space = H5Screate_simple(1, dims, NULL);
+    dset = H5Dcreate(file, "Governor", memtype, space, H5P_DEFAULT,
+                     H5P_DEFAULT, H5P_DEFAULT);
+    H5Sclose(space);
+
+    governor_t *data = malloc(sizeof(governor_t) * count);
+    for (int i = 0; i < count; ++i) {
+        Governor_Decision *decision =
+            &g_array_index(governor_decisions, Governor_Decision, i);
+        data[i].mpi_rank = MPI_RANK;
+        data[i].time = decision->time;
+        data[i].write = decision->write;
+        g_stpcpy(data[i].state, governor_state_name(decision->state));
+        data[i].skip_interval = decision->skip_interval;
+        data[i].overhead = decision->overhead * 100;
+    }
+
+    space = H5Dget_space(dset);
+    H5Sselect_hyperslab(space, H5S_SELECT_SET, offset_decisions, NULL,
+                        count_decisions, NULL);
+    plist_id = H5Pcreate(H5P_DATASET_XFER);
+    H5Pset_dxpl_mpio(plist_id, H5FD_MPIO_INDEPENDENT);
+    slabmemspace = H5Screate_simple(1, count_decisions, NULL);
+    H5Dwrite(dset, memtype, slabmemspace, space, plist_id, data);
+
+    H5Sclose(space);
+    H5Pclose(plist_id);
+    H5Dclose(dset);
+    H5Sclose(slabmemspace);
+    H5Tclose(memtype);
+    H5Tclose(state_type);
+    free(data);
+}
+
 void write_dataset() {
     int ret;
     hid_t file, memtype_IO, memtype_compression, memtype_evaluation, space,
@@ -114,7 +294,7 @@ void write_dataset() {
     hsize_t dims_compression[1];
     hsize_t dims_evaluation[1];
     hid_t operation_type, datatype_type, compressor_type, metric_type,
-        chunk_name_type;
+        chunk_name_type, input_type_type;
     int count_io_ops = 0, count_compression_ops = 0, count_evaluation_ops = 0;
     IO_Operation *io;
     Evaluation_Operation *eo;
@@ -137,6 +317,7 @@ void write_dataset() {
         time_t time;
         long duration;
         gchar datatype[MPI_MAX_DATAREP_STRING];
+        gchar input_type[100];
         long long mpi_offset;
         int mpi_rank;
         int count;
@@ -146,6 +327,15 @@ void write_dataset() {
         gchar metric_name[100];
         gfloat metric_value;
         gchar chunk_name[100];
+        long overhead;
+        long sample_size;
+        gfloat confidence;
+        long long median;
+        long long p10;
+        long long p90;
+        int batch;
+        int cache_cold;
+        int cached;
     } io_compression_t;
 
     typedef struct io_evaluation_t {
@@ -157,10 +347,18 @@ void write_dataset() {
         int compressor_predicted_level;
         gfloat predicted_metric_value;
         long compressed_size;
+        gchar compressor_chosen[100];
+        int compressor_chosen_level;
+        gfloat chosen_metric_value;
+        long chosen_size;
         gchar compressor_tested[100];
         int compressor_tested_level;
         gfloat tested_metric_value;
         long tested_size;
+        gfloat confidence;
+        int searched;
+        int cached;
+        gfloat sampling_rate;
     } io_evaluation_t;
 
     // Count number of items per operation type and process
@@ -263,6 +461,9 @@ void write_dataset() {
     chunk_name_type = H5Tcopy(H5T_C_S1);
     status = H5Tset_size(chunk_name_type, 100);
 
+    input_type_type = H5Tcopy(H5T_C_S1);
+    status = H5Tset_size(input_type_type, 100);
+
     status =
         H5Tinsert(memtype_compression, "Operation name",
                   HOFFSET(io_compression_t, operation_name), operation_type);
@@ -274,6 +475,8 @@ void write_dataset() {
                        HOFFSET(io_compression_t, duration), H5T_NATIVE_LONG);
     status = H5Tinsert(memtype_compression, "MPI Datatype",
                        HOFFSET(io_compression_t, datatype), datatype_type);
+    status = H5Tinsert(memtype_compression, "Input Type",
+                       HOFFSET(io_compression_t, input_type), input_type_type);
     status = H5Tinsert(memtype_compression, "MPI Offset",
                        HOFFSET(io_compression_t, mpi_offset), H5T_NATIVE_LLONG);
     status = H5Tinsert(memtype_compression, "Variable Count",
@@ -291,6 +494,25 @@ void write_dataset() {
     status =
         H5Tinsert(memtype_compression, "Metric Measurement",
                   HOFFSET(io_compression_t, metric_value), H5T_NATIVE_FLOAT);
+    status = H5Tinsert(memtype_compression, "Analysis Overhead [µs]",
+                       HOFFSET(io_compression_t, overhead), H5T_NATIVE_LONG);
+    status = H5Tinsert(memtype_compression, "Sample Size",
+                       HOFFSET(io_compression_t, sample_size), H5T_NATIVE_LONG);
+    status = H5Tinsert(memtype_compression, "Estimate Confidence",
+                       HOFFSET(io_compression_t, confidence),
+                       H5T_NATIVE_FLOAT);
+    status = H5Tinsert(memtype_compression, "Duration Median [ns]",
+                       HOFFSET(io_compression_t, median), H5T_NATIVE_LLONG);
+    status = H5Tinsert(memtype_compression, "Duration P10 [ns]",
+                       HOFFSET(io_compression_t, p10), H5T_NATIVE_LLONG);
+    status = H5Tinsert(memtype_compression, "Duration P90 [ns]",
+                       HOFFSET(io_compression_t, p90), H5T_NATIVE_LLONG);
+    status = H5Tinsert(memtype_compression, "Batch Size",
+                       HOFFSET(io_compression_t, batch), H5T_NATIVE_INT);
+    status = H5Tinsert(memtype_compression, "Cache Cold",
+                       HOFFSET(io_compression_t, cache_cold), H5T_NATIVE_INT);
+    status = H5Tinsert(memtype_compression, "Cached",
+                       HOFFSET(io_compression_t, cached), H5T_NATIVE_INT);
 
     space = H5Screate_simple(1, dims_compression, NULL);
     dset_compression = H5Dcreate(file, "Compression-Trace", memtype_compression,
@@ -319,6 +541,17 @@ void write_dataset() {
     status =
         H5Tinsert(memtype_evaluation, "Predicted Compressor: Size",
                   HOFFSET(io_evaluation_t, compressed_size), H5T_NATIVE_LONG);
+    status =
+        H5Tinsert(memtype_evaluation, "Chosen Compressor",
+                  HOFFSET(io_evaluation_t, compressor_chosen), compressor_type);
+    status = H5Tinsert(memtype_evaluation, "Chosen Level",
+                       HOFFSET(io_evaluation_t, compressor_chosen_level),
+                       H5T_NATIVE_INT);
+    status = H5Tinsert(
+        memtype_evaluation, "Chosen Compressor: Metric Measurement",
+        HOFFSET(io_evaluation_t, chosen_metric_value), H5T_NATIVE_FLOAT);
+    status = H5Tinsert(memtype_evaluation, "Chosen Compressor: Size",
+                       HOFFSET(io_evaluation_t, chosen_size), H5T_NATIVE_LONG);
     status =
         H5Tinsert(memtype_evaluation, "Ideal Compressor",
                   HOFFSET(io_evaluation_t, compressor_tested), compressor_type);
@@ -330,6 +563,15 @@ void write_dataset() {
         HOFFSET(io_evaluation_t, tested_metric_value), H5T_NATIVE_FLOAT);
     status = H5Tinsert(memtype_evaluation, "Ideal Compressor: Size",
                        HOFFSET(io_evaluation_t, tested_size), H5T_NATIVE_LONG);
+    status = H5Tinsert(memtype_evaluation, "Confidence",
+                       HOFFSET(io_evaluation_t, confidence), H5T_NATIVE_FLOAT);
+    status = H5Tinsert(memtype_evaluation, "Searched Compressors",
+                       HOFFSET(io_evaluation_t, searched), H5T_NATIVE_INT);
+    status = H5Tinsert(memtype_evaluation, "Cached",
+                       HOFFSET(io_evaluation_t, cached), H5T_NATIVE_INT);
+    status = H5Tinsert(memtype_evaluation, "Sampling Rate",
+                       HOFFSET(io_evaluation_t, sampling_rate),
+                       H5T_NATIVE_FLOAT);
 
     space = H5Screate_simple(1, dims_evaluation, NULL);
     dset_evaluation = H5Dcreate(file, "Evaluation", memtype_evaluation, space,
@@ -407,9 +649,29 @@ void write_dataset() {
 
             data_compression[data_compression_index].metric_value =
                 io->compression.metric_value;
+            data_compression[data_compression_index].overhead =
+                io->compression.overhead;
+            data_compression[data_compression_index].sample_size =
+                io->compression.sample_size;
+            data_compression[data_compression_index].confidence =
+                io->compression.confidence;
+            data_compression[data_compression_index].median =
+                io->compression.timing.median;
+            data_compression[data_compression_index].p10 =
+                io->compression.timing.p10;
+            data_compression[data_compression_index].p90 =
+                io->compression.timing.p90;
+            data_compression[data_compression_index].batch =
+                io->compression.batch;
+            data_compression[data_compression_index].cache_cold =
+                opt_cache_cold;
+            data_compression[data_compression_index].cached =
+                io->compression.cached;
 
             strcpy(data_compression[data_compression_index].datatype,
                    io->compression.datatype);
+            g_stpcpy(data_compression[data_compression_index].input_type,
+                     input_type_name(io->compression.input_type));
             ++data_compression_index;
         }
     }
@@ -428,6 +690,13 @@ void write_dataset() {
         data_evaluation[i].predicted_metric_value = eo->predicted_metric_value;
         data_evaluation[i].compressed_size = eo->predicted_compressed_size;
 
+        g_stpcpy(data_evaluation[i].compressor_chosen,
+                 compressor_to_name(eo->compressor_chosen.algorithm));
+        data_evaluation[i].compressor_chosen_level =
+            eo->compressor_chosen.level;
+        data_evaluation[i].chosen_metric_value = eo->chosen_metric_value;
+        data_evaluation[i].chosen_size = eo->chosen_compressed_size;
+
         if (eo->compressor_tested.algorithm != _COMPRESSOR_COUNT) {
             g_stpcpy(data_evaluation[i].compressor_tested,
                      compressor_to_name(eo->compressor_tested.algorithm));
@@ -441,6 +710,10 @@ void write_dataset() {
             data_evaluation[i].tested_metric_value = 0;
             data_evaluation[i].tested_size = 0;
         }
+        data_evaluation[i].confidence = eo->choice.confidence;
+        data_evaluation[i].searched = eo->choice.searched;
+        data_evaluation[i].cached = eo->cached;
+        data_evaluation[i].sampling_rate = eo->sampling_rate;
     }
 
     /* Write: IO-Traces */
@@ -501,6 +774,9 @@ void write_dataset() {
     free(data_compression);
     free(data_io);
     free(data_evaluation);
+
+    write_counters(file);
+    write_governor_decisions(file);
     PMPI_Barrier(MPI_COMM_WORLD);
     status = H5Fclose(file);
     if (status < 0) {
@@ -1,8 +1,15 @@
+#define _GNU_SOURCE
 #include <float.h>
+#include <glib.h>
 #include <math.h>
+#include <sched.h>
 #include <stddef.h>
 #include <util.h>
 
+static __thread cpu_set_t previous_affinity;
+static __thread int affinity_changed = 0;
+static gint oversubscription_warned = 0;
+
 long long timeInMilliseconds() {
     struct timeval tv;
 
@@ -10,6 +17,15 @@ long long timeInMilliseconds() {
     return (((long long)tv.tv_sec) * 1000) + (tv.tv_usec / 1000);
 }
 
+// Monotonic clock, read from the TSC through the vDSO on x86-64 Linux
+long long timeInNanoseconds() {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+        return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    else
+        return 0;
+}
+
 long timeInMicroseconds() {
     struct timespec ts;
     // TODO: Prepare @ Setup
@@ -19,6 +35,39 @@ long timeInMicroseconds() {
         return 0;
 }
 
+void pin_current_thread(int worker, int workers) {
+    cpu_set_t affinity;
+    if (sched_getaffinity(0, sizeof(previous_affinity), &previous_affinity))
+        return;
+
+    // Pinning more workers than cores would stack them on the same cores
+    int cores = CPU_COUNT(&previous_affinity);
+    if (workers > cores) {
+        if (g_atomic_int_compare_and_exchange(&oversubscription_warned, 0, 1))
+            g_warning("%d analysis threads but only %d cores, not pinning",
+                      workers, cores);
+        return;
+    }
+
+    // Choose the n-th core of the cores the thread is allowed to run on
+    int target = worker;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &previous_affinity) && target-- == 0) {
+            CPU_ZERO(&affinity);
+            CPU_SET(cpu, &affinity);
+            affinity_changed =
+                sched_setaffinity(0, sizeof(affinity), &affinity) == 0;
+            return;
+        }
+    }
+}
+
+void unpin_current_thread() {
+    if (affinity_changed)
+        sched_setaffinity(0, sizeof(previous_affinity), &previous_affinity);
+    affinity_changed = 0;
+}
+
 void softmax(float *input, int elem, float *out) {
     float sum = 0.0;
     for (int i = 0; i < elem; ++i) {
@@ -40,4 +89,21 @@ int max_value_index(float *array, int size) {
         }
     }
     return index;
-}
\ No newline at end of file
+}
+
+// Types of a file view are only freed if they aren't predefined
+void free_view_type(MPI_Datatype type) {
+    int integers, addresses, datatypes, combiner;
+    MPI_Type_get_envelope(type, &integers, &addresses, &datatypes, &combiner);
+    if (combiner != MPI_COMBINER_NAMED)
+        MPI_Type_free(&type);
+}
+
+// Types whose data starts at 0 and has no gaps, so counts of them are too
+int contiguous_type(MPI_Datatype type) {
+    MPI_Count size, lb, extent, true_lb, true_extent;
+    MPI_Type_size_x(type, &size);
+    MPI_Type_get_extent_x(type, &lb, &extent);
+    MPI_Type_get_true_extent_x(type, &true_lb, &true_extent);
+    return size == extent && size == true_extent && lb == 0 && true_lb == 0;
+}
@@ -0,0 +1,99 @@
+#include <container.h>
+#include <glib.h>
+#include <mpi.h>
+#include <stdio.h>
+#include <string.h>
+/*
+Collective container writes through subarray views. Every rank owns a block
+of columns of a row major array, so the runs of all ranks interleave in the
+file. The aggregator has to sort them by offset before it joins them into
+regions. The array is read back by rows and through the same views.
+
+IOA_OPTIONS="--container=replace --aggregators=1 ..." \
+mpiexec -n 2 ./bld/aggregation-view /tmp/aggregation-view
+*/
+
+#define ROWS 300
+#define COLUMNS 500
+
+static float value(int row, int column) { return row * 0.5f - column; }
+
+static int check_rows(MPI_File fh, int rank, int size) {
+    int wrong = 0;
+    size_t width = (size_t)COLUMNS * size;
+    float *row = g_new(float, width);
+    for (int r = rank; r < ROWS; r += size) {
+        MPI_File_read_at(fh, r * width * sizeof(float), row, width, MPI_FLOAT,
+                         MPI_STATUS_IGNORE);
+        for (size_t c = 0; c < width; ++c)
+            wrong += row[c] != value(r, c);
+    }
+    g_free(row);
+    return wrong;
+}
+
+static int check_view(MPI_File fh, MPI_Datatype view, int rank) {
+    int wrong = 0, count;
+    float *local = g_new0(float, ROWS * COLUMNS);
+    MPI_Status status;
+    MPI_File_set_view(fh, 0, MPI_FLOAT, view, "native", MPI_INFO_NULL);
+    MPI_File_read_all(fh, local, ROWS * COLUMNS, MPI_FLOAT, &status);
+    MPI_Get_count(&status, MPI_FLOAT, &count);
+    wrong += count != ROWS * COLUMNS;
+    for (int r = 0; r < ROWS; ++r) {
+        for (int c = 0; c < COLUMNS; ++c)
+            wrong += local[r * COLUMNS + c] != value(r, COLUMNS * rank + c);
+    }
+    g_free(local);
+    return wrong;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        g_printerr("usage: %s PATH\n", argv[0]);
+        return 1;
+    }
+    MPI_Init(&argc, &argv);
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    int sizes[2] = {ROWS, COLUMNS * size};
+    int subsizes[2] = {ROWS, COLUMNS};
+    int starts[2] = {0, COLUMNS * rank};
+    MPI_Datatype view;
+    MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C,
+                             MPI_FLOAT, &view);
+    MPI_Type_commit(&view);
+
+    float *local = g_new(float, ROWS * COLUMNS);
+    for (int r = 0; r < ROWS; ++r) {
+        for (int c = 0; c < COLUMNS; ++c)
+            local[r * COLUMNS + c] = value(r, COLUMNS * rank + c);
+    }
+    MPI_File fh;
+    if (rank == 0) {
+        gchar *container = g_strconcat(argv[1], CONTAINER_SUFFIX, NULL);
+        MPI_File_delete(argv[1], MPI_INFO_NULL);
+        MPI_File_delete(container, MPI_INFO_NULL);
+        g_free(container);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    MPI_File_open(MPI_COMM_WORLD, argv[1], MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                  MPI_INFO_NULL, &fh);
+    MPI_File_set_view(fh, 0, MPI_FLOAT, view, "native", MPI_INFO_NULL);
+    MPI_File_write_all(fh, local, ROWS * COLUMNS, MPI_FLOAT,
+                       MPI_STATUS_IGNORE);
+    MPI_File_close(&fh);
+
+    MPI_File_open(MPI_COMM_WORLD, argv[1], MPI_MODE_RDONLY, MPI_INFO_NULL,
+                  &fh);
+    int wrong = check_rows(fh, rank, size) + check_view(fh, view, rank);
+    MPI_File_close(&fh);
+    MPI_Allreduce(MPI_IN_PLACE, &wrong, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0 && wrong > 0)
+        g_printerr("%d values read back wrong\n", wrong);
+    MPI_Type_free(&view);
+    g_free(local);
+    MPI_Finalize();
+    return wrong > 0;
+}
@@ -0,0 +1,91 @@
+#include <container.h>
+#include <glib.h>
+#include <mpi.h>
+#include <stdio.h>
+#include <string.h>
+/*
+Empty writes with the bandit choosing the compressors. Every rank writes its
+region between writes of nothing, some of them with a NULL buffer, and a
+collective write in which only odd ranks write. The bandit has to skip the
+empty writes and the file has to read back as written.
+
+IOA_OPTIONS="--selector=bandit --container=replace ..." \
+mpiexec -n 2 ./bld/bandit-empty-write /tmp/bandit-empty-write
+*/
+
+// Elements of the region of every rank
+#define REGION 20000
+
+static float value(int rank, int element) {
+    return rank * 0.5f + (element % 1024) * 0.25f;
+}
+
+static int check_file(MPI_File fh, int size) {
+    int wrong = 0;
+    float *data = g_new(float, REGION);
+    for (int r = 0; r < 2 * size; ++r) {
+        // Even ranks left their collective region empty
+        if (r >= size && (r - size) % 2 == 0)
+            continue;
+        memset(data, 0, REGION * sizeof(float));
+        MPI_File_read_at(fh, (MPI_Offset)r * REGION * sizeof(float), data,
+                         REGION, MPI_FLOAT, MPI_STATUS_IGNORE);
+        for (int i = 0; i < REGION; ++i)
+            wrong += data[i] != value(r, i);
+    }
+    g_free(data);
+    return wrong;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        g_printerr("usage: %s PATH\n", argv[0]);
+        return 1;
+    }
+    MPI_Init(&argc, &argv);
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    MPI_File fh;
+    if (rank == 0) {
+        gchar *container = g_strconcat(argv[1], CONTAINER_SUFFIX, NULL);
+        MPI_File_delete(argv[1], MPI_INFO_NULL);
+        MPI_File_delete(container, MPI_INFO_NULL);
+        g_free(container);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    MPI_File_open(MPI_COMM_WORLD, argv[1], MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                  MPI_INFO_NULL, &fh);
+    float *data = g_new(float, REGION);
+    MPI_Offset offset = (MPI_Offset)rank * REGION * sizeof(float);
+    MPI_Request request;
+    MPI_File_write_at(fh, offset, NULL, 0, MPI_FLOAT, MPI_STATUS_IGNORE);
+    for (int i = 0; i < REGION; ++i)
+        data[i] = value(rank, i);
+    MPI_File_write_at(fh, offset, data, REGION, MPI_FLOAT, MPI_STATUS_IGNORE);
+    MPI_File_write_at(fh, offset + sizeof(float), data, 0, MPI_FLOAT,
+                      MPI_STATUS_IGNORE);
+    MPI_File_iwrite_at(fh, offset, NULL, 0, MPI_FLOAT, &request);
+    MPI_Wait(&request, MPI_STATUS_IGNORE);
+
+    int count = rank % 2 == 1 ? REGION : 0;
+    offset = (MPI_Offset)(size + rank) * REGION * sizeof(float);
+    for (int i = 0; i < REGION; ++i)
+        data[i] = value(size + rank, i);
+    MPI_File_write_at_all(fh, offset, count > 0 ? data : NULL, count,
+                          MPI_FLOAT, MPI_STATUS_IGNORE);
+    MPI_File_write_at_all(fh, 0, NULL, 0, MPI_FLOAT, MPI_STATUS_IGNORE);
+    g_free(data);
+    MPI_File_close(&fh);
+
+    MPI_File_open(MPI_COMM_WORLD, argv[1], MPI_MODE_RDONLY, MPI_INFO_NULL,
+                  &fh);
+    int wrong = check_file(fh, size);
+    MPI_File_close(&fh);
+    MPI_Allreduce(MPI_IN_PLACE, &wrong, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0 && wrong > 0)
+        g_printerr("%d values read back wrong\n", wrong);
+    MPI_Finalize();
+    return wrong > 0;
+}
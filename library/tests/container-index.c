@@ -0,0 +1,132 @@
+#include <container.h>
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+/*
+Builds the index of random, partly overlapping blocks and compares lookups
+with a scan over all blocks, in memory and mapped from a container file that
+holds only the header, the index and the footer.
+
+./bld/container-index /tmp/container-index.ioa
+*/
+
+#define BLOCKS 2000
+#define LOOKUPS 20000
+#define FILE_SIZE (1 << 24)
+
+static int check_index(const Container_Index *index) {
+    int wrong = 0;
+    guint64 max_end = 0;
+    for (guint64 i = 0; i < index->count; ++i) {
+        const Container_Index_Entry *block = &index->blocks[i];
+        wrong += i > 0 && index->blocks[i - 1].offset > block->offset;
+        max_end = MAX(max_end, block->offset + block->raw_size);
+        wrong += block->max_end != max_end;
+
+        // Blocks are sorted, so only ends of earlier ones can reach into it
+        gboolean overlapped = FALSE;
+        for (guint64 j = 0; j < index->count; ++j) {
+            const Container_Index_Entry *a = &index->blocks[MIN(i, j)];
+            const Container_Index_Entry *b = &index->blocks[MAX(i, j)];
+            overlapped |= j != i && a->offset + a->raw_size > b->offset;
+        }
+        wrong += block->overlapped != overlapped;
+    }
+    wrong += index->size != max_end;
+    return wrong;
+}
+
+// Every block the range touches lies between first and last
+static int check_lookups(const Container_Index *index, GRand *rand) {
+    int wrong = 0;
+    for (int l = 0; l < LOOKUPS; ++l) {
+        guint64 start = g_rand_int_range(rand, 0, FILE_SIZE);
+        guint64 end = start + g_rand_int_range(rand, 1, 1 << 16);
+        guint64 first, last;
+        container_index_find(index, start, end, &first, &last);
+        wrong += first > last || last > index->count;
+        for (guint64 i = 0; i < index->count; ++i) {
+            const Container_Index_Entry *block = &index->blocks[i];
+            gboolean touches = block->offset < end &&
+                               block->offset + block->raw_size > start;
+            wrong += (i < first) == (block->max_end > start);
+            wrong += (i < last) != (block->offset < end);
+            wrong += touches && (i < first || i >= last);
+        }
+    }
+    return wrong;
+}
+
+static gboolean write_container(const char *path,
+                                const Container_Index *index) {
+    Container_Header header = {{'I', 'O', 'A', 'C', 'N', 'T', '0', '1'},
+                               1, sizeof(Container_Block_Header)};
+    Container_Footer footer;
+    guint64 position = (sizeof(header) + 7) & ~(guint64)7;
+    container_footer_init(&footer, position, index->count, index->size);
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+        return FALSE;
+    static const char padding[8] = {0};
+    size_t padding_size = position - sizeof(header);
+    gboolean written =
+        fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(padding, 1, padding_size, file) == padding_size &&
+        fwrite(index->blocks, sizeof(Container_Index_Entry), index->count,
+               file) == index->count &&
+        fwrite(&footer, sizeof(footer), 1, file) == 1;
+    return fclose(file) == 0 && written;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        g_printerr("usage: %s PATH\n", argv[0]);
+        return 1;
+    }
+    GRand *rand = g_rand_new_with_seed(42);
+    Container_Index index = {g_new0(Container_Index_Entry, BLOCKS), BLOCKS};
+    for (int i = 0; i < BLOCKS; ++i) {
+        Container_Index_Entry *block = &index.blocks[i];
+        block->offset = g_rand_int_range(rand, 0, FILE_SIZE);
+        // Some writes were empty
+        block->raw_size =
+            i % 50 == 0 ? 0 : g_rand_int_range(rand, 1, 1 << 14);
+        block->data = i;
+        block->compressed_size = block->raw_size;
+        block->algorithm = CONTAINER_STORED;
+    }
+    container_index_build(&index);
+    int wrong = check_index(&index) + check_lookups(&index, rand);
+
+    Container_Index mapped = {0};
+    if (!write_container(argv[1], &index) ||
+        !container_index_map(argv[1], &mapped)) {
+        g_printerr("Can't map the index written to %s\n", argv[1]);
+        ++wrong;
+    } else {
+        wrong += mapped.count != index.count || mapped.size != index.size ||
+                 memcmp(mapped.blocks, index.blocks,
+                        index.count * sizeof(Container_Index_Entry)) != 0;
+        wrong += check_lookups(&mapped, rand);
+        container_index_free(&mapped);
+    }
+
+    // A container without a valid footer has no index to map
+    FILE *file = fopen(argv[1], "r+b");
+    if (file != NULL) {
+        fseek(file, -(long)sizeof(Container_Footer), SEEK_END);
+        fputc('X', file);
+        fclose(file);
+    }
+    if (container_index_map(argv[1], &mapped)) {
+        g_printerr("Mapped an index without a valid footer\n");
+        container_index_free(&mapped);
+        ++wrong;
+    }
+
+    if (wrong > 0)
+        g_printerr("%d index checks failed\n", wrong);
+    container_index_free(&index);
+    g_rand_free(rand);
+    return wrong > 0;
+}
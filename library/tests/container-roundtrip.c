@@ -0,0 +1,125 @@
+#include <container.h>
+#include <glib.h>
+#include <mpi.h>
+#include <stdio.h>
+#include <string.h>
+/*
+Writes through a container and reads the file back. Every rank writes its
+region, overwrites a part of it and writes nothing once. The file is then
+reopened, which keeps the blocks, and a write across the earlier ones is
+appended. Later writes have to win where blocks overlap, with one block per
+write and split into blocks.
+
+IOA_OPTIONS="--container=replace --container-block-size=4 ..." \
+mpiexec -n 2 ./bld/container-roundtrip /tmp/container-roundtrip
+*/
+
+// Elements of the region of every rank
+#define REGION 50000
+
+typedef struct {
+    int generation;
+    // In elements from the start of the region
+    int start;
+    int count;
+} Region_Write;
+
+static const Region_Write first_writes[] = {
+    {0, 0, REGION},
+    // Overlaps the first write
+    {1, REGION / 3, REGION / 4},
+    {2, 17, 0},
+};
+
+// Spans the end of the overlap after the file is reopened
+static const Region_Write reopened_write = {3, REGION / 2, REGION / 3};
+
+static float value(int generation, int rank, int element) {
+    return generation * 1000.0f + rank * 0.5f + (element % 4096) * 0.25f;
+}
+
+static void write_region(MPI_File fh, int rank, Region_Write w) {
+    float *data = g_new(float, MAX(w.count, 1));
+    for (int i = 0; i < w.count; ++i)
+        data[i] = value(w.generation, rank, w.start + i);
+    MPI_Offset offset = ((MPI_Offset)rank * REGION + w.start) * sizeof(float);
+    MPI_File_write_at(fh, offset, data, w.count, MPI_FLOAT,
+                      MPI_STATUS_IGNORE);
+    g_free(data);
+}
+
+static void apply(float *expected, int rank, Region_Write w) {
+    for (int i = 0; i < w.count; ++i)
+        expected[(size_t)rank * REGION + w.start + i] =
+            value(w.generation, rank, w.start + i);
+}
+
+static int check_file(MPI_File fh, int size) {
+    size_t total = (size_t)REGION * size;
+    float *expected = g_new(float, total);
+    for (int r = 0; r < size; ++r) {
+        for (int w = 0; w < G_N_ELEMENTS(first_writes); ++w)
+            apply(expected, r, first_writes[w]);
+        apply(expected, r, reopened_write);
+    }
+
+    int wrong = 0, count;
+    MPI_Status status;
+    float *data = g_new0(float, total);
+    MPI_File_read_at(fh, 0, data, total, MPI_FLOAT, &status);
+    MPI_Get_count(&status, MPI_FLOAT, &count);
+    wrong += count != total;
+    for (size_t i = 0; i < total; ++i)
+        wrong += data[i] != expected[i];
+
+    // A range that starts and ends inside of blocks
+    size_t start = REGION / 3 - 5, length = REGION / 2;
+    memset(data, 0, length * sizeof(float));
+    MPI_File_read_at(fh, start * sizeof(float), data, length, MPI_FLOAT,
+                     MPI_STATUS_IGNORE);
+    for (size_t i = 0; i < length; ++i)
+        wrong += data[i] != expected[start + i];
+    g_free(data);
+    g_free(expected);
+    return wrong;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        g_printerr("usage: %s PATH\n", argv[0]);
+        return 1;
+    }
+    MPI_Init(&argc, &argv);
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    MPI_File fh;
+    if (rank == 0) {
+        gchar *container = g_strconcat(argv[1], CONTAINER_SUFFIX, NULL);
+        MPI_File_delete(argv[1], MPI_INFO_NULL);
+        MPI_File_delete(container, MPI_INFO_NULL);
+        g_free(container);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    MPI_File_open(MPI_COMM_WORLD, argv[1], MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                  MPI_INFO_NULL, &fh);
+    for (int w = 0; w < G_N_ELEMENTS(first_writes); ++w)
+        write_region(fh, rank, first_writes[w]);
+    MPI_File_close(&fh);
+
+    MPI_File_open(MPI_COMM_WORLD, argv[1], MPI_MODE_WRONLY, MPI_INFO_NULL,
+                  &fh);
+    write_region(fh, rank, reopened_write);
+    MPI_File_close(&fh);
+
+    MPI_File_open(MPI_COMM_WORLD, argv[1], MPI_MODE_RDONLY, MPI_INFO_NULL,
+                  &fh);
+    int wrong = check_file(fh, size);
+    MPI_File_close(&fh);
+    MPI_Allreduce(MPI_IN_PLACE, &wrong, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0 && wrong > 0)
+        g_printerr("%d values read back wrong\n", wrong);
+    MPI_Finalize();
+    return wrong > 0;
+}
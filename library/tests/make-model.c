@@ -0,0 +1,37 @@
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+/*
+Writes a native model and its settings file for the tests. The model has one
+layer without weights whose bias always selects the first label, ZSTD:1.
+
+./bld/make-model model.weights settings.txt
+*/
+
+#define INPUTS 64
+#define LABELS 3
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        g_printerr("usage: %s MODEL SETTINGS\n", argv[0]);
+        return 1;
+    }
+    guint32 layers = 1;
+    guint32 shape[2] = {INPUTS, LABELS};
+    float weights[INPUTS * LABELS] = {0};
+    float bias[LABELS] = {1, 0, 0};
+    GString *model = g_string_new_len("IOAMLP01", 8);
+    g_string_append_len(model, (const char *)&layers, sizeof(layers));
+    g_string_append_len(model, (const char *)shape, sizeof(shape));
+    g_string_append_len(model, (const char *)weights, sizeof(weights));
+    g_string_append_len(model, (const char *)bias, sizeof(bias));
+    gchar *settings = g_strdup_printf(
+        "Compression Rate\n%d\n\nZSTD:1\nLZ4:9\nZLIB:6\n", INPUTS);
+
+    gboolean written =
+        g_file_set_contents(argv[1], model->str, model->len, NULL) &&
+        g_file_set_contents(argv[2], settings, -1, NULL);
+    g_string_free(model, TRUE);
+    g_free(settings);
+    return written ? 0 : 1;
+}
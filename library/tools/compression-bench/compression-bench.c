@@ -0,0 +1,410 @@
+#include <analysis/cache.h>
+#include <analysis/compression.h>
+#include <compression-bench.h>
+#include <glib.h>
+#include <lz4.h>
+#include <lz4hc.h>
+#include <math.h>
+#include <settings.h>
+#include <stdio.h>
+#include <util.h>
+#include <zlib.h>
+#include <zstd.h>
+/*
+Compares the one-shot compression APIs (previous implementation) against the
+per-thread cached contexts used by the CompressionAlgorithm vtable.
+
+./bld/compression-bench [--iterations=N] [chunk file]
+
+Without a chunk file a smooth float field with noise is generated.
+
+With --sampling, the block-sampled estimates of test_algorithms are
+validated against the full-buffer results instead:
+
+./bld/compression-bench --sampling [--size=MiB] [--blocks=N] [--block-size=B]
+                        [chunk file]
+
+With --search, the pruned search of best_compressor is compared against the
+exhaustive one:
+
+./bld/compression-bench --search [--size=MiB] [chunk file]
+
+With --timing, the measurements of test_algorithms are shown for small
+chunks, where a single call is below the clock resolution:
+
+./bld/compression-bench --timing [--repeat=N] [--cache-cold] [chunk file]
+
+With --cache, an output phase with a constant field, an unchanged mask and an
+evolving field is analyzed with and without the result cache:
+
+./bld/compression-bench --cache [--size=MiB] [--steps=N]
+*/
+
+static gint opt_iterations = 0;
+static gboolean opt_sampling = FALSE;
+static gboolean opt_search = FALSE;
+static gboolean opt_timing = FALSE;
+static gboolean opt_cache = FALSE;
+static gint opt_steps = 10;
+static gint opt_size = 256;
+static gint opt_blocks = 16;
+static gint opt_block_size = 1048576;
+
+static const size_t buffer_sizes[] = {4 * 1024, 64 * 1024, 4 * 1024 * 1024};
+static const size_t chunk_sizes[] = {16, 256, 4 * 1024};
+
+size_t compress_one_shot(CompressionAlgorithmID id, void *dst,
+                         size_t dstCapacity, const void *src, size_t srcSize,
+                         int level) {
+    uLongf zlib_size = dstCapacity;
+    switch (id) {
+    case LZ4:
+        return LZ4_compress_HC(src, dst, srcSize, dstCapacity, level);
+    case LZ4_FAST:
+        return LZ4_compress_fast(src, dst, srcSize, dstCapacity, level);
+    case ZSTD:
+        return ZSTD_compress(dst, dstCapacity, src, srcSize, level);
+    case ZLIB:
+        compress2(dst, &zlib_size, src, srcSize, level);
+        return zlib_size;
+    default:
+        return 0;
+    }
+}
+
+char *generate_input(size_t size) {
+    float *data = g_malloc(size);
+    GRand *rand = g_rand_new_with_seed(42);
+    for (size_t i = 0; i < size / sizeof(float); ++i) {
+        data[i] = sin(i / 256.0) * 100.0 + g_rand_double(rand);
+    }
+    g_rand_free(rand);
+    return (char *)data;
+}
+
+// Checkpoint-like buffer: zero halo, smooth field, noisy field
+char *generate_checkpoint(size_t size) {
+    size_t elements = size / sizeof(float);
+    float *data = g_malloc(size);
+    GRand *rand = g_rand_new_with_seed(42);
+    for (size_t i = 0; i < elements; ++i) {
+        if (i < elements / 8)
+            data[i] = 0.0;
+        else if (i < elements / 2)
+            data[i] = sin(i / 4096.0) * 100.0;
+        else
+            data[i] = sin(i / 256.0) * 100.0 + g_rand_double(rand);
+    }
+    g_rand_free(rand);
+    return (char *)data;
+}
+
+char *fill_input(const char *content, size_t content_size, size_t size) {
+    char *data = g_malloc(size);
+    for (size_t o = 0; o < size; o += content_size) {
+        memcpy(data + o, content, MIN(content_size, size - o));
+    }
+    return data;
+}
+
+static CompressionRun *winner(GList *runs, Metric_Type metric) {
+    CompressionRun *best = NULL;
+    for (GList *l = runs; l != NULL; l = l->next) {
+        CompressionRun *run = l->data;
+        if (run->metric == metric &&
+            (best == NULL || run->metric_value > best->metric_value))
+            best = run;
+    }
+    return best;
+}
+
+static CompressionRun *find_run(GList *runs, CompressionRun *other) {
+    for (GList *l = runs; l != NULL; l = l->next) {
+        CompressionRun *run = l->data;
+        if (run->metric == other->metric &&
+            run->algorithmID == other->algorithmID &&
+            run->level == other->level)
+            return run;
+    }
+    return NULL;
+}
+
+int validate_sampling(const char *buf, size_t size) {
+    opt_store_chunks = FALSE;
+
+    opt_sample_blocks = 0;
+    long s_full = timeInMicroseconds();
+    GList *full = test_algorithms(MPI_FILE_NULL, buf, size, MPI_BYTE);
+    long e_full = timeInMicroseconds() - s_full;
+
+    opt_sample_blocks = opt_blocks;
+    opt_sample_block_size = opt_block_size;
+    opt_sample_min_size = 0;
+    long s_sampled = timeInMicroseconds();
+    GList *sampled = test_algorithms(MPI_FILE_NULL, buf, size, MPI_BYTE);
+    long e_sampled = timeInMicroseconds() - s_sampled;
+
+    g_print("%-10s %5s %10s %10s %8s %12s %12s %10s\n", "Compressor",
+            "Level", "CR", "CR (est.)", "Error", "MB/s", "MB/s (est.)",
+            "Confidence");
+    for (GList *l = full; l != NULL; l = l->next) {
+        CompressionRun *run = l->data;
+        if (run->metric != METRIC_CR)
+            continue;
+        CompressionRun *estimate = find_run(sampled, run);
+        CompressionRun speed = *run;
+        speed.metric = METRIC_COMPRESSION_SPEED;
+        if (estimate == NULL)
+            continue;
+        g_print("%-10s %5d %10.3f %10.3f %7.1f%% %12.1f %12.1f %10.3f\n",
+                compressor_to_name(run->algorithmID), run->level,
+                run->metric_value, estimate->metric_value,
+                100.0 * (estimate->metric_value - run->metric_value) /
+                    run->metric_value,
+                find_run(full, &speed)->metric_value / 1e6,
+                find_run(sampled, &speed)->metric_value / 1e6,
+                estimate->confidence);
+    }
+
+    g_print("\n%-26s %-14s %-14s\n", "Metric", "Full buffer", "Sampled");
+    for (int m = 0; m < _METRIC_COUNT; ++m) {
+        if (m == METRIC_DECOMPRESSION_SPEED && !opt_decompression)
+            continue;
+        CompressionRun *w_full = winner(full, m);
+        CompressionRun *w_sampled = winner(sampled, m);
+        g_print("%-26s %8s(%2d)     %8s(%2d)     %s\n", metric_enum_name(m),
+                compressor_to_name(w_full->algorithmID), w_full->level,
+                compressor_to_name(w_sampled->algorithmID), w_sampled->level,
+                w_full->algorithmID == w_sampled->algorithmID &&
+                        w_full->level == w_sampled->level
+                    ? "stable"
+                    : "changed");
+    }
+
+    g_print("\nAnalysis time: full %.3f s, sampled %.3f s (%.1fx)\n",
+            e_full / 1e6, e_sampled / 1e6, (double)e_full / e_sampled);
+    g_list_free_full(full, g_free);
+    g_list_free_full(sampled, g_free);
+    return 0;
+}
+
+int validate_search(const char *buf, size_t size) {
+    g_print("%-26s %-14s %10s %-14s %10s %8s %8s\n", "Metric", "Exhaustive",
+            "Time [s]", "Pruned", "Time [s]", "Speedup", "Regret");
+    for (int m = 0; m < _METRIC_COUNT; ++m) {
+        if (m == METRIC_DECOMPRESSION_SPEED && !opt_decompression)
+            continue;
+        opt_pruned_search = FALSE;
+        long s_exhaustive = timeInMicroseconds();
+        CompressionSample exhaustive = best_compressor(buf, size, m, NULL);
+        long e_exhaustive = timeInMicroseconds() - s_exhaustive;
+
+        opt_pruned_search = TRUE;
+        long s_pruned = timeInMicroseconds();
+        CompressionSample pruned = best_compressor(buf, size, m, NULL);
+        long e_pruned = timeInMicroseconds() - s_pruned;
+
+        // Both winners measured again, relative loss of the pruned one
+        opt_metric_inferencing = m;
+        gfloat v_exhaustive =
+            evaluate(exhaustive.compressor, buf, size).metric_value;
+        gfloat v_pruned = evaluate(pruned.compressor, buf, size).metric_value;
+
+        CompressionAlgorithm_Level *w_exhaustive = &exhaustive.compressor;
+        CompressionAlgorithm_Level *w_pruned = &pruned.compressor;
+        g_print("%-26s %8s(%2d)   %10.3f %8s(%2d)   %10.3f %7.1fx %7.1f%%\n",
+                metric_enum_name(m),
+                compressor_to_name(w_exhaustive->algorithm),
+                w_exhaustive->level, e_exhaustive / 1e6,
+                compressor_to_name(w_pruned->algorithm), w_pruned->level,
+                e_pruned / 1e6, (double)e_exhaustive / e_pruned,
+                100.0 * (v_exhaustive - v_pruned) / v_exhaustive);
+    }
+    return 0;
+}
+
+int show_timing(const gchar *content, gsize content_size) {
+    opt_store_chunks = FALSE;
+    g_print("%-10s %5s %6s %12s %12s %12s %6s %12s\n", "Compressor", "Level",
+            "Size", "P10 [ns]", "Median [ns]", "P90 [ns]", "Batch",
+            "MB/s");
+    for (int s = 0; s < COUNT_OF(chunk_sizes); ++s) {
+        size_t size = chunk_sizes[s];
+        char *buf = content_size > 0 ? fill_input(content, content_size, size)
+                                     : generate_input(size);
+        GList *runs = test_algorithms(MPI_FILE_NULL, buf, size, MPI_BYTE);
+        for (GList *l = g_list_last(runs); l != NULL; l = l->prev) {
+            CompressionRun *run = l->data;
+            if (run->metric != METRIC_COMPRESSION_SPEED)
+                continue;
+            g_print("%-10s %5d %6ld %12lld %12lld %12lld %6d %12.1f\n",
+                    compressor_to_name(run->algorithmID), run->level, size,
+                    run->timing.p10, run->timing.median, run->timing.p90,
+                    run->batch, run->metric_value / 1e6);
+        }
+        g_list_free_full(runs, g_free);
+        g_free(buf);
+    }
+    return 0;
+}
+
+// Analysis time of all steps, fields[2] changes in every step
+static long output_phase(char **fields, size_t size, int *cached) {
+    long s = timeInMicroseconds();
+    *cached = 0;
+    for (int step = 0; step < opt_steps; ++step) {
+        ((float *)fields[2])[step] += 1.0;
+        for (int f = 0; f < 3; ++f) {
+            GList *runs = test_algorithms(MPI_FILE_NULL, fields[f], size,
+                                          MPI_FLOAT);
+            *cached += runs && ((CompressionRun *)runs->data)->cached;
+            g_list_free_full(runs, g_free);
+        }
+    }
+    return timeInMicroseconds() - s;
+}
+
+int compare_cache(size_t size) {
+    opt_store_chunks = FALSE;
+    char *fields[3];
+    fields[0] = g_malloc0(size);
+    fields[1] = generate_input(size);
+    fields[2] = generate_checkpoint(size);
+    for (size_t i = 0; i < size; ++i)
+        fields[1][i] = fields[1][i] & 1;
+
+    int cached;
+    long uncached_time = output_phase(fields, size, &cached);
+    result_cache_init(16);
+    long cached_time = output_phase(fields, size, &cached);
+    result_cache_cleanup();
+
+    g_print("%d steps, 3 fields of %ld bytes\n", opt_steps, size);
+    g_print("Without cache: %.3f s\n", uncached_time / 1e6);
+    g_print("With cache:    %.3f s, %d of %d analyses reused (%.1fx)\n",
+            cached_time / 1e6, cached, 3 * opt_steps,
+            (double)uncached_time / cached_time);
+    for (int f = 0; f < 3; ++f)
+        g_free(fields[f]);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    GError *error = NULL;
+    GOptionContext *context;
+    static GOptionEntry entries[] = {
+        {"iterations", 'n', 0, G_OPTION_ARG_INT, &opt_iterations,
+         "Calls per measurement (default: scaled to buffer size)", "N"},
+        {"sampling", 's', 0, G_OPTION_ARG_NONE, &opt_sampling,
+         "Validate block-sampled estimates against full buffers"},
+        {"cache", 0, 0, G_OPTION_ARG_NONE, &opt_cache,
+         "Compare an output phase with and without the result cache"},
+        {"steps", 0, 0, G_OPTION_ARG_INT, &opt_steps,
+         "Output steps for --cache", "10"},
+        {"timing", 0, 0, G_OPTION_ARG_NONE, &opt_timing,
+         "Show measurements of small chunks"},
+        {"repeat", 'r', 0, G_OPTION_ARG_INT, &opt_repeat_measurements,
+         "Number of times to repeat measurements", "1"},
+        {"cache-cold", 0, 0, G_OPTION_ARG_NONE, &opt_cache_cold,
+         "Evict caches before every measurement"},
+        {"search", 0, 0, G_OPTION_ARG_NONE, &opt_search,
+         "Compare pruned against exhaustive best compressor search"},
+        {"size", 'S', 0, G_OPTION_ARG_INT, &opt_size,
+         "Buffer size in MiB for --sampling and --search", "256"},
+        {"blocks", 'k', 0, G_OPTION_ARG_INT, &opt_blocks,
+         "Sampled blocks for --sampling", "16"},
+        {"block-size", 'B', 0, G_OPTION_ARG_INT, &opt_block_size,
+         "Size of sampled blocks in bytes for --sampling", "1048576"},
+        {"decompression", 'd', 0, G_OPTION_ARG_NONE, &opt_decompression,
+         "Include decompression speed for --sampling"},
+        {NULL}};
+
+    context = g_option_context_new("[chunk file]");
+    g_option_context_add_main_entries(context, entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("CLI Error:%s\n", error->message);
+        return 1;
+    }
+
+    gchar *content = NULL;
+    gsize content_size = 0;
+    if (argc > 1 && !g_file_get_contents(argv[1], &content, &content_size,
+                                         NULL)) {
+        g_printerr("Can't open file: %s\n", argv[1]);
+        return 1;
+    }
+
+    init_compressors();
+    if (opt_cache) {
+        int ret = compare_cache((size_t)opt_size * 1024 * 1024);
+        g_free(content);
+        return ret;
+    }
+    if (opt_timing) {
+        int ret = show_timing(content, content_size);
+        g_free(content);
+        return ret;
+    }
+    if (opt_sampling || opt_search) {
+        size_t size = (size_t)opt_size * 1024 * 1024;
+        char *buf = content_size > 0 ? fill_input(content, content_size, size)
+                                     : generate_checkpoint(size);
+        int ret = opt_sampling ? validate_sampling(buf, size)
+                               : validate_search(buf, size);
+        g_free(buf);
+        g_free(content);
+        return ret;
+    }
+
+    g_print("%-10s %5s %10s %14s %14s %8s\n", "Compressor", "Level", "Size",
+            "One-shot [µs]", "Context [µs]", "Speedup");
+
+    for (int s = 0; s < COUNT_OF(buffer_sizes); ++s) {
+        size_t size = buffer_sizes[s];
+        char *buf = content_size > 0 ? fill_input(content, content_size, size)
+                                     : generate_input(size);
+        int iterations = opt_iterations > 0
+                             ? opt_iterations
+                             : MAX(4, (int)(64 * 1024 * 1024 / size));
+
+        for (int i = 0; i < available_compressors->len; ++i) {
+            CompressionAlgorithm *compressor =
+                &g_array_index(available_compressors, CompressionAlgorithm, i);
+            size_t max_bound = compressor->bound(size);
+            char *compressed_data = g_malloc(max_bound);
+
+            for (int l = 0; l < compressor->levels_count; ++l) {
+                int level = compressor->levels[l];
+                // Slow levels are measured less often on large buffers
+                int n = level > 9 && size > 64 * 1024 ? 4 : iterations;
+
+                long s_one_shot = timeInMicroseconds();
+                for (int t = 0; t < n; ++t)
+                    compress_one_shot(compressor->compression_id,
+                                      compressed_data, max_bound, buf, size,
+                                      level);
+                double one_shot =
+                    (timeInMicroseconds() - s_one_shot) / (double)n;
+
+                // Warm up the cached context before measuring
+                compressor->compress(compressed_data, max_bound, buf, size,
+                                     level);
+                long s_context = timeInMicroseconds();
+                for (int t = 0; t < n; ++t)
+                    compressor->compress(compressed_data, max_bound, buf, size,
+                                         level);
+                double cached = (timeInMicroseconds() - s_context) / (double)n;
+
+                g_print("%-10s %5d %10ld %14.2f %14.2f %7.2fx\n",
+                        compressor->name, level, size, one_shot, cached,
+                        cached > 0 ? one_shot / cached : 0.0);
+            }
+            g_free(compressed_data);
+        }
+        g_free(buf);
+    }
+
+    release_compression_contexts();
+    g_free(content);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,4 @@
+#ifndef IOA_TOOLS_COMPRESSION_BENCH_H
+#define IOA_TOOLS_COMPRESSION_BENCH_H
+#include <compression.h>
+#endif
\ No newline at end of file
@@ -0,0 +1,229 @@
+#include <container-bench.h>
+#include <glib.h>
+#include <math.h>
+#include <mpi.h>
+#include <settings.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <util.h>
+/*
+Measures random reads of a container through its seekable index. A few real
+blocks are written through the container, then the index is stretched so its
+entries cover a large original file, all pointing at these blocks. Lookups
+are timed on the mapped index, reads through MPI_File_read_at of the
+original file, which the library serves from the container.
+
+./bld/container-bench [--path=/tmp/container-bench] [--logical-size=GiB]
+                      [--block-size=KiB] [--blocks=N] [--reads=N]
+                      [--read-size=B] [--compressor=ZSTD] [--level=N]
+*/
+
+static gchar *opt_path = "/tmp/container-bench";
+static gint opt_logical_size = 100;
+static gint opt_block_kib = 64;
+static gint opt_blocks = 64;
+static gint opt_reads = 100000;
+static gint opt_read_size = 4096;
+static gchar *opt_compressor = "ZSTD";
+static gint opt_level = 1;
+
+// Smooth float field with noise, different for every block
+static void fill_block(char *block, size_t size, int seed) {
+    float *data = (float *)block;
+    GRand *rand = g_rand_new_with_seed(seed);
+    for (size_t i = 0; i < size / sizeof(float); ++i)
+        data[i] = sin((i + seed * 1000) / 256.0) * 100.0 + g_rand_double(rand);
+    g_rand_free(rand);
+}
+
+static void write_blocks(const char *path, char **raw, size_t block_size,
+                         CompressionAlgorithm_Level compressor) {
+    MPI_File fh;
+    MPI_File_open(MPI_COMM_SELF, path, MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                  MPI_INFO_NULL, &fh);
+    for (int i = 0; i < opt_blocks; ++i) {
+        Write_Target target = {fh, (MPI_Offset)i * block_size};
+        container_write(&target, raw[i], block_size, compressor, NULL, 0);
+    }
+    MPI_File_close(&fh);
+}
+
+/*
+ * Replaces the index with one of count blocks, in turn pointing at the written
+ * ones. Returns the size of the index in bytes.
+ */
+static guint64 stretch_index(const char *container_path, guint64 count,
+                             size_t block_size) {
+    Container_Index written;
+    if (!container_index_map(container_path, &written)) {
+        g_printerr("%s has no index\n", container_path);
+        exit(1);
+    }
+    guint64 position = (const char *)written.blocks -
+                       g_mapped_file_get_contents(written.mapped);
+    Container_Index index = {.count = count};
+    index.blocks = g_new(Container_Index_Entry, count);
+    for (guint64 i = 0; i < count; ++i) {
+        index.blocks[i] = written.blocks[i % written.count];
+        index.blocks[i].offset = i * block_size;
+    }
+    container_index_free(&written);
+    container_index_build(&index);
+
+    Container_Footer footer;
+    container_footer_init(&footer, position, index.count, index.size);
+    guint64 index_size = count * sizeof(Container_Index_Entry);
+    FILE *file = fopen(container_path, "r+b");
+    if (file == NULL || fseeko(file, position, SEEK_SET) != 0 ||
+        fwrite(index.blocks, 1, index_size, file) != index_size ||
+        fwrite(&footer, sizeof(footer), 1, file) != 1 ||
+        ftruncate(fileno(file), ftello(file)) != 0) {
+        g_printerr("Can't write the index of %s\n", container_path);
+        exit(1);
+    }
+    fclose(file);
+    container_index_free(&index);
+    return index_size + sizeof(footer);
+}
+
+static guint64 random_offset(GRand *rand, guint64 size) {
+    guint64 reads = size / opt_read_size;
+    guint64 r = ((guint64)g_rand_int(rand) << 32) | g_rand_int(rand);
+    return (r % reads) * opt_read_size;
+}
+
+// Mean time of a lookup in ns
+static double time_lookups(const char *container_path, guint64 *blocks_found) {
+    Container_Index index = {0};
+    if (!container_index_map(container_path, &index)) {
+        g_printerr("Can't map the index of %s\n", container_path);
+        exit(1);
+    }
+    GRand *rand = g_rand_new_with_seed(1);
+    *blocks_found = 0;
+    long start = timeInMicroseconds();
+    for (int i = 0; i < opt_reads; ++i) {
+        guint64 offset = random_offset(rand, index.size);
+        guint64 first, last;
+        container_index_find(&index, offset, offset + opt_read_size, &first,
+                             &last);
+        *blocks_found += last - first;
+    }
+    long elapsed = timeInMicroseconds() - start;
+    g_rand_free(rand);
+    container_index_free(&index);
+    return elapsed * 1000.0 / opt_reads;
+}
+
+// Mean time of a read in µs, wrong data is counted in errors
+static double time_reads(const char *path, char **raw, size_t block_size,
+                         double *open_time, int *errors) {
+    MPI_File fh;
+    long start = timeInMicroseconds();
+    MPI_File_open(MPI_COMM_SELF, path, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh);
+    *open_time = (timeInMicroseconds() - start) / 1e6;
+
+    guint64 size = (guint64)opt_logical_size * 1024 * 1024 * 1024;
+    char *buf = g_malloc(opt_read_size);
+    GRand *rand = g_rand_new_with_seed(2);
+    *errors = 0;
+    start = timeInMicroseconds();
+    for (int i = 0; i < opt_reads; ++i) {
+        guint64 offset = random_offset(rand, size);
+        MPI_Status status;
+        int count;
+        MPI_File_read_at(fh, offset, buf, opt_read_size, MPI_BYTE, &status);
+        MPI_Get_count(&status, MPI_BYTE, &count);
+        guint64 block = offset / block_size;
+        guint64 within = offset % block_size;
+        *errors += count != opt_read_size ||
+                   memcmp(buf, raw[block % opt_blocks] + within,
+                          MIN(opt_read_size, block_size - within)) != 0;
+    }
+    long elapsed = timeInMicroseconds() - start;
+    g_rand_free(rand);
+    g_free(buf);
+    MPI_File_close(&fh);
+    return (double)elapsed / opt_reads;
+}
+
+int main(int argc, char **argv) {
+    GError *error = NULL;
+    GOptionContext *context;
+    GOptionEntry entries[] = {
+        {"path", 0, 0, G_OPTION_ARG_FILENAME, &opt_path,
+         "Original file, the container is written next to it",
+         "/tmp/container-bench"},
+        {"logical-size", 0, 0, G_OPTION_ARG_INT, &opt_logical_size,
+         "Size of the original file in GiB", "100"},
+        {"block-size", 0, 0, G_OPTION_ARG_INT, &opt_block_kib,
+         "Container blocks in KiB", "64"},
+        {"blocks", 0, 0, G_OPTION_ARG_INT, &opt_blocks,
+         "Distinct blocks written", "64"},
+        {"reads", 0, 0, G_OPTION_ARG_INT, &opt_reads, "Random reads",
+         "100000"},
+        {"read-size", 0, 0, G_OPTION_ARG_INT, &opt_read_size,
+         "Bytes per read", "4096"},
+        {"compressor", 0, 0, G_OPTION_ARG_STRING, &opt_compressor,
+         "Compressor of the blocks", "ZSTD"},
+        {"level", 0, 0, G_OPTION_ARG_INT, &opt_level, "Compression level",
+         "1"},
+        {NULL}};
+    context = g_option_context_new("");
+    g_option_context_add_main_entries(context, entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("option parsing failed: %s\n", error->message);
+        return 1;
+    }
+    g_option_context_free(context);
+    init_compressors();
+    size_t block_size = (size_t)opt_block_kib * 1024;
+    guint64 size = (guint64)opt_logical_size * 1024 * 1024 * 1024;
+    CompressionAlgorithm_Level compressor = {
+        name_to_compressor(opt_compressor), opt_level};
+    if (compressor.algorithm == _COMPRESSOR_COUNT || opt_logical_size < 1 ||
+        opt_block_kib < 1 || opt_blocks < 1 || opt_reads < 1 ||
+        opt_read_size < 1 || size % block_size != 0) {
+        g_printerr("invalid options\n");
+        return 1;
+    }
+
+    MPI_Init(&argc, &argv);
+    // Containers are only written while inferencing
+    opt_inferencing = TRUE;
+    container_init(CONTAINER_REPLACE, opt_block_kib, 1);
+
+    char **raw = g_new(char *, opt_blocks);
+    for (int i = 0; i < opt_blocks; ++i) {
+        raw[i] = g_malloc(block_size);
+        fill_block(raw[i], block_size, i);
+    }
+    write_blocks(opt_path, raw, block_size, compressor);
+    gchar *container_path = g_strconcat(opt_path, CONTAINER_SUFFIX, NULL);
+    guint64 count = size / block_size;
+    guint64 index_size = stretch_index(container_path, count, block_size);
+
+    guint64 blocks_found;
+    double lookup = time_lookups(container_path, &blocks_found);
+    double open_time;
+    int errors;
+    double read = time_reads(opt_path, raw, block_size, &open_time, &errors);
+
+    g_print("Original file: %d GiB in %" G_GUINT64_FORMAT " blocks of %d "
+            "KiB, index %.1f MiB\n",
+            opt_logical_size, count, opt_block_kib,
+            index_size / (1024.0 * 1024.0));
+    g_print("Lookup (mapped index): %.0f ns, %.2f blocks per read\n", lookup,
+            (double)blocks_found / opt_reads);
+    g_print("Open (index read by rank 0): %.3f s\n", open_time);
+    g_print("Random %d B reads: %.1f us (%.0f reads/s), %d wrong\n",
+            opt_read_size, read, 1e6 / read, errors);
+
+    for (int i = 0; i < opt_blocks; ++i)
+        g_free(raw[i]);
+    g_free(raw);
+    g_free(container_path);
+    MPI_Finalize();
+    return errors > 0;
+}
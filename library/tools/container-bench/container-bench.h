@@ -0,0 +1,4 @@
+#ifndef IOA_TOOLS_CONTAINER_BENCH_H
+#define IOA_TOOLS_CONTAINER_BENCH_H
+#include <container.h>
+#endif
@@ -0,0 +1,144 @@
+#include <glib.h>
+#include <inference-bench.h>
+#include <mpi.h>
+#include <settings.h>
+#include <stdio.h>
+#include <tracing.h>
+#include <util.h>
+/*
+Compares the ONNX Runtime backend of predict_compressor against the native
+MLP on stored chunks, for latency and agreement of the predictions.
+
+./bld/inference-bench --model-path=compression-CR.onnx
+                      --weights-path=compression-CR.weights
+                      --settings-path=compression-CR-settings.txt
+                      [--repeat=N] [--batch=N] [--native-int8] chunk files
+*/
+
+static gchar *opt_onnx_path = NULL;
+static gchar *opt_weights_path = NULL;
+static gchar *opt_settings = NULL;
+static gint opt_repeat = 10;
+static gint opt_batch = 1;
+
+typedef struct {
+    gchar *name;
+    gchar *data;
+    gsize length;
+} Chunk;
+
+/*
+ * Predictions of all chunks, the latency is the mean per chunk in µs. The
+ * backend is torn down again, so the next run starts from a clean library.
+ */
+static double predict_all(const char *backend, const char *model_path,
+                          Chunk *chunks, int count,
+                          Prediction *predictions) {
+    opt_inference_backend = backend;
+    opt_inference_batch = opt_batch;
+    init_ml(model_path, opt_settings);
+
+    const void *data[opt_batch];
+    size_t lengths[opt_batch];
+    Input_Type types[opt_batch];
+    long start = timeInMicroseconds();
+    for (int r = 0; r < opt_repeat; ++r) {
+        for (int i = 0; i < count; i += opt_batch) {
+            int rows = MIN(opt_batch, count - i);
+            for (int b = 0; b < rows; ++b) {
+                data[b] = chunks[i + b].data;
+                lengths[b] = chunks[i + b].length;
+                types[b] = INPUT_FLOAT;
+            }
+            predict_compressors(data, lengths, types, rows, predictions + i);
+        }
+    }
+    long elapsed = timeInMicroseconds() - start;
+
+    cleanup_ml();
+    return (double)elapsed / ((double)opt_repeat * count);
+}
+
+int main(int argc, char **argv) {
+    GError *error = NULL;
+    GOptionContext *context;
+    GOptionEntry entries[] = {
+        {"model-path", 0, 0, G_OPTION_ARG_FILENAME, &opt_onnx_path,
+         "ONNX model", NULL},
+        {"weights-path", 0, 0, G_OPTION_ARG_FILENAME, &opt_weights_path,
+         "MLP weights exported with the model", NULL},
+        {"settings-path", 0, 0, G_OPTION_ARG_FILENAME, &opt_settings,
+         "Settings of the model", NULL},
+        {"repeat", 0, 0, G_OPTION_ARG_INT, &opt_repeat,
+         "Predictions of every chunk", "10"},
+        {"batch", 0, 0, G_OPTION_ARG_INT, &opt_batch,
+         "Chunks predicted at once", "1"},
+        {"native-int8", 0, 0, G_OPTION_ARG_NONE, &opt_native_int8,
+         "Quantize the native weights to int8", NULL},
+        {NULL}};
+    context = g_option_context_new("chunk files");
+    g_option_context_add_main_entries(context, entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("option parsing failed: %s\n", error->message);
+        return 1;
+    }
+    g_option_context_free(context);
+    if (opt_onnx_path == NULL || opt_weights_path == NULL ||
+        opt_settings == NULL || argc < 2 || opt_batch < 1 || opt_repeat < 1) {
+        g_printerr("model, weights, settings and chunk files are required\n");
+        return 1;
+    }
+
+    MPI_Init(&argc, &argv);
+    // The library counts its predictions, the bench doesn't write them
+    trace_counters = g_array_new(FALSE, FALSE, sizeof(Trace_Counter));
+    trace_counter_index = g_hash_table_new(g_str_hash, g_str_equal);
+
+    int count = argc - 1;
+    Chunk *chunks = g_new0(Chunk, count);
+    for (int i = 0; i < count; ++i) {
+        chunks[i].name = g_path_get_basename(argv[i + 1]);
+        if (!g_file_get_contents(argv[i + 1], &chunks[i].data,
+                                 &chunks[i].length, &error)) {
+            g_printerr("%s\n", error->message);
+            return 1;
+        }
+    }
+
+    Prediction *onnx = g_new0(Prediction, count);
+    Prediction *native = g_new0(Prediction, count);
+    double onnx_latency =
+        predict_all("onnx", opt_onnx_path, chunks, count, onnx);
+    double native_latency =
+        predict_all("native", opt_weights_path, chunks, count, native);
+
+    int agreed = 0;
+    g_print("%-42s %-14s %-14s\n", "Chunk", "ONNX Runtime", "Native");
+    for (int i = 0; i < count; ++i) {
+        CompressionAlgorithm_Level o = onnx[i].compressor;
+        CompressionAlgorithm_Level n = native[i].compressor;
+        gboolean same = o.algorithm == n.algorithm && o.level == n.level;
+        agreed += same;
+        g_print("%-42s %8s(%2d)     %8s(%2d)     %s\n", chunks[i].name,
+                compressor_to_name(o.algorithm), o.level,
+                compressor_to_name(n.algorithm), n.level,
+                same ? "" : "differs");
+    }
+    g_print("\nAgreement: %d/%d\n", agreed, count);
+    g_print("Latency per chunk (batch %d): ONNX Runtime %.1f us, native%s "
+            "%.1f us (%.2fx)\n",
+            opt_batch, onnx_latency, opt_native_int8 ? " int8" : "",
+            native_latency, onnx_latency / native_latency);
+
+    for (int i = 0; i < count; ++i) {
+        g_free(chunks[i].name);
+        g_free(chunks[i].data);
+    }
+    g_free(chunks);
+    g_free(onnx);
+    g_free(native);
+    g_hash_table_destroy(trace_counter_index);
+    g_array_free(trace_counters, TRUE);
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,4 @@
+#ifndef IOA_TOOLS_INFERENCE_BENCH_H
+#define IOA_TOOLS_INFERENCE_BENCH_H
+#include <inferencing/compression.h>
+#endif
@@ -190,9 +190,13 @@ int main(int argc, char **argv) {
     ORTCHAR_T *input_file = argv[2];
     char *settings_file = argv[3];
 
-    labels = parse_labels(settings_file);
+    int label_count;
+    labels = parse_labels(settings_file, &label_count);
     metric_inferencing = parse_metric(settings_file);
     input_size = model_input_size(settings_file);
+    if (labels == NULL || metric_inferencing == _METRIC_COUNT ||
+        input_size == 0)
+        return 1;
     g_print("Metric: %d, Name: %s, Tensor Size: %d\n", metric_inferencing,
             metric_enum_name(metric_inferencing), input_size);
 